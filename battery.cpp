@@ -0,0 +1,287 @@
+#include <Arduino.h>
+#include "battery.h"
+#include "utility.h"
+#include "telemetry.h"
+#include "logsink.h"
+#include "stats.h"
+#include "cache.h"
+#include <string.h>  // For memcmp
+
+static_assert(BQ_MAX_BATTERIES <= MBA_ARENA_SLOTS, "runOnBatteries keeps one arena slot per battery");
+
+// Completion polling of each battery during a step of runOnBatteries
+static MBAWait batteryWaits[BQ_MAX_BATTERIES];
+
+// Bus clock rates tried by negotiateBatteryClock, slowest (the reference) first
+static const uint32_t batteryClocks[] PROGMEM = { BQ_CLOCK_MIN, 50000, 100000, 200000, 400000 };
+
+// Commands read to check a bus clock rate, their answers never change
+static const Cmd clockProbeCommands[] = { Cmd::DeviceType, Cmd::FirmwareVersion };
+#define CLOCK_PROBE_COMMANDS_COUNT (sizeof(clockProbeCommands) / sizeof(clockProbeCommands[0]))
+
+/**
+ * @brief Makes a battery the target of the ManufacturerBlockAccess functions (selects its bus).
+ *
+ * @param battery  Battery to talk to.
+ */
+void selectBattery(const BQBattery* battery) {
+  selectMBABus(battery->bus);
+}
+
+/**
+ * @brief Probes every battery and prints which ones answer.
+ *
+ * @param batteries  Batteries of the tray.
+ * @param count      Number of batteries.
+ * @param present    Output, receives for each battery whether it answered (`count` entries), may be NULL.
+ *
+ * @return The number of batteries that acknowledged their address.
+ */
+uint8_t scanBatteries(const BQBattery* batteries, uint8_t count, bool* present) {
+  uint8_t found = 0;
+  for (uint8_t i = 0; i < count; i++) {
+    selectBattery(&batteries[i]);
+    BQBus* bus = getMBABus();
+    bus->beginTransmission(batteries[i].address);
+    bool answered = bus->endTransmission() == 0;
+    found += answered;
+    if (present != NULL) {
+      present[i] = answered;
+    }
+    // Whatever was cached may come from another pack
+    evictMBACache(batteries[i].address, 0, true);
+
+    Log.print(F("Battery "));
+    Log.print(batteries[i].name);
+    Log.println(answered ? F(": found") : F(": no answer"));
+  }
+  return found;
+}
+
+/**
+ * @brief Reads the clock probe commands and compares them with a reference.
+ *
+ * @param address    I2C address of the battery.
+ * @param reference  Reference answers, NULL to only read them.
+ * @param slots      Output, receives the answers (CLOCK_PROBE_COMMANDS_COUNT slots).
+ *
+ * @return true if every command was read without retry and matches its reference.
+ */
+static bool probeBatteryClock(uint8_t address, const MBABatchSlot* reference, MBABatchSlot* slots) {
+  uint16_t retries = getMBARetries();
+  uint16_t pecErrors = getMBAPECErrors();
+  // The probe commands are static registers, they must really be read at each rate
+  evictMBACache(address, 0, true);
+  uint8_t succeeded = runMBABatch(address, clockProbeCommands, CLOCK_PROBE_COMMANDS_COUNT, slots);
+  // A retried transaction is a transaction the rate was not good for
+  if (succeeded != CLOCK_PROBE_COMMANDS_COUNT || getMBARetries() != retries || getMBAPECErrors() != pecErrors) {
+    return false;
+  }
+  if (reference == NULL) {
+    return true;
+  }
+  for (uint8_t i = 0; i < CLOCK_PROBE_COMMANDS_COUNT; i++) {
+    const MBAResponse* expected = &reference[i].response;
+    const MBAResponse* response = &slots[i].response;
+    if (response->length != expected->length ||
+        memcmp(response->block, expected->block, 2 + response->length) != 0) {
+      return false;
+    }
+  }
+  return true;
+}
+
+/**
+ * @brief Picks the fastest bus clock a battery answers reliably at, and sets it on its bus.
+ *
+ * DeviceType and FirmwareVersion are first read at the slowest rate (BQ_CLOCK_MIN) as a reference,
+ * then again at each faster rate up to `maxClock`. A rate is kept only if BQ_CLOCK_PROBE_ROUNDS
+ * reads all match the reference without any retry (NACK, timeout or PEC error); the first failing
+ * rate ends the search. A deeply discharged pack therefore ends up between BQ_CLOCK_MIN and 100 kHz.
+ *
+ * @param battery   Battery to negotiate with.
+ * @param maxClock  Fastest rate to try, in Hz (e.g. the result for a battery sharing the same wires).
+ *
+ * @return The selected rate in Hz, BQ_CLOCK_FALLBACK if the battery does not answer at all.
+ */
+uint32_t negotiateBatteryClock(const BQBattery* battery, uint32_t maxClock) {
+  static_assert(2 * CLOCK_PROBE_COMMANDS_COUNT <= MBA_ARENA_SLOTS, "reference and probe answers share the arena");
+  MBABatchSlot* reference = getMBAArena();
+  MBABatchSlot* slots = reference + CLOCK_PROBE_COMMANDS_COUNT;
+
+  selectBattery(battery);
+  BQBus* bus = battery->bus;
+  uint32_t selected = pgm_read_dword(&batteryClocks[0]);
+  bus->setClock(selected);
+
+  if (probeBatteryClock(battery->address, NULL, reference)) {
+    for (uint8_t i = 1; i < sizeof(batteryClocks) / sizeof(batteryClocks[0]); i++) {
+      uint32_t clock = pgm_read_dword(&batteryClocks[i]);
+      if (clock > maxClock) {
+        break;
+      }
+      bus->setClock(clock);
+      bool reliable = true;
+      for (uint8_t round = 0; round < BQ_CLOCK_PROBE_ROUNDS && reliable; round++) {
+        reliable = probeBatteryClock(battery->address, reference, slots);
+      }
+      if (!reliable) {
+        break;
+      }
+      selected = clock;
+    }
+  } else {
+    selected = BQ_CLOCK_FALLBACK;
+  }
+  bus->setClock(selected);
+
+  Log.print(F("Battery "));
+  Log.print(battery->name);
+  Log.print(F(": bus clock "));
+  Log.print(selected / 1000);
+  Log.println(F(" kHz"));
+  return selected;
+}
+
+/**
+ * @brief Negotiates the bus clock of a tray, each set of wires on its own.
+ *
+ * Batteries on separate buses (Wire, SoftwareWire) get their own rate. Batteries behind the
+ * channels of one TCA9548A share the wires of its parent bus, so they share the slowest rate
+ * of the ones present. Batteries that did not answer the scan are not negotiated: their bus
+ * keeps its rate, or takes the one of the present batteries it shares its wires with.
+ *
+ * @param batteries  Batteries of the tray.
+ * @param count      Number of batteries.
+ * @param present    Which batteries answered, as filled by scanBatteries.
+ * @param maxClock   Fastest rate to try, in Hz.
+ */
+void negotiateBatteryClocks(const BQBattery* batteries, uint8_t count, const bool* present, uint32_t maxClock) {
+  for (uint8_t i = 0; i < count; i++) {
+    BQBus* wires = batteries[i].bus->getWires();
+    // The first present battery on a set of wires negotiates it for all of them
+    bool first = present[i];
+    for (uint8_t j = 0; j < i && first; j++) {
+      first = !(present[j] && batteries[j].bus->getWires() == wires);
+    }
+    if (!first) {
+      continue;
+    }
+
+    uint32_t clock = maxClock;
+    for (uint8_t j = i; j < count; j++) {
+      if (present[j] && batteries[j].bus->getWires() == wires) {
+        clock = negotiateBatteryClock(&batteries[j], clock);
+      }
+    }
+    for (uint8_t j = i; j < count; j++) {
+      if (batteries[j].bus->getWires() == wires) {
+        batteries[j].bus->setClock(clock);
+      }
+    }
+  }
+}
+
+/**
+ * @brief Prints the name of a battery before its results (FRAME_BATTERY in OUTPUT_MODE_BINARY).
+ *
+ * @param battery  Battery the next results belong to.
+ */
+void printBatteryName(const BQBattery* battery) {
+  if (getOutputMode() == OUTPUT_MODE_BINARY) {
+    sendTelemetryBattery(battery->name);
+    return;
+  }
+  Log.print(F("[Battery "));
+  Log.print(battery->name);
+  Log.println(F("]"));
+}
+
+/**
+ * @brief Runs a sequence of commands on several batteries in lockstep.
+ *
+ * Each step is sent to every battery first, then their completions are polled together, so
+ * a DeviceReset (or any slow write) costs the same time for N batteries as for one.
+ * Responses are printed per battery once the whole step is done (see printMBABatch).
+ *
+ * @param batteries  Batteries of the tray (up to BQ_MAX_BATTERIES).
+ * @param count      Number of batteries.
+ * @param cmds       Commands to run, in order.
+ * @param length     Number of commands.
+ *
+ * @return The number of failed commands, all batteries included.
+ */
+uint8_t runOnBatteries(const BQBattery* batteries, uint8_t count, const Cmd* cmds, uint8_t length) {
+  MBABatchSlot* slots = getMBAArena();
+  MBAWait* waits = batteryWaits;
+  bool pending[BQ_MAX_BATTERIES];
+  bool cached[BQ_MAX_BATTERIES];
+  uint8_t failures = 0;
+  count = min(count, BQ_MAX_BATTERIES);
+
+  for (uint8_t step = 0; step < length; step++) {
+    const MBACommandInfo* cmdInfo = getMBACommandInfo(cmds[step]);
+    uint32_t startedAt = getMBAStatsTime();
+
+    // Send the step to every battery, nobody waits for anybody yet
+    for (uint8_t i = 0; i < count; i++) {
+      slots[i].id = cmds[step];
+      beginMBAResponse(&slots[i].response, cmdInfo);
+
+      selectBattery(&batteries[i]);
+      cached[i] = lookupMBACache(batteries[i].address, cmdInfo, &slots[i].response);
+      if (cached[i]) {
+        pending[i] = false;
+        continue;
+      }
+      slots[i].response.error = issueMBACommand(batteries[i].address, cmdInfo);
+      pending[i] = slots[i].response.error == 0;
+      if (pending[i]) {
+        beginMBAWait(&waits[i], batteries[i].address, cmdInfo);
+      }
+      delayMicroseconds(SMBUS_BUS_FREE_US);
+    }
+
+    // Poll all the completions together, the device delays overlap
+    bool waiting = true;
+    while (waiting) {
+      waiting = false;
+      for (uint8_t i = 0; i < count; i++) {
+        if (!pending[i]) {
+          continue;
+        }
+        selectBattery(&batteries[i]);
+        MBAWaitStatus status = pollMBAWait(&waits[i]);
+        if (status == MBA_WAIT_PENDING) {
+          waiting = true;
+          continue;
+        }
+        pending[i] = false;
+        if (status == MBA_WAIT_TIMEOUT) {
+          slots[i].response.error = MBA_ERROR_COMPLETION_TIMEOUT;
+        }
+      }
+      Log.drain();
+    }
+
+    // Read the results back and report them battery by battery
+    for (uint8_t i = 0; i < count; i++) {
+      selectBattery(&batteries[i]);
+      if (slots[i].response.error == 0 && !isMBACommandWriteOnly(cmdInfo) && !cached[i]) {
+        readMBAResponse(batteries[i].address, cmdInfo, &slots[i].response);
+        delayMicroseconds(SMBUS_BUS_FREE_US);
+      }
+      if (slots[i].response.error == 0 && !cached[i]) {
+        // Lockstep latency: from the start of the step until this battery is served
+        recordMBACommand(cmds[step], getMBAStatsTime() - startedAt);
+      }
+      failures += slots[i].response.error != 0;
+
+      if (count > 1 || getOutputMode() == OUTPUT_MODE_BINARY) {
+        printBatteryName(&batteries[i]);
+      }
+      printMBABatch(&slots[i], 1);
+    }
+  }
+  return failures;
+}
@@ -0,0 +1,101 @@
+#ifndef BATTERY_H
+#define BATTERY_H
+
+#include <Arduino.h>
+#include "bqbus.h"
+#include "bqcmd.h"
+
+// Maximum number of batteries serviced together by runOnBatteries
+#define BQ_MAX_BATTERIES 8
+
+// Bus clock kept when a battery does not answer at the slowest rate tried by negotiateBatteryClock
+#define BQ_CLOCK_FALLBACK BQ_CLOCK_MIN
+
+// Reads of DeviceType/FirmwareVersion that must all match the reference at a rate to keep it
+#define BQ_CLOCK_PROBE_ROUNDS 3
+
+// A battery of the tray: all gauges answer at 0x0B, each one needs its own bus
+struct BQBattery {
+  const char* name;  // Short name printed before its results (e.g. "A")
+  BQBus* bus;
+  uint8_t address;
+};
+
+/**
+ * @brief Makes a battery the target of the ManufacturerBlockAccess functions (selects its bus).
+ *
+ * @param battery  Battery to talk to.
+ */
+void selectBattery(const BQBattery* battery);
+
+/**
+ * @brief Probes every battery and prints which ones answer.
+ *
+ * @param batteries  Batteries of the tray.
+ * @param count      Number of batteries.
+ * @param present    Output, receives for each battery whether it answered (`count` entries), may be NULL.
+ *
+ * @return The number of batteries that acknowledged their address.
+ */
+uint8_t scanBatteries(const BQBattery* batteries, uint8_t count, bool* present = NULL);
+
+/**
+ * @brief Picks the fastest bus clock a battery answers reliably at, and sets it on its bus.
+ *
+ * DeviceType and FirmwareVersion are first read at the slowest rate (BQ_CLOCK_MIN) as a reference,
+ * then again at each faster rate up to `maxClock`. A rate is kept only if BQ_CLOCK_PROBE_ROUNDS
+ * reads all match the reference without any retry (NACK, timeout or PEC error); the first failing
+ * rate ends the search. A deeply discharged pack therefore ends up between BQ_CLOCK_MIN and 100 kHz.
+ *
+ * @param battery   Battery to negotiate with.
+ * @param maxClock  Fastest rate to try, in Hz (e.g. the result for a battery sharing the same wires).
+ *
+ * @return The selected rate in Hz, BQ_CLOCK_FALLBACK if the battery does not answer at all.
+ */
+uint32_t negotiateBatteryClock(const BQBattery* battery, uint32_t maxClock);
+
+/**
+ * @brief Negotiates the bus clock of a tray, each set of wires on its own.
+ *
+ * Batteries on separate buses (Wire, SoftwareWire) get their own rate. Batteries behind the
+ * channels of one TCA9548A share the wires of its parent bus, so they share the slowest rate
+ * of the ones present. Batteries that did not answer the scan are not negotiated: their bus
+ * keeps its rate, or takes the one of the present batteries it shares its wires with.
+ *
+ * @param batteries  Batteries of the tray.
+ * @param count      Number of batteries.
+ * @param present    Which batteries answered, as filled by scanBatteries.
+ * @param maxClock   Fastest rate to try, in Hz.
+ */
+void negotiateBatteryClocks(const BQBattery* batteries, uint8_t count, const bool* present, uint32_t maxClock);
+
+/**
+ * @brief Prints the name of a battery before its results (FRAME_BATTERY in OUTPUT_MODE_BINARY).
+ *
+ * @param battery  Battery the next results belong to.
+ */
+void printBatteryName(const BQBattery* battery);
+
+/**
+ * @brief Runs a sequence of commands on several batteries in lockstep.
+ *
+ * Each step is sent to every battery first, then their completions are polled together, so
+ * a DeviceReset (or any slow write) costs the same time for N batteries as for one.
+ * Responses are printed per battery once the whole step is done (see printMBABatch).
+ *
+ * @param batteries  Batteries of the tray (up to BQ_MAX_BATTERIES).
+ * @param count      Number of batteries.
+ * @param cmds       Commands to run, in order.
+ * @param length     Number of commands.
+ *
+ * @return The number of failed commands, all batteries included.
+ *
+ * Example usage:
+ * @code
+ * static const Cmd unseal[] = { Cmd::UnsealKey1, Cmd::UnsealKey2 };
+ * runOnBatteries(batteries, 4, unseal, 2);
+ * @endcode
+ */
+uint8_t runOnBatteries(const BQBattery* batteries, uint8_t count, const Cmd* cmds, uint8_t length);
+
+#endif // BATTERY_H
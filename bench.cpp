@@ -0,0 +1,186 @@
+#include <Arduino.h>
+#include "bench.h"
+#include "utility.h"
+#include "unlock.h"
+#include "logsink.h"
+
+static void beginBenchResult(BenchResult* result) {
+  result->commands = 0;
+  result->failed = 0;
+  result->bytes = 0;
+  result->elapsedUs = micros();
+}
+
+static void endBenchResult(BenchResult* result) {
+  result->elapsedUs = micros() - result->elapsedUs;
+  // Flush the output of the run so it is counted in it, not in the next one
+  Log.flush();
+}
+
+/**
+ * @brief Runs a list of read commands `rounds` times with runMBABatch and measures the throughput.
+ *
+ * @param address  I2C device address.
+ * @param cmds     Commands of one round, up to MBA_ARENA_SLOTS (they use the shared arena).
+ * @param count    Number of commands.
+ * @param rounds   Number of rounds.
+ * @param print    true to decode and print every round (printMBABatch), false for the bus work only.
+ * @param result   Output, receives the counters.
+ */
+void benchMBABatch(uint8_t address, const Cmd* cmds, uint8_t count, uint8_t rounds, bool print, BenchResult* result) {
+  MBABatchSlot* slots = getMBAArena();
+  count = min(count, (uint8_t)MBA_ARENA_SLOTS);
+  beginBenchResult(result);
+  for (uint8_t r = 0; r < rounds; r++) {
+    uint8_t succeeded = runMBABatch(address, cmds, count, slots);
+    result->commands += count;
+    result->failed += count - succeeded;
+    for (uint8_t i = 0; i < count; i++) {
+      result->bytes += slots[i].response.length;
+    }
+    if (print) {
+      printMBABatch(slots, count);
+    }
+    Log.drain();
+  }
+  endBenchResult(result);
+}
+
+/**
+ * @brief Runs a list of read commands `rounds` times one by one with runMBACommand and measures the throughput.
+ *
+ * This is the path of the interactive commands: send, wait, read and print for each command.
+ *
+ * @param address  I2C device address.
+ * @param cmds     Commands of one round.
+ * @param count    Number of commands.
+ * @param rounds   Number of rounds.
+ * @param result   Output, receives the counters.
+ */
+void benchMBACommands(uint8_t address, const Cmd* cmds, uint8_t count, uint8_t rounds, BenchResult* result) {
+  beginBenchResult(result);
+  for (uint8_t r = 0; r < rounds; r++) {
+    for (uint8_t i = 0; i < count; i++) {
+      result->commands++;
+      if (runMBACommand(address, cmds[i])) {
+        // runMBACommand keeps its response in the first slot of the arena
+        result->bytes += getMBAArena()->response.length;
+      } else {
+        result->failed++;
+      }
+    }
+  }
+  endBenchResult(result);
+}
+
+/**
+ * @brief Reads every SBS register `rounds` times with readSBSWord and measures the throughput.
+ *
+ * @param address  I2C device address.
+ * @param rounds   Number of rounds.
+ * @param result   Output, receives the counters.
+ */
+void benchSBSReads(uint8_t address, uint8_t rounds, BenchResult* result) {
+  beginBenchResult(result);
+  for (uint8_t r = 0; r < rounds; r++) {
+    for (uint8_t i = 0; i < static_cast<uint8_t>(Sbs::Count); i++) {
+      uint16_t value;
+      result->commands++;
+      if (readSBSWord(address, static_cast<Sbs>(i), &value) == 0) {
+        result->bytes += sizeof(value);
+      } else {
+        result->failed++;
+      }
+    }
+  }
+  endBenchResult(result);
+}
+
+/**
+ * @brief Runs the whole unlock sequence on a battery and returns how long it took.
+ *
+ * ⚠️ This really unlocks and resets the battery, use it with a SimulatedGauge (see simgauge.h).
+ *
+ * @param battery  Battery to unlock.
+ *
+ * @return Duration of the unlock in ms, printing included.
+ */
+uint32_t benchUnlock(const BQBattery* battery) {
+  UnlockTask task;
+  unsigned long startedAt = millis();
+  beginUnlockTask(&task, battery);
+  while (pollUnlockTask(&task)) {
+    Log.drain();
+  }
+  Log.flush();
+  return millis() - startedAt;
+}
+
+/**
+ * @brief Prints one line of results: commands/s, bytes/s, mean time per command and failures.
+ *
+ * @param name    Name of the run.
+ * @param result  Counters of the run.
+ */
+void printBenchResult(const __FlashStringHelper* name, const BenchResult* result) {
+  // Rates from the time in ms, so they fit 32 bits
+  uint32_t elapsedMs = max(result->elapsedUs / 1000, 1UL);
+  Log.print(name);
+  Log.print(F(": "));
+  Log.print(result->commands);
+  Log.print(F(" cmds in "));
+  Log.print(elapsedMs);
+  Log.print(F(" ms, "));
+  Log.print(result->commands * 1000UL / elapsedMs);
+  Log.print(F(" cmds/s, "));
+  Log.print(result->bytes * 1000UL / elapsedMs);
+  Log.print(F(" bytes/s, "));
+  Log.print(result->commands != 0 ? result->elapsedUs / result->commands : 0);
+  Log.print(F(" us/cmd, "));
+  Log.print(result->failed);
+  Log.println(F(" failed"));
+}
+
+/**
+ * @brief Runs every benchmark on a battery and prints the summary once all of them are done.
+ *
+ * The output of the runs that print is part of what is measured. OUTPUT_MODE and the bus clock
+ * are the ones set by the caller, so running it again with other settings compares them.
+ * The summary is always text, in OUTPUT_MODE_BINARY it follows the frames of the runs.
+ *
+ * @param battery  Battery to measure.
+ * @param cmds     Read commands of one round, up to MBA_ARENA_SLOTS.
+ * @param count    Number of commands.
+ * @param rounds   Number of rounds of each run.
+ * @param unlock   true to also time the unlock sequence (only on a SimulatedGauge).
+ */
+void runBenchmark(const BQBattery* battery, const Cmd* cmds, uint8_t count, uint8_t rounds, bool unlock) {
+  BenchResult busOnly, batch, single, sbs;
+  uint32_t unlockMs = 0;
+
+  selectBattery(battery);
+  benchMBABatch(battery->address, cmds, count, rounds, false, &busOnly);
+  benchMBABatch(battery->address, cmds, count, rounds, true, &batch);
+  benchMBACommands(battery->address, cmds, count, rounds, &single);
+  benchSBSReads(battery->address, rounds, &sbs);
+  if (unlock) {
+    unlockMs = benchUnlock(battery);
+  }
+
+  Log.println();
+  Log.print(F("Benchmark of battery "));
+  Log.print(battery->name);
+  Log.print(F(", "));
+  Log.print(rounds);
+  Log.println(F(" rounds:"));
+  printBenchResult(F("Batch, bus only"), &busOnly);
+  printBenchResult(F("Batch + print"), &batch);
+  printBenchResult(F("runMBACommand"), &single);
+  printBenchResult(F("SBS words"), &sbs);
+  if (unlock) {
+    Log.print(F("Unlock sequence: "));
+    Log.print(unlockMs);
+    Log.println(F(" ms"));
+  }
+  Log.println();
+}
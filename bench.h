@@ -0,0 +1,83 @@
+#ifndef BENCH_H
+#define BENCH_H
+
+#include <Arduino.h>
+#include "bqcmd.h"
+#include "battery.h"
+
+// Throughput of one benchmark run
+struct BenchResult {
+  uint16_t commands;   // Commands (or SBS reads) run
+  uint16_t failed;     // Commands that failed
+  uint32_t bytes;      // Response payload bytes received
+  uint32_t elapsedUs;  // Wall time, printing included
+};
+
+/**
+ * @brief Runs a list of read commands `rounds` times with runMBABatch and measures the throughput.
+ *
+ * @param address  I2C device address.
+ * @param cmds     Commands of one round, up to MBA_ARENA_SLOTS (they use the shared arena).
+ * @param count    Number of commands.
+ * @param rounds   Number of rounds.
+ * @param print    true to decode and print every round (printMBABatch), false for the bus work only.
+ * @param result   Output, receives the counters.
+ */
+void benchMBABatch(uint8_t address, const Cmd* cmds, uint8_t count, uint8_t rounds, bool print, BenchResult* result);
+
+/**
+ * @brief Runs a list of read commands `rounds` times one by one with runMBACommand and measures the throughput.
+ *
+ * This is the path of the interactive commands: send, wait, read and print for each command.
+ *
+ * @param address  I2C device address.
+ * @param cmds     Commands of one round.
+ * @param count    Number of commands.
+ * @param rounds   Number of rounds.
+ * @param result   Output, receives the counters.
+ */
+void benchMBACommands(uint8_t address, const Cmd* cmds, uint8_t count, uint8_t rounds, BenchResult* result);
+
+/**
+ * @brief Reads every SBS register `rounds` times with readSBSWord and measures the throughput.
+ *
+ * @param address  I2C device address.
+ * @param rounds   Number of rounds.
+ * @param result   Output, receives the counters.
+ */
+void benchSBSReads(uint8_t address, uint8_t rounds, BenchResult* result);
+
+/**
+ * @brief Runs the whole unlock sequence on a battery and returns how long it took.
+ *
+ * ⚠️ This really unlocks and resets the battery, use it with a SimulatedGauge (see simgauge.h).
+ *
+ * @param battery  Battery to unlock.
+ *
+ * @return Duration of the unlock in ms, printing included.
+ */
+uint32_t benchUnlock(const BQBattery* battery);
+
+/**
+ * @brief Prints one line of results: commands/s, bytes/s, mean time per command and failures.
+ *
+ * @param name    Name of the run.
+ * @param result  Counters of the run.
+ */
+void printBenchResult(const __FlashStringHelper* name, const BenchResult* result);
+
+/**
+ * @brief Runs every benchmark on a battery and prints the summary once all of them are done.
+ *
+ * The output of the runs that print is part of what is measured. OUTPUT_MODE and the bus clock
+ * are the ones set by the caller, so running it again with other settings compares them.
+ *
+ * @param battery  Battery to measure.
+ * @param cmds     Read commands of one round, up to MBA_ARENA_SLOTS.
+ * @param count    Number of commands.
+ * @param rounds   Number of rounds of each run.
+ * @param unlock   true to also time the unlock sequence (only on a SimulatedGauge).
+ */
+void runBenchmark(const BQBattery* battery, const Cmd* cmds, uint8_t count, uint8_t rounds, bool unlock);
+
+#endif // BENCH_H
@@ -0,0 +1,155 @@
+#include <Arduino.h>
+#include <Wire.h>
+#include "bqbus.h"
+#include "deadline.h"
+
+WireBus<TwoWire> hardwareBus(Wire, SDA, SCL);
+
+static BQBus* mbaBus = &hardwareBus;
+
+/**
+ * @brief Bounds how long a single Wire call may block, with Wire.setWireTimeout when the core has it.
+ *
+ * On timeout, the TWI hardware is reset and the call fails with code 5.
+ *
+ * @param timeoutUs  Timeout in microseconds.
+ */
+template <>
+void WireBus<TwoWire>::setTimeout(uint16_t timeoutUs) {
+  if (timeoutUs == this->timeoutUs) {
+    return;
+  }
+  this->timeoutUs = timeoutUs;
+#if defined(WIRE_HAS_TIMEOUT)
+  wire.setWireTimeout(timeoutUs, true);
+#endif
+}
+
+/**
+ * @brief Starts the write of a command byte followed by a repeated-start read, see pollRequest.
+ *
+ * Runs the whole transfer before returning. The read is not started if the write already
+ * took the whole time of the transaction (see startBusDeadline).
+ *
+ * @param address   I2C address of the target device.
+ * @param command   Command byte written first.
+ * @param quantity  Number of bytes to read.
+ */
+void BQBus::startRequest(uint8_t address, uint8_t command, uint8_t quantity) {
+  beginTransmission(address);
+  write(command);
+  // Repeated start for read
+  requestResult = endTransmission(false);
+  if (requestResult == 0 && isBusDeadlineExpired()) {
+    requestResult = 5;
+  }
+  if (requestResult == 0) {
+    requestFrom(address, quantity);
+  }
+}
+
+/**
+ * @brief Sets the clock of the hardware TWI, no slower than BQ_CLOCK_MIN.
+ *
+ * @param clock  Rate in Hz, raised to BQ_CLOCK_MIN (see there why a slower one is unsafe).
+ */
+template <>
+void WireBus<TwoWire>::setClock(uint32_t clock) {
+  this->clock = max(clock, (uint32_t)BQ_CLOCK_MIN);
+  wire.setClock(this->clock);
+}
+
+// Half period of the recovery clock, 100 kHz at most
+#define I2C_RECOVERY_HALF_PERIOD_US 5
+
+/**
+ * @brief Frees an I2C bus whose SDA line is held low by a device stuck in the middle of a byte.
+ *
+ * Clocks SCL up to 9 times until the device releases SDA, then generates a STOP condition.
+ * The I2C interface using these pins must be disabled while this runs.
+ *
+ * @param sdaPin  SDA pin (20 on the Mega 2560).
+ * @param sclPin  SCL pin (21 on the Mega 2560).
+ *
+ * @return true if SDA is high (bus free) at the end.
+ */
+bool recoverI2CBus(uint8_t sdaPin, uint8_t sclPin) {
+  // Open-drain emulation: a line is driven low as OUTPUT LOW and released as INPUT_PULLUP
+  pinMode(sdaPin, INPUT_PULLUP);
+  pinMode(sclPin, INPUT_PULLUP);
+  delayMicroseconds(I2C_RECOVERY_HALF_PERIOD_US);
+
+  // Each clock lets the stuck device shift out one more bit, 9 covers a whole byte and its ACK
+  for (uint8_t i = 0; i < 9 && digitalRead(sdaPin) == LOW; i++) {
+    digitalWrite(sclPin, LOW);
+    pinMode(sclPin, OUTPUT);
+    delayMicroseconds(I2C_RECOVERY_HALF_PERIOD_US);
+    pinMode(sclPin, INPUT_PULLUP);
+    delayMicroseconds(I2C_RECOVERY_HALF_PERIOD_US);
+  }
+
+  // STOP condition: SDA rises while SCL is high
+  digitalWrite(sdaPin, LOW);
+  pinMode(sdaPin, OUTPUT);
+  delayMicroseconds(I2C_RECOVERY_HALF_PERIOD_US);
+  pinMode(sdaPin, INPUT_PULLUP);
+  delayMicroseconds(I2C_RECOVERY_HALF_PERIOD_US);
+
+  return digitalRead(sdaPin) == HIGH;
+}
+
+/**
+ * @brief Routes the parent bus to one channel.
+ *
+ * @param channel  Channel number (0-7).
+ *
+ * @return The Wire.endTransmission() code of the multiplexer write, 0 on success.
+ */
+uint8_t TCA9548A::select(uint8_t channel) {
+  if (selected == channel) {
+    return 0;
+  }
+  parent.beginTransmission(address);
+  parent.write(1 << channel);
+  uint8_t result = parent.endTransmission();
+  selected = result == 0 ? channel : -1;
+  return result;
+}
+
+/**
+ * @brief Selects the channel, then begins the transaction on the parent bus.
+ *
+ * @param address  I2C address of the target device.
+ */
+void MuxChannelBus::beginTransmission(uint8_t address) {
+  selectError = mux.select(channel);
+  mux.getParent().beginTransmission(address);
+}
+
+/**
+ * @brief Ends the transaction, reporting a failed channel selection first.
+ *
+ * @param stop  false to keep the bus for a repeated start.
+ *
+ * @return The Wire.endTransmission() code, the multiplexer one if the selection failed.
+ */
+uint8_t MuxChannelBus::endTransmission(bool stop) {
+  uint8_t result = mux.getParent().endTransmission(stop);
+  return selectError != 0 ? selectError : result;
+}
+
+/**
+ * @brief Selects the bus used by every ManufacturerBlockAccess function of bqcmd.cpp.
+ *
+ * @param bus  Bus to use, hardware Wire by default.
+ */
+void selectMBABus(BQBus* bus) {
+  mbaBus = bus;
+}
+
+/**
+ * @brief Returns the bus currently used by bqcmd.cpp.
+ */
+BQBus* getMBABus() {
+  return mbaBus;
+}
@@ -0,0 +1,253 @@
+#ifndef BQBUS_H
+#define BQBUS_H
+
+#include <Arduino.h>
+#include <Wire.h>
+
+// Default I2C address of a TCA9548A multiplexer (A0-A2 low)
+#define TCA9548A_DEFAULT_ADDR 0x70
+
+// Bytes a single read can carry. The AVR Wire and SoftwareWire buffers hold 32, the ESP32 and
+// RP2040 cores 128 or more: a whole 32-byte block (length, subcommand echo, data, PEC) then fits
+#if defined(ESP32) || defined(ARDUINO_ARCH_RP2040)
+#define BQ_BUS_BUFFER_SIZE 36
+#else
+#define BQ_BUS_BUFFER_SIZE 32
+#endif
+
+// Slowest bus clock. The Mega TWI without its prescaler cannot go below F_CPU / (16 + 2 * 255),
+// about 30 kHz at 16 MHz: AVR Wire.setClock() truncates TWBR to 8 bits, so a slower rate wraps
+// around to a much faster one (10 kHz gives about 250 kHz)
+#if defined(TWBR)
+#define BQ_CLOCK_MIN 32000
+#else
+#define BQ_CLOCK_MIN 10000
+#endif
+
+// Result of pollRequest while the request is still running
+#define BQ_REQUEST_PENDING 0xFF
+
+/**
+ * @brief I2C bus a battery is reachable on.
+ *
+ * All smart batteries answer at the same address, so servicing several of them means one bus
+ * per battery: the Mega hardware TWI, SoftwareWire instances on spare pins or channels of a
+ * TCA9548A multiplexer. The method set is the subset of the Wire API used by bqcmd.cpp, plus
+ * startRequest/pollRequest through which a bus able to run a transfer by itself (DMA or
+ * interrupt driven I2C, as on the ESP32 and RP2040) lets the CPU work while it completes.
+ */
+class BQBus {
+public:
+
+  virtual void begin() = 0;
+  virtual void setClock(uint32_t clock) = 0;
+  virtual void beginTransmission(uint8_t address) = 0;
+  virtual size_t write(uint8_t data) = 0;
+  virtual uint8_t endTransmission(bool stop = true) = 0;
+  virtual uint8_t requestFrom(uint8_t address, uint8_t quantity) = 0;
+  virtual int available() = 0;
+  virtual int read() = 0;
+
+  /**
+   * @brief Frees a bus held by a device and initializes the interface again.
+   *
+   * @return true if the bus is free afterwards, false if it is still stuck or cannot be recovered.
+   */
+  virtual bool recover() = 0;
+
+  /**
+   * @brief Bounds how long a single bus operation may block (clock stretching, stuck lines).
+   *
+   * An operation running out of time fails with code 5. Only buses whose library supports
+   * it honor this, others keep their own behavior.
+   *
+   * @param timeoutUs  Timeout in microseconds.
+   */
+  virtual void setTimeout(uint16_t timeoutUs) = 0;
+
+  /**
+   * @brief Returns the bus whose wires this one drives, the bus itself unless it is a multiplexer channel.
+   *
+   * Buses returning the same wires share their clock and their electrical limits.
+   */
+  virtual BQBus* getWires() { return this; }
+
+  /**
+   * @brief Starts the write of a command byte followed by a repeated-start read, without waiting.
+   *
+   * Once pollRequest reports it done, the bytes received are taken with available() and read().
+   * One request runs at a time per bus. The default implementation does the whole transfer
+   * at once with beginTransmission, write, endTransmission and requestFrom, so a bus only
+   * overrides it when its hardware can complete the transfer in the background.
+   *
+   * @param address   I2C address of the target device.
+   * @param command   Command byte written first (e.g. ManufacturerBlockAccess).
+   * @param quantity  Number of bytes to read, up to BQ_BUS_BUFFER_SIZE.
+   */
+  virtual void startRequest(uint8_t address, uint8_t command, uint8_t quantity);
+
+  /**
+   * @brief Returns the state of the request started by startRequest.
+   *
+   * @return BQ_REQUEST_PENDING while it runs, then the endTransmission() code of its write
+   *         (0 on success, 5 if the read timed out).
+   */
+  virtual uint8_t pollRequest() { return requestResult; }
+
+protected:
+  uint8_t requestResult = 0;  // Result of the last request of the default implementation
+};
+
+/**
+ * @brief Frees an I2C bus whose SDA line is held low by a device stuck in the middle of a byte.
+ *
+ * Clocks SCL up to 9 times until the device releases SDA, then generates a STOP condition.
+ * The I2C interface using these pins must be disabled while this runs.
+ *
+ * @param sdaPin  SDA pin (20 on the Mega 2560).
+ * @param sclPin  SCL pin (21 on the Mega 2560).
+ *
+ * @return true if SDA is high (bus free) at the end.
+ */
+bool recoverI2CBus(uint8_t sdaPin, uint8_t sclPin);
+
+/**
+ * @brief BQBus backed by any Wire-compatible object (TwoWire, SoftwareWire, ...).
+ *
+ * Example usage:
+ * @code
+ * WireBus<TwoWire> hardwareBus(Wire, SDA, SCL);
+ * SoftwareWire softWire(4, 5);               // SDA, SCL
+ * WireBus<SoftwareWire> softwareBus(softWire, 4, 5);
+ * @endcode
+ *
+ * The pins are only needed by recover(), without them the bus can only be initialized again.
+ */
+template <class WireType>
+class WireBus : public BQBus {
+public:
+  explicit WireBus(WireType& wire, int8_t sdaPin = -1, int8_t sclPin = -1)
+    : wire(wire), sdaPin(sdaPin), sclPin(sclPin), clock(0), timeoutUs(0) {}
+
+  void begin() override { wire.begin(); }
+  void setClock(uint32_t clock) override {
+    this->clock = clock;
+    wire.setClock(clock);
+  }
+  void beginTransmission(uint8_t address) override { wire.beginTransmission(address); }
+  size_t write(uint8_t data) override { return wire.write(data); }
+  uint8_t endTransmission(bool stop = true) override { return wire.endTransmission(stop); }
+  uint8_t requestFrom(uint8_t address, uint8_t quantity) override { return wire.requestFrom(address, quantity); }
+  int available() override { return wire.available(); }
+  int read() override { return wire.read(); }
+
+  bool recover() override {
+    bool freed = true;
+    wire.end();
+    if (sdaPin >= 0 && sclPin >= 0) {
+      freed = recoverI2CBus(sdaPin, sclPin);
+    }
+    wire.begin();
+    if (clock != 0) {
+      wire.setClock(clock);
+    }
+    // Applied again on the next transaction
+    timeoutUs = 0;
+    return freed;
+  }
+
+  // Only the hardware TwoWire has a timeout (specialized in bqbus.cpp)
+  void setTimeout(uint16_t timeoutUs) override { this->timeoutUs = timeoutUs; }
+
+private:
+  WireType& wire;
+  int8_t sdaPin;
+  int8_t sclPin;
+  uint32_t clock;      // Last setClock() value, restored by recover()
+  uint16_t timeoutUs;  // Last setTimeout() value, 0 if not applied yet
+};
+
+template <>
+void WireBus<TwoWire>::setTimeout(uint16_t timeoutUs);
+
+template <>
+void WireBus<TwoWire>::setClock(uint32_t clock);
+
+/**
+ * @brief TCA9548A 8-channel I2C multiplexer sitting on a parent bus.
+ *
+ * Remembers the selected channel so that consecutive transactions on the same channel
+ * do not cost an extra write to the multiplexer.
+ */
+class TCA9548A {
+public:
+  explicit TCA9548A(BQBus& parent, uint8_t address = TCA9548A_DEFAULT_ADDR)
+    : parent(parent), address(address), selected(-1) {}
+
+  /**
+   * @brief Routes the parent bus to one channel.
+   *
+   * @param channel  Channel number (0-7).
+   *
+   * @return The Wire.endTransmission() code of the multiplexer write, 0 on success.
+   */
+  uint8_t select(uint8_t channel);
+
+  BQBus& getParent() { return parent; }
+
+  // Forgets the selected channel, e.g. after the multiplexer was reset by a bus recovery
+  void invalidate() { selected = -1; }
+
+private:
+  BQBus& parent;
+  uint8_t address;
+  int8_t selected;
+};
+
+/**
+ * @brief BQBus reaching one channel of a TCA9548A.
+ *
+ * The channel is selected when a transaction begins. requestFrom does not reselect it, so a
+ * write followed by a repeated-start read (as done by readMBAResponse) stays on the same channel.
+ */
+class MuxChannelBus : public BQBus {
+public:
+  MuxChannelBus(TCA9548A& mux, uint8_t channel) : mux(mux), channel(channel) {}
+
+  void begin() override { mux.getParent().begin(); }
+  void setClock(uint32_t clock) override { mux.getParent().setClock(clock); }
+  void beginTransmission(uint8_t address) override;
+  size_t write(uint8_t data) override { return mux.getParent().write(data); }
+  uint8_t endTransmission(bool stop = true) override;
+  uint8_t requestFrom(uint8_t address, uint8_t quantity) override { return mux.getParent().requestFrom(address, quantity); }
+  int available() override { return mux.getParent().available(); }
+  int read() override { return mux.getParent().read(); }
+  bool recover() override {
+    mux.invalidate();
+    return mux.getParent().recover();
+  }
+  void setTimeout(uint16_t timeoutUs) override { mux.getParent().setTimeout(timeoutUs); }
+  BQBus* getWires() override { return mux.getParent().getWires(); }
+
+private:
+  TCA9548A& mux;
+  uint8_t channel;
+  uint8_t selectError = 0;
+};
+
+/**
+ * @brief Selects the bus used by every ManufacturerBlockAccess function of bqcmd.cpp.
+ *
+ * @param bus  Bus to use, hardware Wire by default.
+ */
+void selectMBABus(BQBus* bus);
+
+/**
+ * @brief Returns the bus currently used by bqcmd.cpp.
+ */
+BQBus* getMBABus();
+
+// Hardware TWI (Wire, pins SDA/SCL) as a BQBus, used by default
+extern WireBus<TwoWire> hardwareBus;
+
+#endif // BQBUS_H
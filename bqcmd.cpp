@@ -1,14 +1,77 @@
 #include <Arduino.h>
 #include <Wire.h>
+#include "bqbus.h"
 #include "utility.h"
-#include <string.h>  // For strcmp
+#include "telemetry.h"
+#include <string.h>  // For strcmp_P
+#include "logsink.h"
+#include "pec.h"
+#include "deadline.h"
+#include "stats.h"
+#include "cache.h"
+
+// Shared transaction arena (see getMBAArena)
+static MBABatchSlot mbaArena[MBA_ARENA_SLOTS];
+
+// SMBus packet error checking (see setMBAPECEnabled)
+static bool pecEnabled = false;
+static uint16_t pecErrors = 0;
+static uint16_t pecUnverified = 0;
+
+// Retry policy of the transactions NACKed or timed out (see setMBARetryPolicy)
+static uint8_t retryAttempts = MBA_RETRY_ATTEMPTS;
+static uint8_t retryDelayMs = MBA_RETRY_DELAY_MS;
+static uint8_t retryDelayMaxMs = MBA_RETRY_DELAY_MAX_MS;
+static uint16_t retries = 0;
+static uint16_t busRecoveries = 0;
+
+/**
+ * @brief Retrieves the identifier of a ManufacturerBlockAccess command by its name.
+ *
+ * Binary search over the MBACommandsByName index (sorted at compile time), intended for
+ * names coming from a serial console rather than from code.
+ *
+ * @param name  The name of the command to search for (e.g., "DeviceType").
+ * @param id    Output, receives the command identifier when found.
+ *
+ * @return true if a command with this name exists, false otherwise or if `name` is NULL.
+ *
+ * @note The name comparison is case-sensitive.
+ */
+bool getMBACommandIdByName(const char* name, Cmd* id) {
+    if (name == NULL) {
+        return false;
+    }
+
+    size_t low = 0;
+    size_t high = sizeof(MBACommandsByName) / sizeof(MBACommandsByName[0]);
+
+    while (low < high) {
+        size_t middle = (low + high) / 2;
+        Cmd candidate = static_cast<Cmd>(pgm_read_byte(&MBACommandsByName[middle]));
+        int order = strcmp_P(name, getMBACommandInfo(candidate)->name);
+        if (order == 0) {
+            *id = candidate;
+            return true;
+        }
+        if (order < 0) {
+            high = middle;
+        } else {
+            low = middle + 1;
+        }
+    }
+
+    // No matching command found
+    return false;
+}
 
 /**
  * @brief Retrieves a pointer to a ManufacturerBlockAccess command by its name.
  *
- * This function searches the static MBACommandsInfo array for a command whose `name` field
+ * This function searches the MBACommandsByName index for a command whose `name` field
  * matches the specified string (case-sensitive), and returns a pointer to its corresponding
- * MBACommandInfo structure.
+ * MBACommandInfo structure. The returned pointer points into PROGMEM.
+ * Prefer getMBACommandInfo(Cmd) when the command is known at compile time.
  *
  * @param name  The name of the command to search for (e.g., "DeviceType").
  *              Must not be NULL.
@@ -19,21 +82,455 @@
  * @note The name comparison is case-sensitive.
  */
 const MBACommandInfo* getMBACommandInfoByName(const char* name) {
-    if (name == NULL) {
+    Cmd id;
+    if (!getMBACommandIdByName(name, &id)) {
         return NULL;
     }
-    
-    // Number of commands in the array
-    size_t count = sizeof(MBACommandsInfo) / sizeof(MBACommandsInfo[0]);
-    
-    for (size_t i = 0; i < count; ++i) {
-        if (strcmp(MBACommandsInfo[i].name, name) == 0) {
-            return &MBACommandsInfo[i];
+    return getMBACommandInfo(id);
+}
+
+/**
+ * @brief Retrieves the identifier of an SBS word register by its name.
+ *
+ * Linear search, the SBS table only has a few entries. Intended for names coming from a
+ * serial console, like getMBACommandIdByName.
+ *
+ * @param name  The name of the register to search for (e.g., "Voltage").
+ * @param id    Output, receives the register identifier when found.
+ *
+ * @return true if a register with this name exists, false otherwise or if `name` is NULL.
+ *
+ * @note The name comparison is case-sensitive.
+ */
+bool getSBSRegisterIdByName(const char* name, Sbs* id) {
+    if (name == NULL) {
+        return false;
+    }
+    for (uint8_t i = 0; i < static_cast<uint8_t>(Sbs::Count); i++) {
+        if (strcmp_P(name, getSBSRegisterInfo(static_cast<Sbs>(i))->name) == 0) {
+            *id = static_cast<Sbs>(i);
+            return true;
         }
     }
-    
-    // No matching command found
-    return NULL;
+    return false;
+}
+
+/**
+ * @brief Returns the statically allocated arena of MBA_ARENA_SLOTS results.
+ *
+ * runMBACommand and runOnBatteries use it instead of response buffers on the stack, so
+ * their stack usage does not depend on the number of commands or batteries.
+ * It is shared: its content is only valid until the next call of one of them.
+ */
+MBABatchSlot* getMBAArena() {
+  return mbaArena;
+}
+
+/**
+ * @brief Enables SMBus packet error checking (PEC) on every transaction.
+ *
+ * Writes are followed by their PEC byte, reads request it and check it. A transaction
+ * failing its check is done again at once, up to MBA_PEC_RETRIES times, instead of failing
+ * the whole command.
+ *
+ * @param enabled  true to use PEC, false by default.
+ */
+void setMBAPECEnabled(bool enabled) {
+  pecEnabled = enabled;
+}
+
+/**
+ * @brief Returns whether SMBus packet error checking is enabled.
+ */
+bool isMBAPECEnabled() {
+  return pecEnabled;
+}
+
+/**
+ * @brief Returns the number of PEC mismatches seen since startup, retried ones included.
+ */
+uint16_t getMBAPECErrors() {
+  return pecErrors;
+}
+
+/**
+ * @brief Returns the number of block reads done with PEC enabled but not checked, since startup.
+ *
+ * Echo polls are counted too. A block filling the bus buffer (truncated, or exactly BQ_BUS_BUFFER_SIZE - 1 bytes long) leaves
+ * no room for its PEC byte. Such a block is returned with `unverified` set rather than as an error.
+ */
+uint16_t getMBAPECUnverified() {
+  return pecUnverified;
+}
+
+/**
+ * @brief Sets how transactions failing on a NACK or a bus error are retried.
+ *
+ * A transaction failing with Wire code 2 (address NACK), 3 (data NACK), 4 (bus error) or 5 (timeout)
+ * is done again after a delay doubled on each attempt, from `delayMs` up to `delayMaxMs`. Codes 4 and 5
+ * also recover the bus first (see BQBus::recover), in case a device holds SDA low.
+ *
+ * @param attempts    Total attempts of a transaction, 1 to never retry (MBA_RETRY_ATTEMPTS by default).
+ * @param delayMs     Delay before the first retry (MBA_RETRY_DELAY_MS by default).
+ * @param delayMaxMs  Maximum delay between two attempts (MBA_RETRY_DELAY_MAX_MS by default).
+ */
+void setMBARetryPolicy(uint8_t attempts, uint8_t delayMs, uint8_t delayMaxMs) {
+  retryAttempts = max(attempts, 1);
+  retryDelayMs = delayMs;
+  retryDelayMaxMs = max(delayMs, delayMaxMs);
+}
+
+/**
+ * @brief Returns the number of transactions done again since startup, for any reason.
+ */
+uint16_t getMBARetries() {
+  return retries;
+}
+
+/**
+ * @brief Returns the number of bus recoveries since startup.
+ */
+uint16_t getMBABusRecoveries() {
+  return busRecoveries;
+}
+
+/**
+ * @brief Decides whether a failed transaction is done again, and prepares the bus for it.
+ *
+ * Blocks for the backoff delay of the attempt (a few milliseconds with the default policy).
+ *
+ * @param error    Result of the failed attempt.
+ * @param attempt  Number of the failed attempt, starting at 1.
+ *
+ * @return true if the transaction must be done again.
+ */
+static bool retryMBATransaction(uint8_t error, uint8_t attempt) {
+  if (error != 0) {
+    recordMBAError(error);
+  }
+  switch (error) {
+    case MBA_ERROR_PEC:
+      // The device still holds the same data, do it again at once
+      if (attempt >= MBA_PEC_RETRIES) {
+        return false;
+      }
+      delayMicroseconds(SMBUS_BUS_FREE_US);
+      break;
+    case 4:
+    case 5:
+      if (attempt >= retryAttempts) {
+        return false;
+      }
+      // A device stuck in the middle of a byte holds SDA until it is clocked out
+      getMBABus()->recover();
+      busRecoveries++;
+      // fall through
+    case 2:
+    case 3:
+      if (attempt >= retryAttempts) {
+        return false;
+      }
+      // The gauge NACKs while it is busy (e.g. right after UnsealKey or DeviceReset), give it some time
+      {
+        uint16_t delayMs = (uint16_t)retryDelayMs << min(attempt - 1, 8);
+        delay(min(delayMs, (uint16_t)retryDelayMaxMs));
+      }
+      break;
+    default:
+      return false;
+  }
+  retries++;
+  return true;
+}
+
+/**
+ * @brief Starts one bus transaction: bounds each Wire call and arms the transaction deadline.
+ *
+ * @param timeoutUs  Deadline of the transaction (see the `busTimeoutUs` field of MBACommandInfo).
+ *
+ * @return The bus of the transaction.
+ */
+static BQBus* beginMBATransaction(uint16_t timeoutUs) {
+  BQBus* bus = getMBABus();
+  bus->setTimeout(timeoutUs);
+  startBusDeadline(timeoutUs);
+  return bus;
+}
+
+/**
+ * @brief Ends a bus transaction started by beginMBATransaction.
+ *
+ * @param error  Result of the transaction.
+ *
+ * @return `error`, or 5 (timeout) if the transaction ended after its deadline without a bus error
+ *         (a read cut by the Wire timeout returns no data).
+ */
+static uint8_t endMBATransaction(uint8_t error) {
+  bool expired = stopBusDeadline();
+  return (expired && (error == 0 || error == MBA_ERROR_NO_DATA)) ? 5 : error;
+}
+
+/**
+ * @brief Checks whether the device acknowledges its address (SMBus quick write).
+ *
+ * Never retried: completion polling relies on the device not answering.
+ *
+ * @param address  I2C address of the target battery device.
+ *
+ * @return true if the device answered with an ACK.
+ */
+static bool probeMBADevice(uint8_t address) {
+  BQBus* bus = beginMBATransaction(MBA_BUS_TIMEOUT_US);
+  bus->beginTransmission(address);
+  return endMBATransaction(bus->endTransmission()) == 0;
+}
+
+/**
+ * @brief Schedules the next completion poll, doubling the poll interval.
+ *
+ * @param wait  Polling state initialized by beginMBAWait.
+ *
+ * @return false if the command timeout is already reached.
+ */
+static bool backoffMBAWait(MBAWait* wait) {
+  unsigned long now = millis();
+  if (now - wait->startedAt >= getMBACommandTimeout(wait->cmdInfo)) {
+    return false;
+  }
+  wait->nextPollAt = now + wait->interval;
+  wait->interval = min(wait->interval * 2, MBA_POLL_INTERVAL_MAX_MS);
+  return true;
+}
+
+/**
+ * @brief Starts the completion polling of a command that has just been sent.
+ *
+ * @param wait     Polling state to initialize.
+ * @param address  I2C address of the target battery device.
+ * @param cmdInfo  Command that was sent, its completion/timeoutMs/pollMs fields drive the polling.
+ */
+void beginMBAWait(MBAWait* wait, uint8_t address, const MBACommandInfo* cmdInfo) {
+  wait->cmdInfo = cmdInfo;
+  wait->address = address;
+  wait->startedAt = millis();
+  wait->nextPollAt = wait->startedAt;
+  wait->interval = max(getMBACommandPollInterval(cmdInfo), 1);
+  wait->sawOffline = false;
+  wait->reading = false;
+  wait->attempt = 0;
+  wait->startedAtUs = getMBAStatsTime();
+}
+
+/**
+ * @brief Polls the device once if the next poll is due, see pollMBAWait.
+ *
+ * @param wait  Polling state initialized by beginMBAWait.
+ *
+ * @return MBA_WAIT_DONE once completed, MBA_WAIT_TIMEOUT after `timeoutMs`, MBA_WAIT_PENDING otherwise.
+ */
+static MBAWaitStatus checkMBAWait(MBAWait* wait) {
+  MBACompletion completion = getMBACommandCompletion(wait->cmdInfo);
+  if (completion == COMPLETION_ECHO) {
+    return MBA_WAIT_DONE;
+  }
+
+  // Not yet time to poll again
+  if ((long)(millis() - wait->nextPollAt) < 0) {
+    return MBA_WAIT_PENDING;
+  }
+
+  bool online = probeMBADevice(wait->address);
+  if (completion == COMPLETION_ACK && online) {
+    return MBA_WAIT_DONE;
+  }
+  if (completion == COMPLETION_RESET) {
+    if (!online) {
+      wait->sawOffline = true;
+    } else if (wait->sawOffline) {
+      return MBA_WAIT_DONE;
+    }
+  }
+
+  if (!backoffMBAWait(wait)) {
+    // A reset too short to be seen between two polls still ends with an online device
+    return (completion == COMPLETION_RESET && online) ? MBA_WAIT_DONE : MBA_WAIT_TIMEOUT;
+  }
+  // Keep a tight interval until the device goes down, so a short reset is not missed
+  if (completion == COMPLETION_RESET && !wait->sawOffline) {
+    wait->interval = max(getMBACommandPollInterval(wait->cmdInfo), 1);
+  }
+  return MBA_WAIT_PENDING;
+}
+
+/**
+ * @brief Polls the device once if the next poll is due, without blocking.
+ *
+ * Depending on the command completion mode, the device is considered done when:
+ * - COMPLETION_ECHO: immediately, the echo is checked by readMBAResponse itself.
+ * - COMPLETION_ACK: the device acknowledges its address.
+ * - COMPLETION_RESET: the device has stopped acknowledging its address, then acknowledges again.
+ *
+ * Between two misses the poll interval is doubled, up to MBA_POLL_INTERVAL_MAX_MS.
+ *
+ * @param wait  Polling state initialized by beginMBAWait.
+ *
+ * @return MBA_WAIT_DONE once completed, MBA_WAIT_TIMEOUT after `timeoutMs`, MBA_WAIT_PENDING otherwise.
+ */
+MBAWaitStatus pollMBAWait(MBAWait* wait) {
+  MBAWaitStatus status = checkMBAWait(wait);
+  if (status != MBA_WAIT_PENDING && getMBACommandCompletion(wait->cmdInfo) != COMPLETION_ECHO) {
+    recordMBAPhase(MBA_PHASE_WAIT, getMBAStatsTime() - wait->startedAtUs);
+    if (status == MBA_WAIT_TIMEOUT) {
+      recordMBAError(MBA_ERROR_COMPLETION_TIMEOUT);
+    }
+  }
+  return status;
+}
+
+/**
+ * @brief Polls a command that has just been sent until it completes or times out, without printing.
+ *
+ * @param address  I2C address of the target battery device.
+ * @param cmdInfo  Command that was sent.
+ *
+ * @return MBA_WAIT_DONE or MBA_WAIT_TIMEOUT.
+ */
+static MBAWaitStatus runMBAWait(uint8_t address, const MBACommandInfo* cmdInfo) {
+  MBAWait wait;
+  beginMBAWait(&wait, address, cmdInfo);
+
+  MBAWaitStatus status;
+  while ((status = pollMBAWait(&wait)) == MBA_WAIT_PENDING) {
+    // The next poll is at most MBA_POLL_INTERVAL_MAX_MS away, use the time to send logs
+    Log.drain();
+  }
+  return status;
+}
+
+/**
+ * @brief Blocks until a command that has just been sent is completed.
+ *
+ * @param address  I2C address of the target battery device.
+ * @param cmdInfo  Command that was sent.
+ *
+ * @return true once the device reports completion, false on timeout.
+ */
+bool waitMBACommand(uint8_t address, const MBACommandInfo* cmdInfo) {
+  if (runMBAWait(address, cmdInfo) == MBA_WAIT_TIMEOUT) {
+    Log.print(F("Timeout waiting for command completion ("));
+    Log.print(getMBACommandTimeout(cmdInfo));
+    Log.println(F(" ms)."));
+    return false;
+  }
+  return true;
+}
+
+/**
+ * @brief Writes one byte of a transaction and adds it to its PEC.
+ *
+ * @param bus   Bus of the transaction.
+ * @param data  Byte to write.
+ * @param pec   PEC of the transaction, updated.
+ */
+static void writeMBAByte(BQBus* bus, uint8_t data, uint8_t* pec) {
+  bus->write(data);
+  *pec = crc8Update(*pec, data);
+}
+
+/**
+ * @brief Writes a ManufacturerBlockAccess block once, followed by its PEC when enabled.
+ *
+ * @param address       I2C address of the target battery device.
+ * @param subcommand    Subcommand (or DataFlash address) to write.
+ * @param data          Bytes following the subcommand, in SRAM.
+ * @param length        Number of data bytes.
+ * @param busTimeoutUs  Deadline of the transaction.
+ *
+ * @return The Wire.endTransmission() code, 0 on success.
+ */
+static uint8_t transmitMBABlock(uint8_t address, uint16_t subcommand, const uint8_t* data, uint8_t length,
+                                uint16_t busTimeoutUs) {
+  BQBus* bus = beginMBATransaction(busTimeoutUs);
+  // The PEC covers the address byte (write) too
+  uint8_t pec = crc8Update(0, address << 1);
+  // Begin I2C transmission to device
+  bus->beginTransmission(address);
+  // Write the ManufacturerBlockAccess command byte
+  writeMBAByte(bus, MANUFACTURER_BLOCK_ACCESS_COMMAND, &pec);
+  // 2 for subcommand + data length
+  writeMBAByte(bus, 2 + length, &pec);
+  // Sending LSB command byte
+  writeMBAByte(bus, lowByte(subcommand), &pec);
+  // Sending MSB command byte
+  writeMBAByte(bus, highByte(subcommand), &pec);
+  // Sending all data we want to send
+  for (uint8_t i = 0; i < length; i++) {
+    writeMBAByte(bus, data[i], &pec);
+  }
+  if (pecEnabled) {
+    bus->write(pec);
+  }
+  // End transmission and get result
+  return endMBATransaction(bus->endTransmission());
+}
+
+/**
+ * @brief Writes a ManufacturerBlockAccess block with a subcommand not in MBACommandsInfo.
+ *
+ * Used for the subcommands computed at run time, such as DataFlash addresses (0x4000-0x5FFF):
+ * writing an address alone selects it for reading, with data it writes the flash from there.
+ * A NACKed or failed block is sent again according to the retry policy (see setMBARetryPolicy).
+ *
+ * @param address       I2C address of the target battery device.
+ * @param subcommand    Subcommand (or DataFlash address) to write.
+ * @param data          Bytes following the subcommand, in SRAM (NULL if `length` is 0).
+ * @param length        Number of data bytes, up to MBA_WRITE_DATA_SIZE.
+ * @param busTimeoutUs  Deadline of one transaction (MBA_BUS_TIMEOUT_US, longer for flash writes).
+ *
+ * @return The Wire.endTransmission() code of the last attempt, 0 on success.
+ */
+uint8_t writeMBASubcommand(uint8_t address, uint16_t subcommand, const uint8_t* data, uint8_t length,
+                           uint16_t busTimeoutUs) {
+  uint32_t startedAt = getMBAStatsTime();
+  for (uint8_t attempt = 1; ; attempt++) {
+    uint8_t result = transmitMBABlock(address, subcommand, data, length, busTimeoutUs);
+    uint8_t error = result;
+    // With PEC the gauge NACKs a corrupted block on its PEC byte and ignores it, so it can be sent again
+    if (result == 3 && pecEnabled) {
+      pecErrors++;
+      error = attempt < MBA_PEC_RETRIES ? MBA_ERROR_PEC : result;
+    }
+    if (!retryMBATransaction(error, attempt)) {
+      recordMBAPhase(MBA_PHASE_SEND, getMBAStatsTime() - startedAt);
+      // Data changes the device, a persistent address NACK may be a pack being swapped
+      if (length > 0 || result == 2) {
+        evictMBACache(address, subcommand, result == 2);
+      }
+      return result;
+    }
+  }
+}
+
+/**
+ * @brief Writes a ManufacturerBlockAccess command and its subcommand/data, without waiting or printing.
+ *
+ * Completion is left to the caller (see beginMBAWait), so that waits on several batteries can overlap.
+ * A NACKed or failed block is sent again according to the retry policy (see setMBARetryPolicy).
+ * With PEC enabled, a block NACKed on its PEC byte (code 3) is sent again, up to MBA_PEC_RETRIES times.
+ *
+ * @param address  I2C address of the target battery device.
+ * @param cmdInfo  Command to send.
+ *
+ * @return The Wire.endTransmission() code of the last attempt, 0 on success.
+ */
+uint8_t issueMBACommand(uint8_t address, const MBACommandInfo* cmdInfo) {
+  uint8_t data[sizeof(cmdInfo->data)];
+  uint8_t length = getMBACommandDataLength(cmdInfo);
+  memcpy_P(data, cmdInfo->data, length);
+  if (isMBACommandWriteOnly(cmdInfo)) {
+    evictMBACache(address, getMBACommandSubcommand(cmdInfo), getMBACommandCompletion(cmdInfo) == COMPLETION_RESET);
+  }
+  return writeMBASubcommand(address, getMBACommandSubcommand(cmdInfo), data, length, getMBACommandBusTimeout(cmdInfo));
 }
 
 /**
@@ -52,31 +549,14 @@ const MBACommandInfo* getMBACommandInfoByName(const char* name) {
  *
  * @note This function assumes the device uses the standard SMBus block write format, 
  *       where the first byte after the command indicates the total number of data bytes to follow.
- *       It includes a small delay (20 ms) after transmission to allow the device to process the command.
+ *       It then polls the device until it reports completion (see pollMBAWait), instead of a fixed delay.
  */
 bool sendMBACommand(const uint8_t address, const MBACommandInfo* cmdInfo) {
-  // Begin I2C transmission to device
-  Wire.beginTransmission(address);
-  // Write the ManufacturerBlockAccess command byte
-  Wire.write(MANUFACTURER_BLOCK_ACCESS_COMMAND);
-  // 2 for subcommand + dataLength
-  Wire.write(2 + cmdInfo->dataLength);
-  // Sending LSB command byte
-  Wire.write(lowByte(cmdInfo->cmd));
-  // Sending MSB command byte
-  Wire.write(highByte(cmdInfo->cmd));
-  // Sending all data we want to send
-  for (uint8_t i = 0; i < cmdInfo->dataLength; i++) {
-    Wire.write(cmdInfo->data[i]);
-  }
-  // End transmission and get result
-  int result = Wire.endTransmission();  
-  // Short delay to allow device processing
-  delay(20);  
+  int result = issueMBACommand(address, cmdInfo);
 
-  // Transmission successful
+  // Transmission successful, wait until the device is done processing the command
   if (result == 0) {
-    return true;  
+    return waitMBACommand(address, cmdInfo);
   } 
   // Print appropriate error message
   else {
@@ -87,168 +567,528 @@ bool sendMBACommand(const uint8_t address, const MBACommandInfo* cmdInfo) {
 }
 
 /**
- * @brief Reads a response block from a device over I2C using the Manufacturer Block Access (MBA) command.
+ * @brief Takes the ManufacturerBlockAccess block of a request started with startRequest.
  *
- * This function sends a Manufacturer Block Access command to a device at the specified I2C address,
- * then reads the resulting data block into the provided buffer. It checks for basic transmission
- * errors, handles timeouts, and verifies buffer sizes to avoid overflows.
+ * @param bus       Bus of the transaction.
+ * @param address   I2C address of the target device.
+ * @param error     Result of the request (see BQBus::pollRequest).
+ * @param response  Output, initialized by beginMBAResponse, receives the error code and the block.
+ */
+static void readMBABlockData(BQBus* bus, uint8_t address, uint8_t error, MBAResponse* response) {
+  response->error = error;
+  if (response->error != 0) {
+    // Transmission failed
+    return;
+  }
+
+  // Check if we have at least 3 entry to read (we should at least have 1 byte to length and 2 for command reprint)
+  // Note that ManufacturerBlockAccess command reprint the MBACommandInfo cmd before sending the result
+  if (bus->available() < 3) {
+    response->error = MBA_ERROR_NO_DATA;
+    return;
+  }
+
+  // First byte is the block length, it counts the 2 bytes of subcommand echo
+  uint8_t len = bus->read();
+
+  // The rest goes as is into the response block, decoders read it in place (little-endian).
+  // The echo is always read, even if the length byte does not count it
+  uint8_t blockLength = constrain(len, 2, (uint8_t)sizeof(response->block));
+  uint8_t received = 0;
+  while (bus->available() > 0 && received < blockLength) {
+    response->block[received++] = bus->read();
+  }
+  response->length = received >= 2 ? received - 2 : 0;
+  response->truncated = len > received;
+
+  if (!pecEnabled) {
+    return;
+  }
+  // The PEC follows the block, it is out of the bus buffer for a truncated block or one filling it
+  if (response->truncated || len != received || bus->available() < 1) {
+    pecUnverified++;
+    response->unverified = true;
+    return;
+  }
+  uint8_t pec = crc8Update(0, address << 1);
+  pec = crc8Update(pec, MANUFACTURER_BLOCK_ACCESS_COMMAND);
+  pec = crc8Update(pec, (address << 1) | 1);
+  pec = crc8Update(pec, len);
+  pec = crc8(pec, response->block, received);
+  if (bus->read() != pec) {
+    pecErrors++;
+    response->error = MBA_ERROR_PEC;
+  }
+}
+
+/**
+ * @brief Starts the read of the ManufacturerBlockAccess block (write of the command byte, then block read).
  *
- * Additionally, the function:
- * - Warns if the response length exceeds the buffer capacity.
- * - Prints the received data using the format specified in `cmdInfo->displayFormat`.
- * - Converts the data from little-endian to big-endian using `reverseEndian`.
+ * The deadline of the transaction is armed while the request starts. A bus running it in the
+ * background keeps its own timeout (see BQBus::setTimeout), its deadline is checked by pollMBABlock.
  *
- * @param address I2C address of the target device.
- * @param cmdInfo Command metadata containing display format and other related info.
- * @param buffer Pointer to the buffer where the read data will be stored.
- * @param bufferSize Size of the buffer (maximum number of bytes to read).
+ * @param address       I2C address of the target device.
+ * @param busTimeoutUs  Deadline of the transaction (see beginMBATransaction).
  *
- * @return `true` if the data was successfully read and processed; `false` on transmission failure, timeout,
- *         or if no sufficient data was available.
+ * @return BQ_REQUEST_PENDING if the bus runs the request in the background,
+ *         otherwise the result of the request (see BQBus::pollRequest).
+ */
+static uint8_t startMBABlock(uint8_t address, uint16_t busTimeoutUs) {
+  BQBus* bus = beginMBATransaction(busTimeoutUs);
+  // Max number of bytes we will try to read : the whole bus buffer
+  bus->startRequest(address, MANUFACTURER_BLOCK_ACCESS_COMMAND, BQ_BUS_BUFFER_SIZE);
+  uint8_t error = bus->pollRequest();
+  if (error == BQ_REQUEST_PENDING) {
+    // The deadline is single, other batteries arm it while this request runs
+    stopBusDeadline();
+    return error;
+  }
+  return endMBATransaction(error);
+}
+
+/**
+ * @brief Checks a block read started by startMBABlock on a bus running it in the background.
  *
- * @note The function assumes that the device echoes back the command before the result block,
- *       and that the first byte of the response indicates the payload length.
+ * @param startedAtUs   micros() when the read was started.
+ * @param busTimeoutUs  Deadline of the transaction.
  *
- * Example usage:
- * @code
- * uint8_t data[32];
- * if (readMBACommand(0x50, myCmdInfo, data, sizeof(data))) {
- *     // Process the data
- * }
- * @endcode
+ * @return BQ_REQUEST_PENDING while it runs, 5 once past its deadline, otherwise its result.
  */
-bool readMBACommand(uint8_t address, const MBACommandInfo* cmdInfo, uint8_t* buffer, size_t bufferSize) {
-  // Check if our buffer is larger than the lib limit
-  if (bufferSize > SOFTWAREWIRE_BUFSIZE) {
-    Serial.print(F("⚠️  Warning: bufferSize exceeds Wire buffer max ("));
-    Serial.print(SOFTWAREWIRE_BUFSIZE);
-    Serial.println(F(" bytes)."));
+static uint8_t pollMBABlock(uint32_t startedAtUs, uint16_t busTimeoutUs) {
+  uint8_t error = getMBABus()->pollRequest();
+  if (error == BQ_REQUEST_PENDING && micros() - startedAtUs >= busTimeoutUs) {
+    // Left to the bus recovery of the retry policy (see retryMBATransaction)
+    return 5;
   }
+  return error;
+}
 
-  // Begin I2C transmission to device
-  Wire.beginTransmission(address);
-  // Write the ManufacturerBlockAccess command byte
-  Wire.write(MANUFACTURER_BLOCK_ACCESS_COMMAND);
-  // Repeated start for read
-  int result = Wire.endTransmission(false);
+/**
+ * @brief Reads the ManufacturerBlockAccess block once and checks its PEC when enabled.
+ *
+ * A NACKed or failed read is done again according to the retry policy (see setMBARetryPolicy).
+ * A bus running the read in the background is waited for, see pollMBAResponse to do other work meanwhile.
+ *
+ * @param address       I2C address of the target device.
+ * @param subcommand    Subcommand whose response is expected.
+ * @param busTimeoutUs  Deadline of one transaction (see beginMBATransaction).
+ * @param response      Output, receives the error code and the block.
+ */
+static void readMBABlock(uint8_t address, uint16_t subcommand, uint16_t busTimeoutUs, MBAResponse* response) {
+  uint32_t startedAt = getMBAStatsTime();
+  for (uint8_t attempt = 1; ; attempt++) {
+    uint32_t requestedAt = micros();
+    beginMBAResponse(response, subcommand);
+    uint8_t error = startMBABlock(address, busTimeoutUs);
+    while (error == BQ_REQUEST_PENDING) {
+      error = pollMBABlock(requestedAt, busTimeoutUs);
+    }
+    readMBABlockData(getMBABus(), address, error, response);
+    if (!retryMBATransaction(response->error, attempt)) {
+      recordMBAPhase(MBA_PHASE_READ, getMBAStatsTime() - startedAt);
+      return;
+    }
+  }
+}
 
-  if (result != 0) {
-    // Transmission failed
-    printMBACommandError(result);
-    return false;
+/**
+ * @brief Reads the response of a subcommand written with writeMBASubcommand, without printing.
+ *
+ * The block is read again (poll interval doubled from 1 ms) until it echoes `subcommand`,
+ * up to MBA_SUBCOMMAND_TIMEOUT_MS. Blocks longer than MBA_RESPONSE_PAYLOAD_SIZE are truncated,
+ * a DataFlash read returns the first MBA_RESPONSE_PAYLOAD_SIZE bytes from the written address.
+ *
+ * @param address     I2C address of the target device.
+ * @param subcommand  Subcommand (or DataFlash address) that was written.
+ * @param response    Output, receives the error code, echoed subcommand and payload.
+ *
+ * @return true if the response was read, false otherwise (see `response->error`).
+ */
+bool readMBASubcommandResponse(uint8_t address, uint16_t subcommand, MBAResponse* response) {
+  unsigned long startedAt = millis();
+  uint8_t interval = 1;
+  for (;;) {
+    readMBABlock(address, subcommand, MBA_BUS_TIMEOUT_US, response);
+    if (response->error != 0) {
+      return false;
+    }
+    if (getMBAResponseSubcommand(response) == subcommand) {
+      return true;
+    }
+    if (millis() - startedAt >= MBA_SUBCOMMAND_TIMEOUT_MS) {
+      response->error = MBA_ERROR_ECHO_TIMEOUT;
+      recordMBAError(response->error);
+      return false;
+    }
+    delay(interval);
+    interval = min(interval * 2, MBA_POLL_INTERVAL_MAX_MS);
   }
+}
 
-  // Requesting result
-  // Max number of bytes we will try to read : bufferSize (limited by the Wire.available())
-  Wire.requestFrom(address, (uint8_t)(bufferSize));
+/**
+ * @brief Reads the response of a ManufacturerBlockAccess command into a typed result, without printing.
+ *
+ * This function reads the ManufacturerBlockAccess block of the device at the specified I2C address.
+ * The block is read again (with the command poll backoff) until it echoes the expected subcommand,
+ * so the read completes as soon as the device has the result ready.
+ * Nothing is written to Serial: errors are reported in `response->error` and formatting is left
+ * to printMBAResponse, which can be deferred or skipped.
+ *
+ * @param address   I2C address of the target device.
+ * @param cmdInfo   Command whose response is expected (sent beforehand with sendMBACommand).
+ * @param response  Output, receives the error code, echoed subcommand and payload.
+ *
+ * @return true if the response was read, false on transmission failure, timeout,
+ *         or if no sufficient data was available (see `response->error`).
+ *
+ * @note The device echoes back the subcommand before the result and the first byte of the block
+ *       is its length. Payloads longer than MBA_RESPONSE_PAYLOAD_SIZE are truncated (`truncated` is set).
+ *
+ * Example usage:
+ * @code
+ * MBAResponse response;
+ * if (readMBAResponse(0x0B, getMBACommandInfo(Cmd::PFStatus), &response)) {
+ *     // Process getMBAResponsePayload(&response)
+ * }
+ * @endcode
+ */
+bool readMBAResponse(uint8_t address, const MBACommandInfo* cmdInfo, MBAResponse* response) {
+  MBAWait wait;
+  beginMBAWait(&wait, address, cmdInfo);
 
-  // Check if we have at least 3 entry to read (we should at least have 1 byte to length and 2 for command reprint)
-  // Note that ManufacturerBlockAccess command reprint the MBACommandInfo cmd before sending the result
-  if (Wire.available() < 3) {
-    Serial.println(F("No data available to read"));
-    return false;
+  MBAWaitStatus status;
+  while ((status = pollMBAResponse(&wait, response)) == MBA_WAIT_PENDING) {
+    // The next poll is at most MBA_POLL_INTERVAL_MAX_MS away, use the time to send logs
+    Log.drain();
   }
+  return status == MBA_WAIT_DONE;
+}
 
-  // First byte is the block length
-  uint8_t len = Wire.read();  
+/**
+ * @brief Reads the ManufacturerBlockAccess block once if the next poll is due, without blocking.
+ *
+ * Non-blocking step of readMBAResponse: while the device does not echo the expected subcommand
+ * the read is retried with the command poll backoff, until its `timeoutMs`. A NACKed or failed read
+ * is retried according to the retry policy (see setMBARetryPolicy). With PEC enabled,
+ * a corrupted block is read again at once, up to MBA_PEC_RETRIES times. On a bus running the
+ * read in the background (see BQBus::startRequest) the call returns as soon as the read is
+ * started, the block is taken by a later call once the bus is done.
+ *
+ * @param wait      Polling state initialized by beginMBAWait with the command whose response is expected.
+ * @param response  Output, receives the error code, echoed subcommand and payload.
+ *
+ * @return MBA_WAIT_DONE once the response is read, MBA_WAIT_TIMEOUT on failure (see `response->error`),
+ *         MBA_WAIT_PENDING otherwise.
+ */
+MBAWaitStatus pollMBAResponse(MBAWait* wait, MBAResponse* response) {
+  uint16_t subcommand = getMBACommandSubcommand(wait->cmdInfo);
+  uint16_t busTimeoutUs = getMBACommandBusTimeout(wait->cmdInfo);
+  uint8_t error;
 
-   // Wait until all bytes are available (rarely needed but safest)
-  unsigned long start = millis();
-  // SOFTWAREWIRE_BUFSIZE - 1 because we have already read a byte
-  // Note : len doesn't count his own byte
-  while (Wire.available() < len && Wire.available() < SOFTWAREWIRE_BUFSIZE-1 ) {
-    if (millis() - start > 10000) {
-      Serial.print(F("Timeout waiting for full data block, only "));
-      Serial.print(Wire.available());
-      Serial.println(F(" bytes readable."));
-      return false;
+  if (wait->reading) {
+    // A read running in the background, see whether it is done
+    error = pollMBABlock(wait->requestedAtUs, busTimeoutUs);
+    if (error == BQ_REQUEST_PENDING) {
+      return MBA_WAIT_PENDING;
+    }
+    wait->reading = false;
+  } else {
+    // Not yet time to read again
+    if ((long)(millis() - wait->nextPollAt) < 0) {
+      return MBA_WAIT_PENDING;
+    }
+    if (wait->attempt == 0) {
+      wait->readStartedAtUs = getMBAStatsTime();
+    }
+    wait->requestedAtUs = micros();
+    beginMBAResponse(response, subcommand);
+    error = startMBABlock(wait->address, busTimeoutUs);
+    if (error == BQ_REQUEST_PENDING) {
+      // The caller can do other work (e.g. print the previous response) until the bus is done
+      wait->reading = true;
+      return MBA_WAIT_PENDING;
     }
-    delay(10);
   }
 
-  // If response is bigger than our buffer we send a warning
-  if (len > bufferSize) {
-    Serial.print(F("⚠️  Warning: Block length ("));
-    Serial.print(len);
-    Serial.print(F(" bytes) exceeds buffer limit ("));
-    Serial.print(bufferSize);
-    Serial.println(F(" bytes). Truncation may occur."));
+  // A corrupted or NACKed block is read again (see retryMBATransaction)
+  readMBABlockData(getMBABus(), wait->address, error, response);
+  if (retryMBATransaction(response->error, ++wait->attempt)) {
+    return MBA_WAIT_PENDING;
   }
-  // Check len OK
-  else{
-    Serial.print(F("Response length: "));
-    Serial.print(len);
-    Serial.println(F(" bytes"));
+  wait->attempt = 0;
+  recordMBAPhase(MBA_PHASE_READ, getMBAStatsTime() - wait->readStartedAtUs);
+  if (response->error != 0) {
+    return MBA_WAIT_TIMEOUT;
   }
 
-  int available_bytes = Wire.available();
-  // Writing response into buffer
-  for (uint8_t i = 0; i < available_bytes; i++) {
-    buffer[i] = Wire.read();
+  // The device echoes our subcommand once the result is ready
+  if (getMBAResponseSubcommand(response) == subcommand) {
+    storeMBACache(wait->address, wait->cmdInfo, response);
+    return MBA_WAIT_DONE;
   }
 
-  // Print received data
-  printBuffer(&buffer[0], min(available_bytes, len), cmdInfo->displayFormat);
-
-  // Little edian to big edian to reorder proprely
-  reverseBufferEndian(buffer, len);
-
-  return true;
+  if (!backoffMBAWait(wait)) {
+    response->error = MBA_ERROR_ECHO_TIMEOUT;
+    recordMBAError(response->error);
+    return MBA_WAIT_TIMEOUT;
+  }
+  return MBA_WAIT_PENDING;
 }
 
 /**
  * @brief Run a BQ ManufacturerBlockAccess command by name: send the sub-command and read back data.
  * 
- * This function looks up the command info by its name, sends the
- * ManufacturerBlockAccess command with the sub-command,
- * reads the response from the device, and prints it according to the
- * command's expected data format.
+ * Same as runMBACommand(uint8_t, Cmd) but looks up the command by its name first,
+ * intended for names typed on a serial console.
  * 
  * @param address I2C device address
  * @param cmdName Name of the command to run (case-sensitive)
- * @param format Display format for the read data (decimal, hex, binary, text)
  * 
- * @return true if command executed successfully, false on failure.
+ * @return true if command executed successfully, false on failure (including unknown name).
  */
 bool runMBACommand(uint8_t address, const char* cmdName) {
-    // Lookup command info
-    const MBACommandInfo* cmdInfo = getMBACommandInfoByName(cmdName);
-    if (cmdInfo == NULL) {
-        Serial.print(F("Command not found: "));
-        Serial.println(cmdName);
-        Serial.println();
+    // Lookup command id
+    Cmd id;
+    if (!getMBACommandIdByName(cmdName, &id)) {
+        Log.print(F("Command not found: "));
+        Log.println(cmdName);
+        Log.println();
         return false;
-    } else{
-        Serial.print(F("Starting command "));
-        printMBACommandInfo(cmdInfo);
     }
+    return runMBACommand(address, id);
+}
+
+/**
+ * @brief Run a BQ ManufacturerBlockAccess command: send the sub-command and read back data.
+ * 
+ * This function sends the ManufacturerBlockAccess command with the sub-command,
+ * reads the response from the device, and prints it according to the
+ * command's expected data format (or sends it as a telemetry frame in OUTPUT_MODE_BINARY).
+ * 
+ * @param address I2C device address
+ * @param id      Compile-time identifier of the command to run (e.g., Cmd::PFStatus)
+ * 
+ * @return true if command executed successfully, false on failure.
+ */
+bool runMBACommand(uint8_t address, Cmd id) {
+    // Binary telemetry: one frame per command, nothing else
+    if (getOutputMode() == OUTPUT_MODE_BINARY) {
+        MBABatchSlot* slot = getMBAArena();
+        bool succeeded = runMBABatch(address, &id, 1, slot) == 1;
+        sendTelemetryResponse(id, &slot->response);
+        return succeeded;
+    }
+
+    const MBACommandInfo* cmdInfo = getMBACommandInfo(id);
+    Log.print(F("Starting command "));
+    printMBACommandInfo(cmdInfo);
+
+    // Static registers are only read once per battery (see cache.h)
+    MBAResponse* cached = &getMBAArena()->response;
+    if (lookupMBACache(address, cmdInfo, cached)) {
+        Log.println(F("Response from cache"));
+        printMBAResponse(cmdInfo, cached);
+        Log.println();
+        return true;
+    }
+    uint32_t startedAt = getMBAStatsTime();
 
     // Send the ManufacturerBlockAccess command
     if (!sendMBACommand(address, cmdInfo)) {
-        Serial.println(F("Failed to send command."));
-        Serial.println();
+        Log.println(F("Failed to send command."));
+        Log.println();
         return false;
     }
 
     // Only print result of readable commands
-    if(cmdInfo->access != "W"){
+    if(!isMBACommandWriteOnly(cmdInfo)){
       // Where we store response
-      uint8_t buffer[SOFTWAREWIRE_BUFSIZE];
+      MBAResponse* response = &getMBAArena()->response;
 
-      // Send command and read the response
-      if (!readMBACommand(address, cmdInfo, buffer, sizeof(buffer))) {
-          Serial.println(F("Failed to read command response"));
-          Serial.println();
+      // Read the response, then format it
+      if (!readMBAResponse(address, cmdInfo, response)) {
+          printMBACommandError(response->error);
+          Log.println(F("Failed to read command response"));
+          Log.println();
           return false;
       } 
-      else{
-        if (cmdInfo->bitfields && cmdInfo->bitfieldCount > 0) {
-          printBitFields(&buffer[0], sizeof(buffer)-2, cmdInfo->bitfields, cmdInfo->bitfieldCount);
+      recordMBACommand(id, getMBAStatsTime() - startedAt);
+      DecodedBitFields decoded;
+      uint32_t decodedAt = getMBAStatsTime();
+      decodeMBAResponse(cmdInfo, response, &decoded);
+      uint32_t printedAt = getMBAStatsTime();
+      recordMBAPhase(MBA_PHASE_DECODE, printedAt - decodedAt);
+      printDecodedMBAResponse(cmdInfo, response, &decoded);
+      recordMBAPhase(MBA_PHASE_PRINT, getMBAStatsTime() - printedAt);
+    } else {
+      recordMBACommand(id, getMBAStatsTime() - startedAt);
+    }
+
+    Log.println();
+    return true;
+}
+
+
+/**
+ * @brief Runs a list of ManufacturerBlockAccess commands back-to-back and stores their raw results.
+ *
+ * All bus work is done first, with only the SMBus bus free time (SMBUS_BUS_FREE_US) between two
+ * transactions and the per-command completion polling; nothing is printed. Decode and print
+ * the results afterwards with printMBABatch.
+ *
+ * @param address  I2C device address
+ * @param cmds     Commands to run, in order.
+ * @param count    Number of commands (and of slots).
+ * @param slots    Caller-provided arena receiving one result per command.
+ *
+ * @return Number of commands that succeeded.
+ */
+uint8_t runMBABatch(uint8_t address, const Cmd* cmds, uint8_t count, MBABatchSlot* slots) {
+  uint8_t succeeded = 0;
+
+  for (uint8_t i = 0; i < count; i++) {
+    MBABatchSlot* slot = &slots[i];
+    MBAResponse* response = &slot->response;
+    const MBACommandInfo* cmdInfo = getMBACommandInfo(cmds[i]);
+    slot->id = cmds[i];
+    beginMBAResponse(response, cmdInfo);
+
+    if (lookupMBACache(address, cmdInfo, response)) {
+      succeeded++;
+      continue;
+    }
+    if (i > 0) {
+      delayMicroseconds(SMBUS_BUS_FREE_US);
+    }
+    uint32_t startedAt = getMBAStatsTime();
+    response->error = issueMBACommand(address, cmdInfo);
+
+    if (response->error == 0) {
+      if (isMBACommandWriteOnly(cmdInfo)) {
+        if (runMBAWait(address, cmdInfo) == MBA_WAIT_TIMEOUT) {
+          response->error = MBA_ERROR_COMPLETION_TIMEOUT;
         }
+      } else {
+        delayMicroseconds(SMBUS_BUS_FREE_US);
+        readMBAResponse(address, cmdInfo, response);
       }
     }
 
-    Serial.println();
-    delay(100);
-    return true;
+    if (response->error == 0) {
+      recordMBACommand(cmds[i], getMBAStatsTime() - startedAt);
+      succeeded++;
+    }
+  }
+
+  return succeeded;
+}
+
+/**
+ * @brief Writes the register of a read-word, then reads the word and its PEC when enabled.
+ *
+ * @param bus      Bus of the transaction.
+ * @param address  I2C address of the target device.
+ * @param reg      SBS register.
+ * @param value    Output, receives the word.
+ *
+ * @return 0 on success, else the Wire.endTransmission() code, MBA_ERROR_NO_DATA or MBA_ERROR_PEC.
+ */
+static uint8_t transferSBSWord(BQBus* bus, uint8_t address, uint8_t reg, uint16_t* value) {
+  bus->beginTransmission(address);
+  bus->write(reg);
+  // Repeated start for read
+  uint8_t error = bus->endTransmission(false);
+  if (error != 0) {
+    return error;
+  }
+  if (isBusDeadlineExpired()) {
+    return 5;
+  }
+
+  uint8_t length = pecEnabled ? 3 : 2;
+  bus->requestFrom(address, length);
+  if (bus->available() < length) {
+    return MBA_ERROR_NO_DATA;
+  }
+  uint8_t low = bus->read();
+  uint8_t high = bus->read();
+  *value = word(high, low);
+
+  if (pecEnabled) {
+    uint8_t pec = crc8Update(0, address << 1);
+    pec = crc8Update(pec, reg);
+    pec = crc8Update(pec, (address << 1) | 1);
+    pec = crc8Update(pec, low);
+    pec = crc8Update(pec, high);
+    if (bus->read() != pec) {
+      pecErrors++;
+      return MBA_ERROR_PEC;
+    }
+  }
+  return 0;
+}
+
+/**
+ * @brief Runs one SMBus read-word transaction and checks its PEC when enabled.
+ *
+ * Bounded by MBA_BUS_TIMEOUT_US (see beginMBATransaction).
+ *
+ * @param address  I2C address of the target device.
+ * @param reg      SBS register.
+ * @param value    Output, receives the word.
+ *
+ * @return 0 on success, else the Wire.endTransmission() code, MBA_ERROR_NO_DATA or MBA_ERROR_PEC.
+ */
+static uint8_t transactSBSWord(uint8_t address, uint8_t reg, uint16_t* value) {
+  BQBus* bus = beginMBATransaction(MBA_BUS_TIMEOUT_US);
+  uint8_t error = transferSBSWord(bus, address, reg, value);
+  return endMBATransaction(error);
+}
+
+/**
+ * @brief Reads an SBS word register with a single SMBus read-word transaction, without printing.
+ *
+ * Unlike ManufacturerBlockAccess there is no subcommand to send nor echo to wait for: the
+ * register address is written, then the 2 bytes of the word are read back (LSB first) after
+ * a repeated start. This is the cheapest way to sample the measurements.
+ * A NACKed or failed read is retried according to the retry policy (see setMBARetryPolicy).
+ * With PEC enabled, a corrupted word is read again, up to MBA_PEC_RETRIES times.
+ *
+ * @param address  I2C address of the target device.
+ * @param id       Register to read (e.g., Sbs::Voltage).
+ * @param value    Output, receives the raw word (cast it to int16_t for signed registers).
+ *
+ * @return 0 on success, else the Wire.endTransmission() code, MBA_ERROR_NO_DATA or MBA_ERROR_PEC.
+ */
+uint8_t readSBSWord(uint8_t address, Sbs id, uint16_t* value) {
+  for (uint8_t attempt = 1; ; attempt++) {
+    uint8_t error = transactSBSWord(address, getSBSRegister(getSBSRegisterInfo(id)), value);
+    if (!retryMBATransaction(error, attempt)) {
+      return error;
+    }
+  }
+}
+
+/**
+ * @brief Reads an SBS word register and prints it with its unit (FRAME_SBS in OUTPUT_MODE_BINARY).
+ *
+ * @param address  I2C address of the target device.
+ * @param id       Register to read (e.g., Sbs::Voltage).
+ *
+ * @return true if the register was read.
+ */
+bool runSBSRead(uint8_t address, Sbs id) {
+  uint16_t value = 0;
+  uint8_t error = readSBSWord(address, id, &value);
+
+  if (getOutputMode() == OUTPUT_MODE_BINARY) {
+    sendTelemetrySBS(id, error, value);
+  } else if (error != 0) {
+    Log.print(getSBSRegisterName(getSBSRegisterInfo(id)));
+    Log.print(F(": "));
+    printMBACommandError(error);
+  } else {
+    printSBSRegister(getSBSRegisterInfo(id), value);
+  }
+  return error == 0;
 }
@@ -1,11 +1,36 @@
 #ifndef BQCMD_H
 #define BQCMD_H
 #define MANUFACTURER_BLOCK_ACCESS_COMMAND 0x44
-// https://github.com/Testato/SoftwareWire/blob/master/SoftwareWire.h
-#define SOFTWAREWIRE_BUFSIZE  32
+// Upper bound of the exponential backoff between two completion polls
+#define MBA_POLL_INTERVAL_MAX_MS 100
+// SMBus bus free time between a STOP and the next START (4.7 us at 100 kHz)
+#define SMBUS_BUS_FREE_US 5
+// Data bytes of one block write: the Wire buffer minus command, length, subcommand (2) and PEC
+#define MBA_WRITE_DATA_SIZE (BQ_BUS_BUFFER_SIZE - 5)
+// Give up waiting for the echo of a subcommand written with writeMBASubcommand after this delay
+#define MBA_SUBCOMMAND_TIMEOUT_MS 100
+
+// Errors reported on top of the Wire.endTransmission() codes 1-5 (see printMBACommandError)
+#define MBA_ERROR_NO_DATA 6
+#define MBA_ERROR_ECHO_TIMEOUT 7
+#define MBA_ERROR_COMPLETION_TIMEOUT 8
+#define MBA_ERROR_PEC 9
+#define MBA_ERROR_VERIFY 10
+
+// Attempts of a single transaction whose PEC check fails (see setMBAPECEnabled)
+#define MBA_PEC_RETRIES 3
+
+// Default deadline of one bus transaction, the SMBus clock low timeout (tTIMEOUT)
+#define MBA_BUS_TIMEOUT_US 25000
+
+// Default retry policy of the transactions NACKed or timed out (see setMBARetryPolicy)
+#define MBA_RETRY_ATTEMPTS 4
+#define MBA_RETRY_DELAY_MS 1
+#define MBA_RETRY_DELAY_MAX_MS 8
 
 #include <Arduino.h>
 #include <Wire.h>
+#include "bqbus.h"
 
 enum DisplayFormat {
   FORMAT_DECIMAL,
@@ -15,33 +40,196 @@ enum DisplayFormat {
   FORMAT_MIXED,
 };
 
+// How the end of a command is detected by the completion polling
+enum MBACompletion {
+  COMPLETION_ECHO,  // Read: the response block echoes our subcommand once it is ready
+  COMPLETION_ACK,   // Write: the device acknowledges its address again
+  COMPLETION_RESET, // Reset: the device drops off the bus, then acknowledges again
+};
+
+// How long a response stays valid in the response cache (see lookupMBACache)
+enum MBACaching {
+  CACHE_NEVER,        // Volatile (status registers) or write command, always sent to the device
+  CACHE_STATIC,       // Constant until DeviceReset or a pack swap (versions)
+  CACHE_UNTIL_WRITE,  // Only changed by writes, evicted by any write to the battery
+};
+
 // Represents a single bit in a status or response byte
+// Strings are stored inline so the whole table can live in PROGMEM (see getBitField* accessors)
 struct BitFieldInfo {
-  uint8_t bitIndex;        // Index (0-7)
-  const char* label;       // Name of the bit (e.g. "PF Alert")
-  const char* description; // Description or meaning
-  const char* activeValue; // What does it mean when the bit is 1?
-  const char* inactiveValue; // Optional: what does it mean when bit is 0?
+  uint8_t bitIndex;        // Index (0-31)
+  char label[11];          // Name of the bit (e.g. "PF Alert")
+  char description[70];    // Description or meaning
+  char activeValue[10];    // What does it mean when the bit is 1?
+  char inactiveValue[14];  // Optional: what does it mean when bit is 0?
 };
 
+// Strings are stored inline so the whole table can live in PROGMEM (see getMBACommand* accessors)
 typedef struct {
     uint16_t cmd;
     uint8_t data[8];
     uint8_t dataLength;
-    const char* name; 
-    const char* access;
-    const DisplayFormat displayFormat;
+    char name[26];
+    char access[2];
+    DisplayFormat displayFormat;
     const BitFieldInfo* bitfields;
     uint8_t bitfieldCount;
-    const char* description;
+    MBACompletion completion; // How completion is polled
+    uint16_t timeoutMs;       // Give up polling after this delay
+    uint8_t pollMs;           // First poll interval, doubled after each miss (see MBA_POLL_INTERVAL_MAX_MS)
+    uint16_t busTimeoutUs;    // Deadline of one bus transaction, 0 for MBA_BUS_TIMEOUT_US (flash writes stretch the clock longer)
+    MBACaching caching;       // Whether and until when its response may be served from the cache
+    char description[106];
 } MBACommandInfo;
 
+// Unit of an SBS word register, tells how its value is printed
+enum SBSUnit {
+  SBS_UNIT_NONE,        // Plain count
+  SBS_UNIT_MILLIVOLT,
+  SBS_UNIT_MILLIAMP,    // Signed, negative while discharging
+  SBS_UNIT_PERCENT,
+  SBS_UNIT_DECIKELVIN,  // 0.1 K, printed in degrees Celsius
+};
+
+// Standard SBS (Smart Battery Data) word register, read with a single SMBus read-word
+// Strings are stored inline so the whole table can live in PROGMEM (see getSBSRegister* accessors)
+typedef struct {
+    uint8_t reg;
+    char name[22];
+    SBSUnit unit;
+    char description[64];
+} SBSRegisterInfo;
+
+// Flash-resident accessors, every BitFieldInfo / MBACommandInfo pointer points into PROGMEM
+// and must never be dereferenced directly
+inline uint8_t getBitFieldIndex(const BitFieldInfo* b) { return pgm_read_byte(&b->bitIndex); }
+inline const __FlashStringHelper* getBitFieldLabel(const BitFieldInfo* b) { return (const __FlashStringHelper*)b->label; }
+inline const __FlashStringHelper* getBitFieldDescription(const BitFieldInfo* b) { return (const __FlashStringHelper*)b->description; }
+inline const __FlashStringHelper* getBitFieldActiveValue(const BitFieldInfo* b) { return (const __FlashStringHelper*)b->activeValue; }
+inline const __FlashStringHelper* getBitFieldInactiveValue(const BitFieldInfo* b) { return (const __FlashStringHelper*)b->inactiveValue; }
+
+inline uint16_t getMBACommandSubcommand(const MBACommandInfo* cmdInfo) { return pgm_read_word(&cmdInfo->cmd); }
+inline uint8_t getMBACommandDataLength(const MBACommandInfo* cmdInfo) { return pgm_read_byte(&cmdInfo->dataLength); }
+inline uint8_t getMBACommandData(const MBACommandInfo* cmdInfo, uint8_t i) { return pgm_read_byte(&cmdInfo->data[i]); }
+inline const __FlashStringHelper* getMBACommandName(const MBACommandInfo* cmdInfo) { return (const __FlashStringHelper*)cmdInfo->name; }
+inline bool isMBACommandWriteOnly(const MBACommandInfo* cmdInfo) { return pgm_read_byte(&cmdInfo->access[0]) == 'W'; }
+inline DisplayFormat getMBACommandDisplayFormat(const MBACommandInfo* cmdInfo) { return (DisplayFormat)pgm_read_byte(&cmdInfo->displayFormat); }
+inline const BitFieldInfo* getMBACommandBitFields(const MBACommandInfo* cmdInfo) { return (const BitFieldInfo*)pgm_read_ptr(&cmdInfo->bitfields); }
+inline uint8_t getMBACommandBitFieldCount(const MBACommandInfo* cmdInfo) { return pgm_read_byte(&cmdInfo->bitfieldCount); }
+inline MBACompletion getMBACommandCompletion(const MBACommandInfo* cmdInfo) { return (MBACompletion)pgm_read_byte(&cmdInfo->completion); }
+inline uint16_t getMBACommandTimeout(const MBACommandInfo* cmdInfo) { return pgm_read_word(&cmdInfo->timeoutMs); }
+inline uint8_t getMBACommandPollInterval(const MBACommandInfo* cmdInfo) { return pgm_read_byte(&cmdInfo->pollMs); }
+inline uint16_t getMBACommandBusTimeout(const MBACommandInfo* cmdInfo) {
+  uint16_t timeoutUs = pgm_read_word(&cmdInfo->busTimeoutUs);
+  return timeoutUs != 0 ? timeoutUs : MBA_BUS_TIMEOUT_US;
+}
+inline MBACaching getMBACommandCaching(const MBACommandInfo* cmdInfo) { return (MBACaching)pgm_read_byte(&cmdInfo->caching); }
+inline const __FlashStringHelper* getMBACommandDescription(const MBACommandInfo* cmdInfo) { return (const __FlashStringHelper*)cmdInfo->description; }
+
+inline uint8_t getSBSRegister(const SBSRegisterInfo* regInfo) { return pgm_read_byte(&regInfo->reg); }
+inline const __FlashStringHelper* getSBSRegisterName(const SBSRegisterInfo* regInfo) { return (const __FlashStringHelper*)regInfo->name; }
+inline SBSUnit getSBSRegisterUnit(const SBSRegisterInfo* regInfo) { return (SBSUnit)pgm_read_byte(&regInfo->unit); }
+inline const __FlashStringHelper* getSBSRegisterDescription(const SBSRegisterInfo* regInfo) { return (const __FlashStringHelper*)regInfo->description; }
+
+// Compile-time identifiers of the MBACommandsInfo entries, in table order.
+// Adding a command means adding it both here and in MBACommandsInfo / MBACommandsByName,
+// static_asserts at the end of this file catch any mismatch.
+#define MBA_COMMAND_IDS(X) \
+  X(DeviceType) \
+  X(FirmwareVersion) \
+  X(HardwareVersion) \
+  X(PermanentFailure) \
+  X(LifetimeDataReset) \
+  X(PermanentFailureDataReset) \
+  X(BlackBoxRecorderReset) \
+  X(SealDevice) \
+  X(DeviceReset) \
+  X(SafetyAlert) \
+  X(SafetyStatus) \
+  X(PFAlert) \
+  X(PFStatus) \
+  X(OperationStatus) \
+  X(ManufacturingStatus) \
+  X(LifetimeDataBlock1) \
+  X(LifetimeDataBlock2) \
+  X(LifetimeDataBlock3) \
+  X(LifetimeDataBlock4) \
+  X(LifetimeDataBlock5) \
+  X(UnsealKey1) \
+  X(UnsealKey2) \
+  X(PF2RegisterRead) \
+  X(ClearPF2)
+
+enum class Cmd : uint8_t {
+#define MBA_COMMAND_ID(id) id,
+  MBA_COMMAND_IDS(MBA_COMMAND_ID)
+#undef MBA_COMMAND_ID
+  Count
+};
+
+// Compile-time identifiers of the SBSRegistersInfo entries, in table order (checked like MBA_COMMAND_IDS)
+#define SBS_REGISTER_IDS(X) \
+  X(Temperature) \
+  X(Voltage) \
+  X(Current) \
+  X(RelativeStateOfCharge) \
+  X(CycleCount) \
+  X(SerialNumber) \
+  X(CellVoltage4) \
+  X(CellVoltage3) \
+  X(CellVoltage2) \
+  X(CellVoltage1)
+
+enum class Sbs : uint8_t {
+#define SBS_REGISTER_ID(id) id,
+  SBS_REGISTER_IDS(SBS_REGISTER_ID)
+#undef SBS_REGISTER_ID
+  Count
+};
+
+/**
+ * @brief Retrieves a pointer to an SBS word register by its compile-time identifier.
+ *
+ * @param id  The register identifier (e.g., Sbs::Voltage).
+ *
+ * @return A pointer to the matching SBSRegisterInfo struct (points into PROGMEM).
+ */
+inline const SBSRegisterInfo* getSBSRegisterInfo(Sbs id);
+
+/**
+ * @brief Retrieves a pointer to a ManufacturerBlockAccess command by its compile-time identifier.
+ *
+ * The lookup is a plain table index (MBACommandsInfo is ordered like `Cmd`), so it costs nothing
+ * at runtime and an unknown command name is a build error.
+ *
+ * @param id  The command identifier (e.g., Cmd::DeviceType).
+ *
+ * @return A pointer to the matching MBACommandInfo struct (points into PROGMEM).
+ */
+inline const MBACommandInfo* getMBACommandInfo(Cmd id);
+
+/**
+ * @brief Retrieves the identifier of a ManufacturerBlockAccess command by its name.
+ *
+ * Binary search over the MBACommandsByName index (sorted at compile time), intended for
+ * names coming from a serial console rather than from code.
+ *
+ * @param name  The name of the command to search for (e.g., "DeviceType").
+ * @param id    Output, receives the command identifier when found.
+ *
+ * @return true if a command with this name exists, false otherwise or if `name` is NULL.
+ *
+ * @note The name comparison is case-sensitive.
+ */
+bool getMBACommandIdByName(const char* name, Cmd* id);
+
 /**
  * @brief Retrieves a pointer to a ManufacturerBlockAccess command by its name.
  *
- * This function searches the static MBACommandsInfo array for a command whose `name` field
+ * This function searches the MBACommandsByName index for a command whose `name` field
  * matches the specified string (case-sensitive), and returns a pointer to its corresponding
- * MBACommandInfo structure.
+ * MBACommandInfo structure. The returned pointer points into PROGMEM.
+ * Prefer getMBACommandInfo(Cmd) when the command is known at compile time.
  *
  * @param name  The name of the command to search for (e.g., "DeviceType").
  *              Must not be NULL.
@@ -53,6 +241,200 @@ typedef struct {
  */
 const MBACommandInfo* getMBACommandInfoByName(const char* name);
 
+/**
+ * @brief Retrieves the identifier of an SBS word register by its name.
+ *
+ * Linear search, the SBS table only has a few entries. Intended for names coming from a
+ * serial console, like getMBACommandIdByName.
+ *
+ * @param name  The name of the register to search for (e.g., "Voltage").
+ * @param id    Output, receives the register identifier when found.
+ *
+ * @return true if a register with this name exists, false otherwise or if `name` is NULL.
+ *
+ * @note The name comparison is case-sensitive.
+ */
+bool getSBSRegisterIdByName(const char* name, Sbs* id);
+
+// Largest payload of a ManufacturerBlockAccess block (subcommand echo excluded)
+#define MBA_BLOCK_DATA_MAX 32
+// Payload room left in the bus buffer after the length byte and the 2 bytes of subcommand echo
+#define MBA_RESPONSE_PAYLOAD_SIZE (BQ_BUS_BUFFER_SIZE - 3 < MBA_BLOCK_DATA_MAX ? BQ_BUS_BUFFER_SIZE - 3 : MBA_BLOCK_DATA_MAX)
+
+// Typed response of a ManufacturerBlockAccess read (see readMBAResponse)
+struct MBAResponse {
+  uint8_t error;                                   // 0 on success, printMBACommandError code otherwise
+  uint8_t length;                                  // Payload bytes stored (subcommand echo excluded)
+  bool truncated;                                  // The device announced more than MBA_RESPONSE_PAYLOAD_SIZE bytes
+  bool unverified;                                 // PEC enabled but not checked, the PEC byte did not fit in the bus buffer
+  uint8_t block[2 + MBA_RESPONSE_PAYLOAD_SIZE];    // Block as received: subcommand echo (LSB first) then payload, little-endian
+};
+
+/**
+ * @brief Prepares a response for a command: no error, empty payload, echo set to its subcommand.
+ *
+ * Write commands keep it as is, so their result reports the subcommand that was sent.
+ *
+ * @param response    Response to initialize.
+ * @param subcommand  Subcommand the response belongs to.
+ */
+inline void beginMBAResponse(MBAResponse* response, uint16_t subcommand) {
+  response->error = 0;
+  response->length = 0;
+  response->truncated = false;
+  response->unverified = false;
+  response->block[0] = subcommand & 0xFF;
+  response->block[1] = subcommand >> 8;
+}
+
+/**
+ * @brief Prepares a response for a command: no error, empty payload, echo set to its subcommand.
+ *
+ * @param response  Response to initialize.
+ * @param cmdInfo   Command the response belongs to (points into PROGMEM).
+ */
+inline void beginMBAResponse(MBAResponse* response, const MBACommandInfo* cmdInfo) {
+  beginMBAResponse(response, getMBACommandSubcommand(cmdInfo));
+}
+
+/**
+ * @brief Returns the subcommand echoed by the device.
+ *
+ * @param response  Response read by readMBAResponse.
+ */
+inline uint16_t getMBAResponseSubcommand(const MBAResponse* response) {
+  return ((uint16_t)response->block[1] << 8) | response->block[0];
+}
+
+/**
+ * @brief Returns the payload of a response, read in place from the received block.
+ *
+ * @param response  Response read by readMBAResponse.
+ */
+inline const uint8_t* getMBAResponsePayload(const MBAResponse* response) {
+  return &response->block[2];
+}
+
+/**
+ * @brief Decodes the first (up to) 4 payload bytes of a response as a little-endian value.
+ *
+ * @param response  Response read by readMBAResponse.
+ *
+ * @return The register value, e.g. the 32 flags of SafetyAlert or the 16 of ManufacturingStatus.
+ */
+inline uint32_t getMBAResponseValue(const MBAResponse* response) {
+  const uint8_t* payload = getMBAResponsePayload(response);
+  uint32_t value = 0;
+  for (uint8_t i = min(response->length, 4); i > 0; i--) {
+    value = (value << 8) | payload[i - 1];
+  }
+  return value;
+}
+
+// Result of a completion poll
+enum MBAWaitStatus {
+  MBA_WAIT_PENDING,
+  MBA_WAIT_DONE,
+  MBA_WAIT_TIMEOUT,
+};
+
+// State of the completion polling of one command (see beginMBAWait / pollMBAWait)
+struct MBAWait {
+  const MBACommandInfo* cmdInfo;
+  uint8_t address;
+  unsigned long startedAt;
+  unsigned long nextPollAt;
+  uint8_t interval;
+  bool sawOffline;
+  bool reading;              // A block read runs in the background (see pollMBAResponse)
+  uint8_t attempt;           // Attempts of the block read so far, for the retry policy
+  uint32_t requestedAtUs;    // micros() at the start of the running read, for its deadline
+  uint32_t readStartedAtUs;  // For the instrumentation only, first attempt of the read
+  uint32_t startedAtUs;      // For the instrumentation only (see stats.h)
+};
+
+/**
+ * @brief Starts the completion polling of a command that has just been sent.
+ *
+ * @param wait     Polling state to initialize.
+ * @param address  I2C address of the target battery device.
+ * @param cmdInfo  Command that was sent, its completion/timeoutMs/pollMs fields drive the polling.
+ */
+void beginMBAWait(MBAWait* wait, uint8_t address, const MBACommandInfo* cmdInfo);
+
+/**
+ * @brief Polls the device once if the next poll is due, without blocking.
+ *
+ * Depending on the command completion mode, the device is considered done when:
+ * - COMPLETION_ECHO: immediately, the echo is checked by readMBAResponse itself.
+ * - COMPLETION_ACK: the device acknowledges its address.
+ * - COMPLETION_RESET: the device has stopped acknowledging its address, then acknowledges again.
+ *
+ * Between two misses the poll interval is doubled, up to MBA_POLL_INTERVAL_MAX_MS.
+ *
+ * @param wait  Polling state initialized by beginMBAWait.
+ *
+ * @return MBA_WAIT_DONE once completed, MBA_WAIT_TIMEOUT after `timeoutMs`, MBA_WAIT_PENDING otherwise.
+ */
+MBAWaitStatus pollMBAWait(MBAWait* wait);
+
+/**
+ * @brief Blocks until a command that has just been sent is completed.
+ *
+ * @param address  I2C address of the target battery device.
+ * @param cmdInfo  Command that was sent.
+ *
+ * @return true once the device reports completion, false on timeout.
+ */
+bool waitMBACommand(uint8_t address, const MBACommandInfo* cmdInfo);
+
+/**
+ * @brief Writes a ManufacturerBlockAccess command and its subcommand/data, without waiting or printing.
+ *
+ * Completion is left to the caller (see beginMBAWait), so that waits on several batteries can overlap.
+ * A NACKed or failed block is sent again according to the retry policy (see setMBARetryPolicy).
+ * With PEC enabled, a block NACKed on its PEC byte (code 3) is sent again, up to MBA_PEC_RETRIES times.
+ *
+ * @param address  I2C address of the target battery device.
+ * @param cmdInfo  Command to send.
+ *
+ * @return The Wire.endTransmission() code of the last attempt, 0 on success.
+ */
+uint8_t issueMBACommand(uint8_t address, const MBACommandInfo* cmdInfo);
+
+/**
+ * @brief Writes a ManufacturerBlockAccess block with a subcommand not in MBACommandsInfo.
+ *
+ * Used for the subcommands computed at run time, such as DataFlash addresses (0x4000-0x5FFF):
+ * writing an address alone selects it for reading, with data it writes the flash from there.
+ * A NACKed or failed block is sent again according to the retry policy (see setMBARetryPolicy).
+ *
+ * @param address       I2C address of the target battery device.
+ * @param subcommand    Subcommand (or DataFlash address) to write.
+ * @param data          Bytes following the subcommand, in SRAM (NULL if `length` is 0).
+ * @param length        Number of data bytes, up to MBA_WRITE_DATA_SIZE.
+ * @param busTimeoutUs  Deadline of one transaction (MBA_BUS_TIMEOUT_US, longer for flash writes).
+ *
+ * @return The Wire.endTransmission() code of the last attempt, 0 on success.
+ */
+uint8_t writeMBASubcommand(uint8_t address, uint16_t subcommand, const uint8_t* data, uint8_t length,
+                           uint16_t busTimeoutUs);
+
+/**
+ * @brief Reads the response of a subcommand written with writeMBASubcommand, without printing.
+ *
+ * The block is read again (poll interval doubled from 1 ms) until it echoes `subcommand`,
+ * up to MBA_SUBCOMMAND_TIMEOUT_MS. Blocks longer than MBA_RESPONSE_PAYLOAD_SIZE are truncated,
+ * a DataFlash read returns the first MBA_RESPONSE_PAYLOAD_SIZE bytes from the written address.
+ *
+ * @param address     I2C address of the target device.
+ * @param subcommand  Subcommand (or DataFlash address) that was written.
+ * @param response    Output, receives the error code, echoed subcommand and payload.
+ *
+ * @return true if the response was read, false otherwise (see `response->error`).
+ */
+bool readMBASubcommandResponse(uint8_t address, uint16_t subcommand, MBAResponse* response);
+
 /**
  * @brief Sends a ManufacturerBlockAccess (MBA) command to a BQ battery device over I2C.
  *
@@ -69,60 +451,214 @@ const MBACommandInfo* getMBACommandInfoByName(const char* name);
  *
  * @note This function assumes the device uses the standard SMBus block write format, 
  *       where the first byte after the command indicates the total number of data bytes to follow.
- *       It includes a small delay (20 ms) after transmission to allow the device to process the command.
+ *       It then polls the device until it reports completion (see pollMBAWait), instead of a fixed delay.
  */
 bool sendMBACommand(const uint8_t address, const MBACommandInfo* cmdInfo);
 
 /**
- * @brief Reads a response block from a device over I2C using the Manufacturer Block Access (MBA) command.
+ * @brief Reads the response of a ManufacturerBlockAccess command into a typed result, without printing.
  *
- * This function sends a Manufacturer Block Access command to a device at the specified I2C address,
- * then reads the resulting data block into the provided buffer. It checks for basic transmission
- * errors, handles timeouts, and verifies buffer sizes to avoid overflows.
+ * This function reads the ManufacturerBlockAccess block of the device at the specified I2C address.
+ * The block is read again (with the command poll backoff) until it echoes the expected subcommand,
+ * so the read completes as soon as the device has the result ready.
+ * Nothing is written to Serial: errors are reported in `response->error` and formatting is left
+ * to printMBAResponse, which can be deferred or skipped.
  *
- * Additionally, the function:
- * - Warns if the response length exceeds the buffer capacity.
- * - Prints the received data using the format specified in `cmdInfo.displayFormat`.
- * - Converts the data from little-endian to big-endian using `reverseEndian`.
+ * @param address   I2C address of the target device.
+ * @param cmdInfo   Command whose response is expected (sent beforehand with sendMBACommand).
+ * @param response  Output, receives the error code, echoed subcommand and payload.
  *
- * @param address I2C address of the target device.
- * @param cmdInfo Command metadata containing display format and other related info.
- * @param buffer Pointer to the buffer where the read data will be stored.
- * @param bufferSize Size of the buffer (maximum number of bytes to read).
+ * @return true if the response was read, false on transmission failure, timeout,
+ *         or if no sufficient data was available (see `response->error`).
  *
- * @return `true` if the data was successfully read and processed; `false` on transmission failure, timeout,
- *         or if no sufficient data was available.
- *
- * @note The function assumes that the device echoes back the command before the result block,
- *       and that the first byte of the response indicates the payload length.
+ * @note The device echoes back the subcommand before the result and the first byte of the block
+ *       is its length. Payloads longer than MBA_RESPONSE_PAYLOAD_SIZE are truncated (`truncated` is set).
  *
  * Example usage:
  * @code
- * uint8_t data[32];
- * if (readMBACommand(0x50, myCmdInfo, data, sizeof(data))) {
- *     // Process the data
+ * MBAResponse response;
+ * if (readMBAResponse(0x0B, getMBACommandInfo(Cmd::PFStatus), &response)) {
+ *     // Process getMBAResponsePayload(&response)
  * }
  * @endcode
  */
-bool readMBACommand(uint8_t address, const MBACommandInfo* cmdInfo, uint8_t* buffer, size_t bufferSize);
+bool readMBAResponse(uint8_t address, const MBACommandInfo* cmdInfo, MBAResponse* response);
 
 /**
- * @brief Run a BQ ManufacturerBlockAccess command by name: send the sub-command and read back data.
+ * @brief Reads the ManufacturerBlockAccess block once if the next poll is due, without blocking.
+ *
+ * Non-blocking step of readMBAResponse: while the device does not echo the expected subcommand
+ * the read is retried with the command poll backoff, until its `timeoutMs`. A NACKed or failed read
+ * is retried according to the retry policy (see setMBARetryPolicy). With PEC enabled,
+ * a corrupted block is read again at once, up to MBA_PEC_RETRIES times. On a bus running the
+ * read in the background (see BQBus::startRequest) the call returns as soon as the read is
+ * started, the block is taken by a later call once the bus is done.
+ *
+ * @param wait      Polling state initialized by beginMBAWait with the command whose response is expected.
+ * @param response  Output, receives the error code, echoed subcommand and payload.
+ *
+ * @return MBA_WAIT_DONE once the response is read, MBA_WAIT_TIMEOUT on failure (see `response->error`),
+ *         MBA_WAIT_PENDING otherwise.
+ */
+MBAWaitStatus pollMBAResponse(MBAWait* wait, MBAResponse* response);
+
+/**
+ * @brief Run a BQ ManufacturerBlockAccess command: send the sub-command and read back data.
  * 
- * This function looks up the command info by its name, sends the
- * ManufacturerBlockAccess command with the sub-command,
+ * This function sends the ManufacturerBlockAccess command with the sub-command,
  * reads the response from the device, and prints it according to the
- * command's expected data format.
+ * command's expected data format (or sends it as a telemetry frame in OUTPUT_MODE_BINARY).
  * 
  * @param address I2C device address
- * @param cmdName Name of the command to run (case-sensitive)
- * @param format Display format for the read data (decimal, hex, binary, text)
+ * @param id      Compile-time identifier of the command to run (e.g., Cmd::PFStatus)
  * 
  * @return true if command executed successfully, false on failure.
  */
+bool runMBACommand(uint8_t address, Cmd id);
+
+/**
+ * @brief Run a BQ ManufacturerBlockAccess command by name: send the sub-command and read back data.
+ * 
+ * Same as runMBACommand(uint8_t, Cmd) but looks up the command by its name first,
+ * intended for names typed on a serial console.
+ * 
+ * @param address I2C device address
+ * @param cmdName Name of the command to run (case-sensitive)
+ * 
+ * @return true if command executed successfully, false on failure (including unknown name).
+ */
 bool runMBACommand(uint8_t address, const char* cmdName);
 
-static const BitFieldInfo safetyAlertBits[] = {
+// Raw result of one command of a batch (see runMBABatch)
+struct MBABatchSlot {
+  Cmd id;
+  MBAResponse response;  // error is set for write commands too, the payload stays empty
+};
+
+// Slots of the shared transaction arena (see getMBAArena)
+#define MBA_ARENA_SLOTS 8
+
+/**
+ * @brief Enables SMBus packet error checking (PEC) on every transaction.
+ *
+ * Writes are followed by their PEC byte, reads request it and check it. A transaction
+ * failing its check is done again at once, up to MBA_PEC_RETRIES times, instead of failing
+ * the whole command.
+ *
+ * @param enabled  true to use PEC, false by default.
+ */
+void setMBAPECEnabled(bool enabled);
+
+/**
+ * @brief Returns whether SMBus packet error checking is enabled.
+ */
+bool isMBAPECEnabled();
+
+/**
+ * @brief Returns the number of PEC mismatches seen since startup, retried ones included.
+ */
+uint16_t getMBAPECErrors();
+
+/**
+ * @brief Returns the number of block reads done with PEC enabled but not checked, since startup.
+ *
+ * Echo polls are counted too. A block filling the bus buffer (truncated, or exactly BQ_BUS_BUFFER_SIZE - 1 bytes long) leaves
+ * no room for its PEC byte. Such a block is returned with `unverified` set rather than as an error.
+ */
+uint16_t getMBAPECUnverified();
+
+/**
+ * @brief Sets how transactions failing on a NACK or a bus error are retried.
+ *
+ * A transaction failing with Wire code 2 (address NACK), 3 (data NACK), 4 (bus error) or 5 (timeout)
+ * is done again after a delay doubled on each attempt, from `delayMs` up to `delayMaxMs`. Codes 4 and 5
+ * also recover the bus first (see BQBus::recover), in case a device holds SDA low.
+ *
+ * @param attempts    Total attempts of a transaction, 1 to never retry (MBA_RETRY_ATTEMPTS by default).
+ * @param delayMs     Delay before the first retry (MBA_RETRY_DELAY_MS by default).
+ * @param delayMaxMs  Maximum delay between two attempts (MBA_RETRY_DELAY_MAX_MS by default).
+ */
+void setMBARetryPolicy(uint8_t attempts, uint8_t delayMs, uint8_t delayMaxMs);
+
+/**
+ * @brief Returns the number of transactions done again since startup, for any reason.
+ */
+uint16_t getMBARetries();
+
+/**
+ * @brief Returns the number of bus recoveries since startup.
+ */
+uint16_t getMBABusRecoveries();
+
+/**
+ * @brief Returns the statically allocated arena of MBA_ARENA_SLOTS results.
+ *
+ * runMBACommand and runOnBatteries use it instead of response buffers on the stack, so
+ * their stack usage does not depend on the number of commands or batteries.
+ * It is shared: its content is only valid until the next call of one of them.
+ */
+MBABatchSlot* getMBAArena();
+
+/**
+ * @brief Runs a list of ManufacturerBlockAccess commands back-to-back and stores their raw results.
+ *
+ * All bus work is done first, with only the SMBus bus free time (SMBUS_BUS_FREE_US) between two
+ * transactions and the per-command completion polling; nothing is printed. Decode and print
+ * the results afterwards with printMBABatch.
+ *
+ * @param address  I2C device address
+ * @param cmds     Commands to run, in order.
+ * @param count    Number of commands (and of slots).
+ * @param slots    Caller-provided arena receiving one result per command.
+ *
+ * @return Number of commands that succeeded.
+ *
+ * Example usage:
+ * @code
+ * static const Cmd status[] = { Cmd::OperationStatus, Cmd::PFStatus };
+ * MBABatchSlot slots[2];
+ * runMBABatch(0x0B, status, 2, slots);
+ * printMBABatch(slots, 2);
+ * @endcode
+ */
+uint8_t runMBABatch(uint8_t address, const Cmd* cmds, uint8_t count, MBABatchSlot* slots);
+
+/**
+ * @brief Reads an SBS word register with a single SMBus read-word transaction, without printing.
+ *
+ * Unlike ManufacturerBlockAccess there is no subcommand to send nor echo to wait for: the
+ * register address is written, then the 2 bytes of the word are read back (LSB first) after
+ * a repeated start. This is the cheapest way to sample the measurements.
+ * A NACKed or failed read is retried according to the retry policy (see setMBARetryPolicy).
+ * With PEC enabled, a corrupted word is read again, up to MBA_PEC_RETRIES times.
+ *
+ * @param address  I2C address of the target device.
+ * @param id       Register to read (e.g., Sbs::Voltage).
+ * @param value    Output, receives the raw word (cast it to int16_t for signed registers).
+ *
+ * @return 0 on success, else the Wire.endTransmission() code, MBA_ERROR_NO_DATA or MBA_ERROR_PEC.
+ *
+ * Example usage:
+ * @code
+ * uint16_t millivolts;
+ * if (readSBSWord(0x0B, Sbs::Voltage, &millivolts) == 0) {
+ *     // Process millivolts
+ * }
+ * @endcode
+ */
+uint8_t readSBSWord(uint8_t address, Sbs id, uint16_t* value);
+
+/**
+ * @brief Reads an SBS word register and prints it with its unit (FRAME_SBS in OUTPUT_MODE_BINARY).
+ *
+ * @param address  I2C address of the target device.
+ * @param id       Register to read (e.g., Sbs::Voltage).
+ *
+ * @return true if the register was read.
+ */
+bool runSBSRead(uint8_t address, Sbs id);
+
+static const BitFieldInfo safetyAlertBits[] PROGMEM = {
   // Bits 0–7
   {  0, "CUV",     "Cell Undervoltage",                          "Detected", "Not Detected" },
   {  1, "COV",     "Cell Overvoltage",                           "Detected", "Not Detected" },
@@ -164,7 +700,7 @@ static const BitFieldInfo safetyAlertBits[] = {
   { 31, "RSVD",    "Reserved",                                   "",          "" },
 };
 
-static const BitFieldInfo safetyStatusBits[] = {
+static const BitFieldInfo safetyStatusBits[] PROGMEM = {
   // Bits 0–7
   {  0, "CUV",     "Cell Undervoltage",                          "Detected", "Not Detected" },
   {  1, "COV",     "Cell Overvoltage",                           "Detected", "Not Detected" },
@@ -206,7 +742,7 @@ static const BitFieldInfo safetyStatusBits[] = {
   { 31, "RSVD",    "Reserved",                                   "",          "" },
 };
 
-static const BitFieldInfo pfAlertBits[] = {
+static const BitFieldInfo pfAlertBits[] PROGMEM = {
   // Bit 0–7
   { 0,  "SUV",    "Safety Cell Undervoltage Failure",       "Detected", "Not Detected" },
   { 1,  "SOV",    "Safety Cell Overvoltage Failure",        "Detected", "Not Detected" },
@@ -248,7 +784,7 @@ static const BitFieldInfo pfAlertBits[] = {
   {31,  "TS4",    "Open Thermistor TS4 Failure",            "Detected", "Not Detected" }
 };
 
-static const BitFieldInfo pfStatusBits[] = {
+static const BitFieldInfo pfStatusBits[] PROGMEM = {
   // Bits 0–7
   {  0, "SUV",    "Safety Cell Undervoltage Failure",            "Detected", "Not Detected" },
   {  1, "SOV",    "Safety Cell Overvoltage Failure",             "Detected", "Not Detected" },
@@ -290,7 +826,7 @@ static const BitFieldInfo pfStatusBits[] = {
   { 31, "TS4",    "Open Thermistor TS4 Failure",                 "Detected", "Not Detected" }
 };
 
-static const BitFieldInfo operationStatusBits[] = {
+static const BitFieldInfo operationStatusBits[] PROGMEM = {
   // Bits 0–7
   {  0, "PRES",     "System Present (low)",                       "Active", "Inactive" },
   {  1, "DSG",      "Discharge FET status",                      "Active", "Inactive" },
@@ -332,7 +868,7 @@ static const BitFieldInfo operationStatusBits[] = {
   { 31, "RSVD",    "Reserved",                                   "",          "" },
 };
 
-static const BitFieldInfo ManufacturingStatusBits[] = {
+static const BitFieldInfo ManufacturingStatusBits[] PROGMEM = {
   // Bits 0–7
   {  0, "PCHG",     "Precharge FET Test.",                          "Active", "Disabled" },
   {  1, "CHG",      "Charge FET Test.",                             "Active", "Disabled" },
@@ -355,27 +891,115 @@ static const BitFieldInfo ManufacturingStatusBits[] = {
 };
 
 // List of ManufacturerBlockAccess commands () (data from bq40z50-R2 Technical Reference)
-static const MBACommandInfo MBACommandsInfo[] = {
-    {0x0001, {}, 0,"DeviceType", "R", FORMAT_HEX, NULL, 0, "Identifies the battery device type to verify model and family compatibility."},
-    {0x0002, {}, 0,"FirmwareVersion", "R", FORMAT_HEX, NULL, 0, "Reports the firmware version running on the battery controller, useful for compatibility and updates."},
-    {0x0003, {}, 0,"HardwareVersion", "R", FORMAT_HEX, NULL, 0, "Indicates the hardware revision of the device to identify physical variations or improvements."},
-    {0x0024, {}, 0,"PermanentFailure", "W", FORMAT_HEX, NULL, 0, "This command enables/disables Permanent Failure to help streamline production testing."},
-    {0x0028, {}, 0,"LifetimeDataReset", "W", FORMAT_HEX, NULL, 0, "Resets accumulated lifetime data such as cycle count and usage statistics."},
-    {0x0029, {}, 0,"PermanentFailureDataReset", "W", FORMAT_HEX, NULL, 0, "Resets permanent failure data flags to clear fault status."},
-    {0x002A, {}, 0,"BlackBoxRecorderReset", "W", FORMAT_HEX, NULL, 0, "Resets the black box event recorder to clear logged fault history."},
-    {0x0030, {}, 0,"SealDevice", "W", FORMAT_HEX, NULL, 0, "Seals the device to prevent further modifications to configuration or data."},
-    {0x0041, {}, 0,"DeviceReset", "W", FORMAT_HEX, NULL, 0, "Command to reset the device, reinitializing all registers and states."},
-    {0x0050, {}, 0,"SafetyAlert", "R", FORMAT_BINARY, safetyAlertBits, 32, "Returns current safety alert flags indicating critical conditions such as overvoltage or overtemperature."},
-    {0x0051, {}, 0,"SafetyStatus", "R", FORMAT_BINARY, safetyStatusBits, 32, "Reports the current safety status of the device, showing ongoing safety-related events."},
-    {0x0052, {}, 0,"PFAlert", "R", FORMAT_BINARY, pfAlertBits, 32, "Indicates permanent failure alerts that require immediate attention or servicing."},
-    {0x0053, {}, 0,"PFStatus", "R", FORMAT_BINARY, pfStatusBits, 32, "Reports the status of permanent failure flags for battery health monitoring."},
-    {0x0054, {}, 0,"OperationStatus", "R", FORMAT_BINARY, operationStatusBits, 32, "General operational status reporting the current mode and condition of the device."},
-    {0x0057, {}, 0,"ManufacturingStatus", "R", FORMAT_BINARY, ManufacturingStatusBits, 16, "Contains informations about activated modes (PF, etc ..)"},
-    {0x7EE0, {}, 0,"UnsealKey1", "W", FORMAT_HEX, NULL, 0, "Key to change security mode from SEALED to UNSEALED 1/2. The two words must be sent within 4 s."},
-    {0xCCDF, {}, 0,"UnsealKey2", "W", FORMAT_HEX, NULL, 0, "Key to change security mode from SEALED to UNSEALED 2/2. The two words must be sent within 4 s."},
-    {0x4062, {}, 0,"PF2RegisterRead", "R", FORMAT_HEX, NULL, 0, "Custom DJI register key where we can find the PF2 flag."},
+static constexpr MBACommandInfo MBACommandsInfo[] PROGMEM = {
+    {0x0001, {}, 0,"DeviceType", "R", FORMAT_HEX, NULL, 0, COMPLETION_ECHO, 500, 2, 0, CACHE_STATIC, "Identifies the battery device type to verify model and family compatibility."},
+    {0x0002, {}, 0,"FirmwareVersion", "R", FORMAT_HEX, NULL, 0, COMPLETION_ECHO, 500, 2, 0, CACHE_STATIC, "Reports the firmware version running on the battery controller, useful for compatibility and updates."},
+    {0x0003, {}, 0,"HardwareVersion", "R", FORMAT_HEX, NULL, 0, COMPLETION_ECHO, 500, 2, 0, CACHE_STATIC, "Indicates the hardware revision of the device to identify physical variations or improvements."},
+    {0x0024, {}, 0,"PermanentFailure", "W", FORMAT_HEX, NULL, 0, COMPLETION_ACK, 500, 5, 0, CACHE_NEVER, "This command enables/disables Permanent Failure to help streamline production testing."},
+    {0x0028, {}, 0,"LifetimeDataReset", "W", FORMAT_HEX, NULL, 0, COMPLETION_ACK, 2000, 10, 50000, CACHE_NEVER, "Resets accumulated lifetime data such as cycle count and usage statistics."},
+    {0x0029, {}, 0,"PermanentFailureDataReset", "W", FORMAT_HEX, NULL, 0, COMPLETION_ACK, 2000, 10, 50000, CACHE_NEVER, "Resets permanent failure data flags to clear fault status."},
+    {0x002A, {}, 0,"BlackBoxRecorderReset", "W", FORMAT_HEX, NULL, 0, COMPLETION_ACK, 2000, 10, 50000, CACHE_NEVER, "Resets the black box event recorder to clear logged fault history."},
+    {0x0030, {}, 0,"SealDevice", "W", FORMAT_HEX, NULL, 0, COMPLETION_ACK, 500, 5, 0, CACHE_NEVER, "Seals the device to prevent further modifications to configuration or data."},
+    {0x0041, {}, 0,"DeviceReset", "W", FORMAT_HEX, NULL, 0, COMPLETION_RESET, 10000, 5, 0, CACHE_NEVER, "Command to reset the device, reinitializing all registers and states."},
+    {0x0050, {}, 0,"SafetyAlert", "R", FORMAT_BINARY, safetyAlertBits, 32, COMPLETION_ECHO, 500, 2, 0, CACHE_NEVER, "Returns current safety alert flags indicating critical conditions such as overvoltage or overtemperature."},
+    {0x0051, {}, 0,"SafetyStatus", "R", FORMAT_BINARY, safetyStatusBits, 32, COMPLETION_ECHO, 500, 2, 0, CACHE_NEVER, "Reports the current safety status of the device, showing ongoing safety-related events."},
+    {0x0052, {}, 0,"PFAlert", "R", FORMAT_BINARY, pfAlertBits, 32, COMPLETION_ECHO, 500, 2, 0, CACHE_NEVER, "Indicates permanent failure alerts that require immediate attention or servicing."},
+    {0x0053, {}, 0,"PFStatus", "R", FORMAT_BINARY, pfStatusBits, 32, COMPLETION_ECHO, 500, 2, 0, CACHE_NEVER, "Reports the status of permanent failure flags for battery health monitoring."},
+    {0x0054, {}, 0,"OperationStatus", "R", FORMAT_BINARY, operationStatusBits, 32, COMPLETION_ECHO, 500, 2, 0, CACHE_NEVER, "General operational status reporting the current mode and condition of the device."},
+    {0x0057, {}, 0,"ManufacturingStatus", "R", FORMAT_BINARY, ManufacturingStatusBits, 16, COMPLETION_ECHO, 500, 2, 0, CACHE_UNTIL_WRITE, "Contains informations about activated modes (PF, etc ..)"},
+    {0x0060, {}, 0,"LifetimeDataBlock1", "R", FORMAT_HEX, NULL, 0, COMPLETION_ECHO, 500, 2, 0, CACHE_NEVER, "Lifetime extremes: max/min cell voltages, max currents and power, max/min temperatures."},
+    {0x0061, {}, 0,"LifetimeDataBlock2", "R", FORMAT_HEX, NULL, 0, COMPLETION_ECHO, 500, 2, 0, CACHE_NEVER, "Lifetime counters: shutdowns, partial/full/watchdog resets, cell balancing time per cell."},
+    {0x0062, {}, 0,"LifetimeDataBlock3", "R", FORMAT_HEX, NULL, 0, COMPLETION_ECHO, 500, 2, 0, CACHE_NEVER, "Lifetime firmware runtime and time spent in each temperature range."},
+    {0x0063, {}, 0,"LifetimeDataBlock4", "R", FORMAT_HEX, NULL, 0, COMPLETION_ECHO, 500, 2, 0, CACHE_NEVER, "Protection events (COV, CUV, OCD, OCC, AOLD, ASCD): count and cycle count of the last one."},
+    {0x0064, {}, 0,"LifetimeDataBlock5", "R", FORMAT_HEX, NULL, 0, COMPLETION_ECHO, 500, 2, 0, CACHE_NEVER, "Protection events (ASCC, OTC, OTD, OTF) and valid charge terminations, with the last cycle count."},
+    {0x7EE0, {}, 0,"UnsealKey1", "W", FORMAT_HEX, NULL, 0, COMPLETION_ACK, 100, 1, 0, CACHE_NEVER, "Key to change security mode from SEALED to UNSEALED 1/2. The two words must be sent within 4 s."},
+    {0xCCDF, {}, 0,"UnsealKey2", "W", FORMAT_HEX, NULL, 0, COMPLETION_ACK, 100, 1, 0, CACHE_NEVER, "Key to change security mode from SEALED to UNSEALED 2/2. The two words must be sent within 4 s."},
+    {0x4062, {}, 0,"PF2RegisterRead", "R", FORMAT_HEX, NULL, 0, COMPLETION_ECHO, 500, 2, 0, CACHE_UNTIL_WRITE, "Custom DJI register key where we can find the PF2 flag."},
     // Why write 0x01234567 to clear PF ? Saw it with DJI battery recovery tool so i simply reproduce it and it worked well
-    {0x4062, {0x01, 0x23, 0x45, 0x67}, 4,"ClearPF2", "W", FORMAT_HEX, NULL, 0, "Overwrite the custom DJI register key where we can find the PF2 flag."},
+    {0x4062, {0x01, 0x23, 0x45, 0x67}, 4,"ClearPF2", "W", FORMAT_HEX, NULL, 0, COMPLETION_ACK, 2000, 10, 50000, CACHE_NEVER, "Overwrite the custom DJI register key where we can find the PF2 flag."},
 };
 
+// Name index of MBACommandsInfo, sorted by strcmp order for getMBACommandIdByName
+static constexpr Cmd MBACommandsByName[] PROGMEM = {
+    Cmd::BlackBoxRecorderReset,
+    Cmd::ClearPF2,
+    Cmd::DeviceReset,
+    Cmd::DeviceType,
+    Cmd::FirmwareVersion,
+    Cmd::HardwareVersion,
+    Cmd::LifetimeDataBlock1,
+    Cmd::LifetimeDataBlock2,
+    Cmd::LifetimeDataBlock3,
+    Cmd::LifetimeDataBlock4,
+    Cmd::LifetimeDataBlock5,
+    Cmd::LifetimeDataReset,
+    Cmd::ManufacturingStatus,
+    Cmd::OperationStatus,
+    Cmd::PF2RegisterRead,
+    Cmd::PFAlert,
+    Cmd::PFStatus,
+    Cmd::PermanentFailure,
+    Cmd::PermanentFailureDataReset,
+    Cmd::SafetyAlert,
+    Cmd::SafetyStatus,
+    Cmd::SealDevice,
+    Cmd::UnsealKey1,
+    Cmd::UnsealKey2,
+};
+
+// Standard SBS word registers (data from bq40z50-R2 Technical Reference, SBS Commands)
+static constexpr SBSRegisterInfo SBSRegistersInfo[] PROGMEM = {
+    {0x08, "Temperature", SBS_UNIT_DECIKELVIN, "Internal pack temperature."},
+    {0x09, "Voltage", SBS_UNIT_MILLIVOLT, "Sum of the cell voltages."},
+    {0x0A, "Current", SBS_UNIT_MILLIAMP, "Measured current, negative while discharging."},
+    {0x0D, "RelativeStateOfCharge", SBS_UNIT_PERCENT, "Remaining capacity in percent of FullChargeCapacity."},
+    {0x17, "CycleCount", SBS_UNIT_NONE, "Number of discharge cycles the battery has experienced."},
+    {0x1C, "SerialNumber", SBS_UNIT_NONE, "Serial number of the pack, set at manufacturing."},
+    {0x3C, "CellVoltage4", SBS_UNIT_MILLIVOLT, "Voltage of cell 4."},
+    {0x3D, "CellVoltage3", SBS_UNIT_MILLIVOLT, "Voltage of cell 3."},
+    {0x3E, "CellVoltage2", SBS_UNIT_MILLIVOLT, "Voltage of cell 2."},
+    {0x3F, "CellVoltage1", SBS_UNIT_MILLIVOLT, "Voltage of cell 1."},
+};
+
+inline const MBACommandInfo* getMBACommandInfo(Cmd id) {
+  return &MBACommandsInfo[static_cast<uint8_t>(id)];
+}
+
+inline const SBSRegisterInfo* getSBSRegisterInfo(Sbs id) {
+  return &SBSRegistersInfo[static_cast<uint8_t>(id)];
+}
+
+// Compile-time consistency checks between Cmd, MBACommandsInfo and MBACommandsByName
+constexpr int compareMBACommandNames(const char* a, const char* b) {
+  return (*a != *b || *a == '\0') ? (int)(uint8_t)*a - (int)(uint8_t)*b : compareMBACommandNames(a + 1, b + 1);
+}
+
+constexpr bool isMBACommandNameIndexSorted(size_t i) {
+  return i + 1 >= sizeof(MBACommandsByName) / sizeof(MBACommandsByName[0])
+      || (compareMBACommandNames(MBACommandsInfo[static_cast<uint8_t>(MBACommandsByName[i])].name,
+                                 MBACommandsInfo[static_cast<uint8_t>(MBACommandsByName[i + 1])].name) < 0
+          && isMBACommandNameIndexSorted(i + 1));
+}
+
+static_assert(sizeof(MBACommandsInfo) / sizeof(MBACommandsInfo[0]) == static_cast<size_t>(Cmd::Count),
+              "MBACommandsInfo and Cmd must have the same number of entries");
+static_assert(sizeof(MBACommandsByName) / sizeof(MBACommandsByName[0]) == static_cast<size_t>(Cmd::Count),
+              "MBACommandsByName must index every command exactly once");
+static_assert(isMBACommandNameIndexSorted(0), "MBACommandsByName must be sorted by name without duplicates");
+
+#define MBA_COMMAND_ID(id) \
+  static_assert(compareMBACommandNames(MBACommandsInfo[static_cast<uint8_t>(Cmd::id)].name, #id) == 0, \
+                "MBACommandsInfo entry out of order for Cmd::" #id);
+MBA_COMMAND_IDS(MBA_COMMAND_ID)
+#undef MBA_COMMAND_ID
+
+static_assert(sizeof(SBSRegistersInfo) / sizeof(SBSRegistersInfo[0]) == static_cast<size_t>(Sbs::Count),
+              "SBSRegistersInfo and Sbs must have the same number of entries");
+
+#define SBS_REGISTER_ID(id) \
+  static_assert(compareMBACommandNames(SBSRegistersInfo[static_cast<uint8_t>(Sbs::id)].name, #id) == 0, \
+                "SBSRegistersInfo entry out of order for Sbs::" #id);
+SBS_REGISTER_IDS(SBS_REGISTER_ID)
+#undef SBS_REGISTER_ID
+
 #endif // BQCMD_H
\ No newline at end of file
@@ -0,0 +1,145 @@
+#include <Arduino.h>
+#include "cache.h"
+#include "bqbus.h"
+
+// One cached response, free when bus is NULL
+struct MBACacheEntry {
+  BQBus* bus;
+  uint8_t address;
+  uint16_t subcommand;
+  MBACaching caching;
+  MBAResponse response;
+};
+
+static MBACacheEntry cacheEntries[MBA_CACHE_ENTRIES];
+// Entry replaced by the next store when the cache is full (round robin, the oldest one)
+static uint8_t nextEntry = 0;
+static bool cacheEnabled = true;
+static uint16_t cacheHits = 0;
+
+/**
+ * @brief Enables the response cache of the commands marked CACHE_STATIC or CACHE_UNTIL_WRITE.
+ *
+ * @param enabled  true to serve them from the cache, true by default. Disabling it also empties it.
+ */
+void setMBACacheEnabled(bool enabled) {
+  cacheEnabled = enabled;
+  flushMBACache();
+}
+
+/**
+ * @brief Returns whether the response cache is enabled.
+ */
+bool isMBACacheEnabled() {
+  return cacheEnabled;
+}
+
+static MBACacheEntry* findMBACacheEntry(uint8_t address, uint16_t subcommand) {
+  BQBus* bus = getMBABus();
+  for (uint8_t i = 0; i < MBA_CACHE_ENTRIES; i++) {
+    MBACacheEntry* entry = &cacheEntries[i];
+    if (entry->bus == bus && entry->address == address && entry->subcommand == subcommand) {
+      return entry;
+    }
+  }
+  return NULL;
+}
+
+/**
+ * @brief Copies the cached response of a command of the selected battery, if there is one.
+ *
+ * Entries are keyed by bus, address and subcommand, so each battery of the tray has its own.
+ *
+ * @param address   I2C device address.
+ * @param cmdInfo   Command whose response is wanted.
+ * @param response  Output, receives the cached response on a hit.
+ *
+ * @return true on a hit, false if the command must be sent to the device.
+ */
+bool lookupMBACache(uint8_t address, const MBACommandInfo* cmdInfo, MBAResponse* response) {
+  if (!cacheEnabled || getMBACommandCaching(cmdInfo) == CACHE_NEVER) {
+    return false;
+  }
+  const MBACacheEntry* entry = findMBACacheEntry(address, getMBACommandSubcommand(cmdInfo));
+  if (entry == NULL) {
+    return false;
+  }
+  *response = entry->response;
+  cacheHits++;
+  return true;
+}
+
+/**
+ * @brief Keeps the response of a cacheable command of the selected battery, replacing the oldest entry if full.
+ *
+ * Failed, truncated and unchecked (`unverified`) responses, and commands marked CACHE_NEVER, are not kept.
+ *
+ * @param address   I2C device address.
+ * @param cmdInfo   Command that was read.
+ * @param response  Its response.
+ */
+void storeMBACache(uint8_t address, const MBACommandInfo* cmdInfo, const MBAResponse* response) {
+  if (!cacheEnabled || getMBACommandCaching(cmdInfo) == CACHE_NEVER || response->error != 0 || response->truncated ||
+      response->unverified) {
+    return;
+  }
+  uint16_t subcommand = getMBACommandSubcommand(cmdInfo);
+  MBACacheEntry* entry = findMBACacheEntry(address, subcommand);
+  if (entry == NULL) {
+    // A free entry first, else the oldest one
+    for (uint8_t i = 0; i < MBA_CACHE_ENTRIES && entry == NULL; i++) {
+      if (cacheEntries[i].bus == NULL) {
+        entry = &cacheEntries[i];
+      }
+    }
+    if (entry == NULL) {
+      entry = &cacheEntries[nextEntry];
+      nextEntry = (nextEntry + 1) % MBA_CACHE_ENTRIES;
+    }
+  }
+  entry->bus = getMBABus();
+  entry->address = address;
+  entry->subcommand = subcommand;
+  entry->caching = getMBACommandCaching(cmdInfo);
+  entry->response = *response;
+}
+
+/**
+ * @brief Drops the entries of the selected battery made stale by a write.
+ *
+ * Any write evicts the CACHE_UNTIL_WRITE entries and the one of the written subcommand
+ * (e.g. ClearPF2 evicts PF2RegisterRead), a reset evicts everything, CACHE_STATIC included.
+ *
+ * @param address     I2C device address.
+ * @param subcommand  Subcommand (or DataFlash address) written.
+ * @param reset       true if the write resets the device (or the pack may have been swapped).
+ */
+void evictMBACache(uint8_t address, uint16_t subcommand, bool reset) {
+  BQBus* bus = getMBABus();
+  for (uint8_t i = 0; i < MBA_CACHE_ENTRIES; i++) {
+    MBACacheEntry* entry = &cacheEntries[i];
+    if (entry->bus != bus || entry->address != address) {
+      continue;
+    }
+    if (reset || entry->subcommand == subcommand || entry->caching == CACHE_UNTIL_WRITE) {
+      entry->bus = NULL;
+    }
+  }
+}
+
+/**
+ * @brief Empties the cache of every battery, e.g. when the tray is scanned again.
+ */
+void flushMBACache() {
+  for (uint8_t i = 0; i < MBA_CACHE_ENTRIES; i++) {
+    cacheEntries[i].bus = NULL;
+  }
+  nextEntry = 0;
+}
+
+/**
+ * @brief Returns the number of responses served from the cache since startup.
+ */
+uint16_t getMBACacheHits() {
+  return cacheHits;
+}
@@ -0,0 +1,68 @@
+#ifndef CACHE_H
+#define CACHE_H
+
+#include <Arduino.h>
+#include "bqcmd.h"
+
+// Responses kept, all batteries together (about 40 bytes of SRAM each)
+#define MBA_CACHE_ENTRIES 8
+
+/**
+ * @brief Enables the response cache of the commands marked CACHE_STATIC or CACHE_UNTIL_WRITE.
+ *
+ * @param enabled  true to serve them from the cache, true by default. Disabling it also empties it.
+ */
+void setMBACacheEnabled(bool enabled);
+
+/**
+ * @brief Returns whether the response cache is enabled.
+ */
+bool isMBACacheEnabled();
+
+/**
+ * @brief Copies the cached response of a command of the selected battery, if there is one.
+ *
+ * Entries are keyed by bus, address and subcommand, so each battery of the tray has its own.
+ *
+ * @param address   I2C device address.
+ * @param cmdInfo   Command whose response is wanted.
+ * @param response  Output, receives the cached response on a hit.
+ *
+ * @return true on a hit, false if the command must be sent to the device.
+ */
+bool lookupMBACache(uint8_t address, const MBACommandInfo* cmdInfo, MBAResponse* response);
+
+/**
+ * @brief Keeps the response of a cacheable command of the selected battery, replacing the oldest entry if full.
+ *
+ * Failed, truncated and unchecked (`unverified`) responses, and commands marked CACHE_NEVER, are not kept.
+ *
+ * @param address   I2C device address.
+ * @param cmdInfo   Command that was read.
+ * @param response  Its response.
+ */
+void storeMBACache(uint8_t address, const MBACommandInfo* cmdInfo, const MBAResponse* response);
+
+/**
+ * @brief Drops the entries of the selected battery made stale by a write.
+ *
+ * Any write evicts the CACHE_UNTIL_WRITE entries and the one of the written subcommand
+ * (e.g. ClearPF2 evicts PF2RegisterRead), a reset evicts everything, CACHE_STATIC included.
+ *
+ * @param address     I2C device address.
+ * @param subcommand  Subcommand (or DataFlash address) written.
+ * @param reset       true if the write resets the device (or the pack may have been swapped).
+ */
+void evictMBACache(uint8_t address, uint16_t subcommand, bool reset);
+
+/**
+ * @brief Empties the cache of every battery, e.g. when the tray is scanned again.
+ */
+void flushMBACache();
+
+/**
+ * @brief Returns the number of responses served from the cache since startup.
+ */
+uint16_t getMBACacheHits();
+
+#endif // CACHE_H
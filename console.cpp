@@ -0,0 +1,301 @@
+#include <Arduino.h>
+#include "console.h"
+#include "dataflash.h"
+#include "telemetry.h"
+#include "logsink.h"
+#include "stats.h"
+#include "recipes.h"
+#include "history.h"
+#include "lifetime.h"
+
+static const Cmd consoleUnsealCommands[] = { Cmd::UnsealKey1, Cmd::UnsealKey2 };
+
+/**
+ * @brief Starts a line-oriented console on a serial port, nothing is read before pollConsole.
+ *
+ * @param console      Console state to initialize.
+ * @param input        Serial port the commands are read from (e.g. Serial).
+ * @param batteries    Batteries of the tray.
+ * @param count        Number of batteries.
+ * @param unlockTasks  Script state of each battery (`count` entries), used by `unlock` and `run`.
+ */
+void beginConsole(Console* console, Stream* input, const BQBattery* batteries, uint8_t count, UnlockTask* unlockTasks) {
+  console->input = input;
+  console->batteries = batteries;
+  console->count = count;
+  console->selected = 0;
+  console->unlockTasks = unlockTasks;
+  console->unlocking = false;
+  console->watching = false;
+  console->length = 0;
+  console->overflow = false;
+}
+
+static void printConsoleHelp() {
+  Log.println(F("Commands:"));
+  Log.println(F("  battery <name>               target another battery"));
+  Log.println(F("  read <name>                  run a command or read an SBS register (e.g. read PFStatus)"));
+  Log.println(F("  watch <name>... [<ms>ms]     report the changes of registers, watch off to stop"));
+  Log.println(F("  unlock [all]                 unlock the battery (or all of them)"));
+  Log.println(F("  run <recipe> [all]           run a script of the catalog (e.g. run check)"));
+  Log.println(F("  unseal                       send the unseal keys"));
+  Log.println(F("  dump df [start [end]]        dump the DataFlash (unseal first)"));
+  Log.println(F("  lifetime                     read and decode the Lifetime Data blocks"));
+  Log.println(F("  clock <Hz>                   set the bus clock"));
+  Log.println(F("  mode text|binary             switch the output mode"));
+  Log.println(F("  stats [reset]                print or clear the statistics (MBA_STATS_ACTIVATED builds)"));
+  Log.println(F("  history [export|clear]       print, stream (binary frames) or clear the unlock history"));
+}
+
+/**
+ * @brief Parses a number of a command line, decimal or 0x-prefixed hexadecimal, with an optional unit suffix.
+ *
+ * @param text    Word to parse.
+ * @param suffix  Unit allowed after the number (e.g. "ms"), NULL for none.
+ * @param value   Output, receives the number.
+ *
+ * @return true if the whole word is a number.
+ */
+static bool parseConsoleNumber(const char* text, const char* suffix, uint32_t* value) {
+  char* end;
+  *value = strtoul(text, &end, 0);
+  if (end == text) {
+    return false;
+  }
+  return *end == '\0' || (suffix != NULL && strcmp(end, suffix) == 0);
+}
+
+// `read <name>`: an MBA command by name, else an SBS register
+static void runConsoleRead(Console* console, const char* name) {
+  const BQBattery* battery = &console->batteries[console->selected];
+  Cmd id;
+  Sbs reg;
+  selectBattery(battery);
+  if (getMBACommandIdByName(name, &id)) {
+    runMBACommand(battery->address, id);
+  } else if (getSBSRegisterIdByName(name, &reg)) {
+    runSBSRead(battery->address, reg);
+    Log.println();
+  } else {
+    Log.print(F("Unknown command or register: "));
+    Log.println(name);
+  }
+}
+
+// `watch <name>... [<ms>ms]`: the names are checked before anything is changed
+static void runConsoleWatch(Console* console, char** args, uint8_t argc) {
+  if (argc == 2 && strcmp_P(args[1], PSTR("off")) == 0) {
+    console->watching = false;
+    return;
+  }
+
+  uint32_t intervalMs = CONSOLE_WATCH_INTERVAL_MS;
+  uint8_t count = 0;
+  for (uint8_t i = 1; i < argc; i++) {
+    if (parseConsoleNumber(args[i], "ms", &intervalMs)) {
+      continue;
+    }
+    if (count == MONITOR_MAX_COMMANDS || !getMBACommandIdByName(args[i], &console->watchCmds[count])) {
+      Log.print(F("Cannot watch: "));
+      Log.println(args[i]);
+      return;
+    }
+    count++;
+  }
+  if (count == 0) {
+    Log.println(F("Usage: watch <name>... [<ms>ms]"));
+    return;
+  }
+
+  beginMonitor(&console->monitor, &console->batteries[console->selected], console->watchCmds, count,
+               constrain(intervalMs, 1UL, 60000UL));
+  console->watching = true;
+}
+
+// `unlock [all]` and `run <recipe> [all]` (recipe NULL for the unlock): the tasks are then advanced by pollConsole
+static void runConsoleScript(Console* console, const ScriptRecipe* recipe, bool all) {
+  for (uint8_t i = 0; i < console->count; i++) {
+    UnlockTask* task = &console->unlockTasks[i];
+    if (!all && i != console->selected) {
+      task->script.state = SCRIPT_DONE;
+      task->logging = false;
+    } else if (recipe == NULL) {
+      beginUnlockTask(task, &console->batteries[i]);
+    } else {
+      beginScriptTask(&task->script, &console->batteries[i], recipe->script, recipe->title);
+      task->logging = false;
+    }
+  }
+  console->unlocking = true;
+}
+
+// `dump df [start [end]]`, the whole DataFlash by default
+static void runConsoleDump(Console* console, char** args, uint8_t argc) {
+  uint32_t start = DATAFLASH_START;
+  uint32_t end = DATAFLASH_END;
+  if (argc < 2 || strcmp_P(args[1], PSTR("df")) != 0 ||
+      (argc > 2 && !parseConsoleNumber(args[2], NULL, &start)) ||
+      (argc > 3 && !parseConsoleNumber(args[3], NULL, &end)) ||
+      start < DATAFLASH_START || end > DATAFLASH_END || start >= end) {
+    Log.println(F("Usage: dump df [start [end]], between 0x4000 and 0x6000"));
+    return;
+  }
+  const BQBattery* battery = &console->batteries[console->selected];
+  selectBattery(battery);
+  dumpDataFlash(battery->address, start, end);
+}
+
+/**
+ * @brief Splits a complete line into words and runs its command.
+ *
+ * @param console  Console state, `line` holds the NUL-terminated line.
+ */
+static void runConsoleLine(Console* console) {
+  char* args[CONSOLE_MAX_ARGS];
+  uint8_t argc = 0;
+  char* word = strtok(console->line, " \t");
+  while (word != NULL && argc < CONSOLE_MAX_ARGS) {
+    args[argc++] = word;
+    word = strtok(NULL, " \t");
+  }
+  if (argc == 0) {
+    return;
+  }
+
+  const char* name = args[0];
+  if (strcmp_P(name, PSTR("help")) == 0) {
+    printConsoleHelp();
+    return;
+  }
+  if (strcmp_P(name, PSTR("stats")) == 0) {
+    if (argc > 1 && strcmp_P(args[1], PSTR("reset")) == 0) {
+      resetMBAStats();
+    } else {
+      printMBAStats();
+    }
+    return;
+  }
+  if (strcmp_P(name, PSTR("history")) == 0) {
+    if (argc > 1 && strcmp_P(args[1], PSTR("export")) == 0) {
+      exportHistory();
+    } else if (argc > 1 && strcmp_P(args[1], PSTR("clear")) == 0) {
+      clearHistory();
+    } else {
+      printHistory();
+    }
+    return;
+  }
+  if (strcmp_P(name, PSTR("mode")) == 0) {
+    if (argc > 1 && strcmp_P(args[1], PSTR("text")) == 0) {
+      setOutputMode(OUTPUT_MODE_TEXT);
+    } else if (argc > 1 && strcmp_P(args[1], PSTR("binary")) == 0) {
+      setOutputMode(OUTPUT_MODE_BINARY);
+      sendTelemetryCatalog();
+    } else {
+      Log.println(F("Usage: mode text|binary"));
+    }
+    return;
+  }
+
+  // The other commands use the bus, they would break the sequence of a running script
+  if (console->unlocking) {
+    Log.println(F("Busy: script running."));
+    return;
+  }
+  const BQBattery* battery = &console->batteries[console->selected];
+
+  if (strcmp_P(name, PSTR("battery")) == 0 && argc == 2) {
+    for (uint8_t i = 0; i < console->count; i++) {
+      if (strcmp(args[1], console->batteries[i].name) == 0) {
+        console->selected = i;
+        console->watching = false;
+        return;
+      }
+    }
+    Log.print(F("Unknown battery: "));
+    Log.println(args[1]);
+  } else if (strcmp_P(name, PSTR("read")) == 0 && argc == 2) {
+    runConsoleRead(console, args[1]);
+  } else if (strcmp_P(name, PSTR("watch")) == 0 && argc >= 2) {
+    runConsoleWatch(console, args, argc);
+  } else if (strcmp_P(name, PSTR("unlock")) == 0) {
+    runConsoleScript(console, NULL, argc > 1 && strcmp_P(args[1], PSTR("all")) == 0);
+  } else if (strcmp_P(name, PSTR("run")) == 0 && argc >= 2) {
+    ScriptRecipe recipe;
+    if (getScriptRecipeByName(args[1], &recipe)) {
+      runConsoleScript(console, &recipe, argc > 2 && strcmp_P(args[2], PSTR("all")) == 0);
+    } else {
+      Log.print(F("Unknown recipe: "));
+      Log.println(args[1]);
+      printScriptRecipes();
+    }
+  } else if (strcmp_P(name, PSTR("unseal")) == 0) {
+    runOnBatteries(battery, 1, consoleUnsealCommands, sizeof(consoleUnsealCommands) / sizeof(consoleUnsealCommands[0]));
+  } else if (strcmp_P(name, PSTR("dump")) == 0) {
+    runConsoleDump(console, args, argc);
+  } else if (strcmp_P(name, PSTR("lifetime")) == 0) {
+    runLifetimeCapture(battery);
+  } else if (strcmp_P(name, PSTR("clock")) == 0 && argc == 2) {
+    uint32_t clock;
+    if (parseConsoleNumber(args[1], NULL, &clock) && clock >= BQ_CLOCK_MIN && clock <= 1000000) {
+      battery->bus->setClock(clock);
+    } else {
+      Log.print(F("Usage: clock <Hz>, "));
+      Log.print(BQ_CLOCK_MIN);
+      Log.println(F(" to 1000000"));
+    }
+  } else {
+    Log.print(F("Unknown command: "));
+    Log.print(name);
+    Log.println(F(", type help for the list."));
+  }
+}
+
+/**
+ * @brief Reads the pending input and runs a command once its line is complete, without waiting.
+ *
+ * At most CONSOLE_MAX_BYTES_PER_POLL bytes are taken per call, the line is parsed once its
+ * CR or LF is received. Also advances a running script (one transaction per call and battery)
+ * and the watch. Call it from loop().
+ *
+ * @param console  Console state initialized by beginConsole.
+ *
+ * @return true while a script (e.g. the unlock) started from the console is running.
+ */
+bool pollConsole(Console* console) {
+  for (uint8_t i = 0; i < CONSOLE_MAX_BYTES_PER_POLL && console->input->available() > 0; i++) {
+    char c = console->input->read();
+    if (c == '\r' || c == '\n') {
+      if (console->overflow) {
+        Log.println(F("Line too long, ignored."));
+      } else if (console->length > 0) {
+        console->line[console->length] = '\0';
+        runConsoleLine(console);
+      }
+      console->length = 0;
+      console->overflow = false;
+      // One command per call, the next line waits for the next loop()
+      break;
+    }
+    if (c == '\b' || c == 0x7F) {
+      if (console->length > 0) {
+        console->length--;
+      }
+    } else if (console->length < CONSOLE_LINE_SIZE - 1) {
+      console->line[console->length++] = c;
+    } else {
+      console->overflow = true;
+    }
+  }
+
+  if (console->unlocking) {
+    bool running = false;
+    for (uint8_t i = 0; i < console->count; i++) {
+      running |= pollUnlockTask(&console->unlockTasks[i]);
+    }
+    console->unlocking = running;
+  } else if (console->watching) {
+    pollMonitor(&console->monitor);
+  }
+  return console->unlocking;
+}
@@ -0,0 +1,73 @@
+#ifndef CONSOLE_H
+#define CONSOLE_H
+
+#include <Arduino.h>
+#include "bqcmd.h"
+#include "battery.h"
+#include "monitor.h"
+#include "unlock.h"
+
+// Longest command line, longer lines are rejected
+#define CONSOLE_LINE_SIZE 64
+// Words of a command line, command name included
+#define CONSOLE_MAX_ARGS 8
+// Bytes taken from the serial port per pollConsole call, so a pasted script does not delay the bus work
+#define CONSOLE_MAX_BYTES_PER_POLL 16
+// Interval of `watch` when none is given
+#define CONSOLE_WATCH_INTERVAL_MS 50
+
+// State of the serial console (see beginConsole / pollConsole)
+struct Console {
+  Stream* input;
+  const BQBattery* batteries;
+  uint8_t count;
+  uint8_t selected;                      // Battery targeted by read, watch, unseal and dump
+  UnlockTask* unlockTasks;               // One per battery, provided by the caller, also runs `run` scripts
+  bool unlocking;                        // A script is running
+  bool watching;
+  Cmd watchCmds[MONITOR_MAX_COMMANDS];
+  Monitor monitor;
+  char line[CONSOLE_LINE_SIZE];          // Line being received
+  uint8_t length;
+  bool overflow;                         // The line being received is too long, it is dropped
+};
+
+/**
+ * @brief Starts a line-oriented console on a serial port, nothing is read before pollConsole.
+ *
+ * Commands (type `help` for the list):
+ * - `battery <name>`: target another battery of the tray, the first one by default.
+ * - `read <name>`: runs a ManufacturerBlockAccess command or reads an SBS register (e.g. `read PFStatus`).
+ * - `watch <name>... [<ms>ms]`, `watch off`: reports the changes of up to MONITOR_MAX_COMMANDS registers.
+ * - `unlock [all]`: runs the unlock sequence on the battery (or on all of them side by side).
+ * - `run <recipe> [all]`: runs a script of the catalog (see recipes.h), e.g. `run check`.
+ * - `unseal`: sends the unseal keys.
+ * - `dump df [start [end]]`: dumps the DataFlash (it has to be unsealed first).
+ * - `lifetime`: reads the five Lifetime Data blocks in one batch and prints their decoded fields.
+ * - `clock <Hz>`: sets the bus clock of the battery.
+ * - `mode text|binary`: switches the output mode.
+ * - `stats [reset]`: prints (or clears) the instrumentation counters.
+ * - `history [export|clear]`: prints the unlock history, streams it as FRAME_HISTORY frames, or clears it.
+ *
+ * @param console      Console state to initialize.
+ * @param input        Serial port the commands are read from (e.g. Serial).
+ * @param batteries    Batteries of the tray.
+ * @param count        Number of batteries.
+ * @param unlockTasks  Script state of each battery (`count` entries), used by `unlock` and `run`.
+ */
+void beginConsole(Console* console, Stream* input, const BQBattery* batteries, uint8_t count, UnlockTask* unlockTasks);
+
+/**
+ * @brief Reads the pending input and runs a command once its line is complete, without waiting.
+ *
+ * At most CONSOLE_MAX_BYTES_PER_POLL bytes are taken per call, the line is parsed once its
+ * CR or LF is received. Also advances a running script (one transaction per call and battery)
+ * and the watch. Call it from loop().
+ *
+ * @param console  Console state initialized by beginConsole.
+ *
+ * @return true while a script (e.g. the unlock) started from the console is running.
+ */
+bool pollConsole(Console* console);
+
+#endif // CONSOLE_H
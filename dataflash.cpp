@@ -0,0 +1,293 @@
+#include <Arduino.h>
+#include "dataflash.h"
+#include "utility.h"
+#include "telemetry.h"
+#include "logsink.h"
+#include <string.h>  // For memcpy
+
+/**
+ * @brief Reads a chunk of DataFlash into a response, in place.
+ *
+ * Writes the address as a subcommand, then reads the block until it echoes the address.
+ *
+ * @param address    I2C address of the target device.
+ * @param dfAddress  First DataFlash address of the chunk.
+ * @param length     Chunk length, up to DATAFLASH_CHUNK_SIZE.
+ * @param response   Output, holds the chunk at getMBAResponsePayload (see `response->error`).
+ *
+ * @return 0 on success, else a printMBACommandError code (the device must be unsealed).
+ */
+uint8_t readDataFlashChunk(uint8_t address, uint16_t dfAddress, uint8_t length, MBAResponse* response) {
+  beginMBAResponse(response, dfAddress);
+  response->error = writeMBASubcommand(address, dfAddress, NULL, 0, MBA_BUS_TIMEOUT_US);
+  if (response->error != 0) {
+    return response->error;
+  }
+  delayMicroseconds(SMBUS_BUS_FREE_US);
+  if (!readMBASubcommandResponse(address, dfAddress, response)) {
+    return response->error;
+  }
+  // A sealed gauge answers with an empty block
+  if (response->length < length) {
+    response->error = MBA_ERROR_NO_DATA;
+  }
+  return response->error;
+}
+
+/**
+ * @brief Reads any range of DataFlash into a buffer, one chunk per transaction.
+ *
+ * @param address    I2C address of the target device.
+ * @param dfAddress  First DataFlash address.
+ * @param data       Output buffer.
+ * @param length     Number of bytes to read.
+ *
+ * @return 0 on success, else the printMBACommandError code of the failed chunk.
+ */
+uint8_t readDataFlash(uint8_t address, uint16_t dfAddress, uint8_t* data, uint16_t length) {
+  MBAResponse* response = &getMBAArena()->response;
+  for (uint16_t offset = 0; offset < length; offset += DATAFLASH_CHUNK_SIZE) {
+    uint8_t chunkLength = min(length - offset, (uint16_t)DATAFLASH_CHUNK_SIZE);
+    if (offset > 0) {
+      delayMicroseconds(SMBUS_BUS_FREE_US);
+    }
+    uint8_t error = readDataFlashChunk(address, dfAddress + offset, chunkLength, response);
+    if (error != 0) {
+      return error;
+    }
+    memcpy(data + offset, getMBAResponsePayload(response), chunkLength);
+  }
+  return 0;
+}
+
+/**
+ * @brief Prints one chunk of DataFlash as a hex line "0x4000: 01 02 ...".
+ *
+ * @param dfAddress  Address of the first byte.
+ * @param data       Chunk data.
+ * @param length     Chunk length.
+ */
+static void printDataFlashChunk(uint16_t dfAddress, const uint8_t* data, uint8_t length) {
+  Log.print(F("0x"));
+  Log.print(dfAddress, HEX);
+  Log.print(F(":"));
+  for (uint8_t i = 0; i < length; i++) {
+    Log.print(data[i] < 0x10 ? F(" 0") : F(" "));
+    Log.print(data[i], HEX);
+  }
+  Log.println();
+}
+
+/**
+ * @brief Streams a range of DataFlash to the output, chunk by chunk, to back it up.
+ *
+ * Each chunk is printed as one hex line "0x4000: 01 02 ..." (one FRAME_DATAFLASH frame in
+ * OUTPUT_MODE_BINARY) as soon as it is read, straight from the transaction arena, so the image
+ * is never held in SRAM. The dump stops at the first failed chunk.
+ *
+ * @param address  I2C address of the target device.
+ * @param start    First DataFlash address (DATAFLASH_START for the whole image).
+ * @param end      Address after the last one (DATAFLASH_END for the whole image).
+ *
+ * @return true if the whole range was read.
+ */
+bool dumpDataFlash(uint8_t address, uint16_t start, uint16_t end) {
+  MBAResponse* response = &getMBAArena()->response;
+  bool binary = getOutputMode() == OUTPUT_MODE_BINARY;
+  unsigned long startedAt = millis();
+
+  for (uint16_t dfAddress = start; dfAddress < end; dfAddress += DATAFLASH_CHUNK_SIZE) {
+    uint8_t length = min(end - dfAddress, (uint16_t)DATAFLASH_CHUNK_SIZE);
+    uint8_t error = readDataFlashChunk(address, dfAddress, length, response);
+
+    if (binary) {
+      sendTelemetryDataFlash(response, length);
+    } else if (error == 0) {
+      printDataFlashChunk(dfAddress, getMBAResponsePayload(response), length);
+    }
+    if (error != 0) {
+      if (!binary) {
+        Log.print(F("DataFlash read failed at 0x"));
+        Log.println(dfAddress, HEX);
+        printMBACommandError(error);
+      }
+      return false;
+    }
+    // Send the line while the next chunk is read
+    Log.drain();
+  }
+
+  if (!binary) {
+    Log.print(F("DataFlash 0x"));
+    Log.print(start, HEX);
+    Log.print(F("-0x"));
+    Log.print(end - 1, HEX);
+    Log.print(F(": "));
+    Log.print(end - start);
+    Log.print(F(" bytes in "));
+    Log.print(millis() - startedAt);
+    Log.println(F(" ms."));
+  }
+  return true;
+}
+
+// FNV-1a, 32 bits: cheap on the AVR and with a negligible collision rate over a few hundred rows
+#define ROW_HASH_OFFSET 2166136261UL
+#define ROW_HASH_PRIME 16777619UL
+
+/**
+ * @brief Adds bytes to a row hash.
+ *
+ * @param hash      Hash of the previous bytes (ROW_HASH_OFFSET to start).
+ * @param data      Bytes to add, in SRAM or in PROGMEM.
+ * @param length    Number of bytes.
+ * @param progmem   true if `data` points into PROGMEM.
+ *
+ * @return The updated hash.
+ */
+static uint32_t hashRow(uint32_t hash, const uint8_t* data, uint8_t length, bool progmem) {
+  for (uint8_t i = 0; i < length; i++) {
+    hash ^= progmem ? pgm_read_byte(&data[i]) : data[i];
+    hash *= ROW_HASH_PRIME;
+  }
+  return hash;
+}
+
+/**
+ * @brief Reads one row of DataFlash and hashes it, chunk by chunk, without a row buffer.
+ *
+ * @param address    I2C address of the target device.
+ * @param dfAddress  Address of the row.
+ * @param length     Row length.
+ * @param hash       Output, receives the row hash.
+ *
+ * @return 0 on success, else the printMBACommandError code of the failed chunk.
+ */
+static uint8_t readDataFlashRowHash(uint8_t address, uint16_t dfAddress, uint8_t length, uint32_t* hash) {
+  MBAResponse* response = &getMBAArena()->response;
+  *hash = ROW_HASH_OFFSET;
+  for (uint8_t offset = 0; offset < length; offset += DATAFLASH_CHUNK_SIZE) {
+    uint8_t chunkLength = min(length - offset, DATAFLASH_CHUNK_SIZE);
+    uint8_t error = readDataFlashChunk(address, dfAddress + offset, chunkLength, response);
+    if (error != 0) {
+      return error;
+    }
+    *hash = hashRow(*hash, getMBAResponsePayload(response), chunkLength, false);
+    delayMicroseconds(SMBUS_BUS_FREE_US);
+  }
+  return 0;
+}
+
+/**
+ * @brief Writes one row of the image to DataFlash, in MBA_WRITE_DATA_SIZE chunks.
+ *
+ * @param address    I2C address of the target device.
+ * @param dfAddress  Address of the row.
+ * @param row        Row of the image, in PROGMEM.
+ * @param length     Row length.
+ *
+ * @return 0 on success, else the Wire.endTransmission() code of the failed chunk.
+ */
+static uint8_t writeDataFlashRow(uint8_t address, uint16_t dfAddress, const uint8_t* row, uint8_t length) {
+  uint8_t data[MBA_WRITE_DATA_SIZE];
+  for (uint8_t offset = 0; offset < length; offset += MBA_WRITE_DATA_SIZE) {
+    uint8_t chunkLength = min(length - offset, MBA_WRITE_DATA_SIZE);
+    memcpy_P(data, row + offset, chunkLength);
+    // The gauge NACKs while programming, the next transaction is retried until it is done
+    uint8_t error = writeMBASubcommand(address, dfAddress + offset, data, chunkLength, DATAFLASH_WRITE_TIMEOUT_US);
+    if (error != 0) {
+      return error;
+    }
+    delayMicroseconds(SMBUS_BUS_FREE_US);
+  }
+  return 0;
+}
+
+/**
+ * @brief Writes back only the DataFlash rows that differ from a target image.
+ *
+ * Every DATAFLASH_ROW_SIZE row is read from the gauge and hashed on the fly, straight from the
+ * transaction arena, then compared with the hash of the same row of the image. Only the rows
+ * whose hashes differ are written (in MBA_WRITE_DATA_SIZE chunks) and read back to verify them.
+ * Fewer writes make a re-provisioning pass faster and spare the gauge flash.
+ *
+ * @param address  I2C address of the target device (unsealed).
+ * @param start    DataFlash address of the first byte of the image.
+ * @param image    Target image, in PROGMEM.
+ * @param length   Image length in bytes, the last row may be shorter.
+ * @param write    false to only report the rows that differ.
+ * @param result   Output, receives the row counters.
+ *
+ * @return true if every row matches the image at the end (dry run: already matched).
+ */
+bool syncDataFlash(uint8_t address, uint16_t start, const uint8_t* image, uint16_t length, bool write,
+                   DataFlashSyncResult* result) {
+  result->rows = 0;
+  result->changed = 0;
+  result->failed = 0;
+  unsigned long startedAt = millis();
+
+  // An unfilled profile would overwrite the start of the DataFlash with nothing but zeros
+  if (length == 0) {
+    if (getOutputMode() != OUTPUT_MODE_BINARY) {
+      Log.println(F("DataFlash image empty, nothing synced."));
+    }
+    return false;
+  }
+
+  for (uint16_t offset = 0; offset < length; offset += DATAFLASH_ROW_SIZE) {
+    uint16_t dfAddress = start + offset;
+    const uint8_t* row = image + offset;
+    uint8_t rowLength = min(length - offset, (uint16_t)DATAFLASH_ROW_SIZE);
+    uint32_t expected = hashRow(ROW_HASH_OFFSET, row, rowLength, true);
+    result->rows++;
+
+    uint32_t hash;
+    uint8_t error = readDataFlashRowHash(address, dfAddress, rowLength, &hash);
+    if (error == 0 && hash == expected) {
+      continue;
+    }
+
+    if (error == 0) {
+      result->changed++;
+      if (write) {
+        error = writeDataFlashRow(address, dfAddress, row, rowLength);
+      }
+      // Read the row back, the flash may have refused the write (sealed gauge, protected area)
+      if (write && error == 0) {
+        error = readDataFlashRowHash(address, dfAddress, rowLength, &hash);
+        if (error == 0 && hash != expected) {
+          error = MBA_ERROR_VERIFY;
+        }
+      }
+    }
+
+    if (getOutputMode() != OUTPUT_MODE_BINARY) {
+      Log.print(F("Row 0x"));
+      Log.print(dfAddress, HEX);
+      if (error != 0) {
+        Log.print(F(": failed, "));
+        printMBACommandError(error);
+      } else {
+        Log.println(write ? F(": written") : F(": differs"));
+      }
+    }
+    if (error != 0) {
+      result->failed++;
+    }
+    Log.drain();
+  }
+
+  if (getOutputMode() != OUTPUT_MODE_BINARY) {
+    Log.print(F("DataFlash sync: "));
+    Log.print(result->changed);
+    Log.print(F("/"));
+    Log.print(result->rows);
+    Log.print(write ? F(" row(s) written, ") : F(" row(s) differ, "));
+    Log.print(result->failed);
+    Log.print(F(" failed, in "));
+    Log.print(millis() - startedAt);
+    Log.println(F(" ms."));
+  }
+  return result->failed == 0 && (write || result->changed == 0);
+}
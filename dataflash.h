@@ -0,0 +1,86 @@
+#ifndef DATAFLASH_H
+#define DATAFLASH_H
+
+#include <Arduino.h>
+#include "bqcmd.h"
+
+// DataFlash of the bq40z50, addressed with ManufacturerBlockAccess subcommands 0x4000-0x5FFF
+#define DATAFLASH_START 0x4000
+#define DATAFLASH_END 0x6000  // Exclusive
+// Bytes read per transaction: the gauge answers 32 bytes from the address, the Wire buffer keeps this many
+#define DATAFLASH_CHUNK_SIZE MBA_RESPONSE_PAYLOAD_SIZE
+// Unit compared and written back by syncDataFlash
+#define DATAFLASH_ROW_SIZE 32
+// Deadline of one DataFlash write transaction, the gauge stretches the clock while programming
+#define DATAFLASH_WRITE_TIMEOUT_US 50000
+
+// Outcome of syncDataFlash
+struct DataFlashSyncResult {
+  uint16_t rows;     // Rows compared
+  uint16_t changed;  // Rows that differed from the image
+  uint16_t failed;   // Rows that could not be read, written or verified
+};
+
+/**
+ * @brief Reads a chunk of DataFlash into a response, in place.
+ *
+ * Writes the address as a subcommand, then reads the block until it echoes the address.
+ *
+ * @param address    I2C address of the target device.
+ * @param dfAddress  First DataFlash address of the chunk.
+ * @param length     Chunk length, up to DATAFLASH_CHUNK_SIZE.
+ * @param response   Output, holds the chunk at getMBAResponsePayload (see `response->error`).
+ *
+ * @return 0 on success, else a printMBACommandError code (the device must be unsealed).
+ */
+uint8_t readDataFlashChunk(uint8_t address, uint16_t dfAddress, uint8_t length, MBAResponse* response);
+
+/**
+ * @brief Reads any range of DataFlash into a buffer, one chunk per transaction.
+ *
+ * @param address    I2C address of the target device.
+ * @param dfAddress  First DataFlash address.
+ * @param data       Output buffer.
+ * @param length     Number of bytes to read.
+ *
+ * @return 0 on success, else the printMBACommandError code of the failed chunk.
+ */
+uint8_t readDataFlash(uint8_t address, uint16_t dfAddress, uint8_t* data, uint16_t length);
+
+/**
+ * @brief Streams a range of DataFlash to the output, chunk by chunk, to back it up.
+ *
+ * Each chunk is printed as one hex line "0x4000: 01 02 ..." (one FRAME_DATAFLASH frame in
+ * OUTPUT_MODE_BINARY) as soon as it is read, straight from the transaction arena, so the image
+ * is never held in SRAM. The dump stops at the first failed chunk.
+ *
+ * @param address  I2C address of the target device.
+ * @param start    First DataFlash address (DATAFLASH_START for the whole image).
+ * @param end      Address after the last one (DATAFLASH_END for the whole image).
+ *
+ * @return true if the whole range was read.
+ */
+bool dumpDataFlash(uint8_t address, uint16_t start, uint16_t end);
+
+/**
+ * @brief Writes back only the DataFlash rows that differ from a target image.
+ *
+ * Every DATAFLASH_ROW_SIZE row is read from the gauge and hashed on the fly, straight from the
+ * transaction arena, then compared with the hash of the same row of the image. Only the rows
+ * whose hashes differ are written (in MBA_WRITE_DATA_SIZE chunks) and read back to verify them.
+ * Fewer writes make a re-provisioning pass faster and spare the gauge flash.
+ *
+ * @param address  I2C address of the target device (unsealed).
+ * @param start    DataFlash address of the first byte of the image.
+ * @param image    Target image, in PROGMEM.
+ * @param length   Image length in bytes, the last row may be shorter.
+ * @param write    false to only report the rows that differ.
+ * @param result   Output, receives the row counters.
+ *
+ * @return true if every row matches the image at the end (dry run: already matched),
+ *         false for an empty image, which is never synced.
+ */
+bool syncDataFlash(uint8_t address, uint16_t start, const uint8_t* image, uint16_t length, bool write,
+                   DataFlashSyncResult* result);
+
+#endif // DATAFLASH_H
@@ -0,0 +1,40 @@
+#include <Arduino.h>
+#include "deadline.h"
+
+static unsigned long deadlineStartedAt = 0;
+static uint16_t deadlineUs = 0;
+static bool deadlineArmed = false;
+
+/**
+ * @brief Arms the deadline of one bus transaction.
+ *
+ * The deadline is checked against micros() between the calls of a transaction, it does not
+ * interrupt a call in progress: only the bus timeout (Wire.setWireTimeout, see BQBus::setTimeout)
+ * bounds how long a single call blocks. A single deadline exists at a time, arming it again
+ * restarts it.
+ *
+ * @param timeoutUs  Delay from now, in microseconds.
+ */
+void startBusDeadline(uint16_t timeoutUs) {
+  deadlineStartedAt = micros();
+  deadlineUs = timeoutUs;
+  deadlineArmed = true;
+}
+
+/**
+ * @brief Returns whether the deadline armed by startBusDeadline has passed.
+ */
+bool isBusDeadlineExpired() {
+  return deadlineArmed && micros() - deadlineStartedAt >= deadlineUs;
+}
+
+/**
+ * @brief Disarms the deadline armed by startBusDeadline.
+ *
+ * @return true if it had passed.
+ */
+bool stopBusDeadline() {
+  bool expired = isBusDeadlineExpired();
+  deadlineArmed = false;
+  return expired;
+}
@@ -0,0 +1,30 @@
+#ifndef DEADLINE_H
+#define DEADLINE_H
+
+#include <Arduino.h>
+
+/**
+ * @brief Arms the deadline of one bus transaction.
+ *
+ * The deadline is checked against micros() between the calls of a transaction, it does not
+ * interrupt a call in progress: only the bus timeout (Wire.setWireTimeout, see BQBus::setTimeout)
+ * bounds how long a single call blocks. A single deadline exists at a time, arming it again
+ * restarts it.
+ *
+ * @param timeoutUs  Delay from now, in microseconds.
+ */
+void startBusDeadline(uint16_t timeoutUs);
+
+/**
+ * @brief Returns whether the deadline armed by startBusDeadline has passed.
+ */
+bool isBusDeadlineExpired();
+
+/**
+ * @brief Disarms the deadline armed by startBusDeadline.
+ *
+ * @return true if it had passed.
+ */
+bool stopBusDeadline();
+
+#endif
@@ -0,0 +1,260 @@
+#include <Arduino.h>
+#include "esp32bus.h"
+
+#if ESP32_BUS_AVAILABLE
+
+/**
+ * @brief Creates the master bus on the port, with the transfers run from its interrupt.
+ */
+void Esp32Bus::begin() {
+  if (bus != NULL) {
+    return;
+  }
+  i2c_master_bus_config_t config = {};
+  config.i2c_port = port;
+  config.sda_io_num = (gpio_num_t)sdaPin;
+  config.scl_io_num = (gpio_num_t)sclPin;
+  config.clk_source = I2C_CLK_SRC_DEFAULT;
+  config.glitch_ignore_cnt = 7;
+  // A queue makes every transfer function of the driver return at once (asynchronous mode)
+  config.trans_queue_depth = ESP32_BUS_QUEUE_DEPTH;
+  config.flags.enable_internal_pullup = true;
+  if (i2c_new_master_bus(&config, &bus) != ESP_OK) {
+    bus = NULL;
+  }
+}
+
+/**
+ * @brief Sets the clock, applied from the next transaction.
+ *
+ * @param clock  Rate in Hz.
+ */
+void Esp32Bus::setClock(uint32_t clock) {
+  this->clock = clock;
+  // The driver keeps the rate per device, the next transaction adds it again
+  if (device != NULL) {
+    i2c_master_bus_rm_device(device);
+    device = NULL;
+    deviceAddress = -1;
+  }
+}
+
+/**
+ * @brief Makes `device` the one at `address`, with the completion callback registered.
+ *
+ * @param address  I2C address of the target device.
+ *
+ * @return false if the bus could not be created or the device not added.
+ */
+bool Esp32Bus::selectDevice(uint8_t address) {
+  if (bus == NULL) {
+    return false;
+  }
+  if (device != NULL && deviceAddress == address) {
+    return true;
+  }
+  if (device != NULL) {
+    i2c_master_bus_rm_device(device);
+    device = NULL;
+    deviceAddress = -1;
+  }
+
+  i2c_device_config_t config = {};
+  config.dev_addr_length = I2C_ADDR_BIT_LEN_7;
+  config.device_address = address;
+  config.scl_speed_hz = clock;
+  if (i2c_master_bus_add_device(bus, &config, &device) != ESP_OK) {
+    device = NULL;
+    return false;
+  }
+  i2c_master_event_callbacks_t callbacks = {};
+  callbacks.on_trans_done = onTransferDone;
+  if (i2c_master_register_event_callbacks(device, &callbacks, this) != ESP_OK) {
+    i2c_master_bus_rm_device(device);
+    device = NULL;
+    return false;
+  }
+  deviceAddress = address;
+  return true;
+}
+
+/**
+ * @brief Completion callback of the driver, runs in its interrupt.
+ *
+ * @return false, no task is woken.
+ */
+bool IRAM_ATTR Esp32Bus::onTransferDone(i2c_master_dev_handle_t device, const i2c_master_event_data_t* event, void* arg) {
+  Esp32Bus* self = (Esp32Bus*)arg;
+  switch (event->event) {
+    case I2C_EVENT_DONE:
+      self->transferResult = 0;
+      break;
+    case I2C_EVENT_NACK:
+      self->transferResult = 2;
+      break;
+    case I2C_EVENT_TIMEOUT:
+      self->transferResult = 5;
+      break;
+    default:
+      // Still running
+      break;
+  }
+  return false;
+}
+
+/**
+ * @brief Waits for the queued transfer to complete.
+ *
+ * @return The endTransmission() code of the transfer, 5 if it did not complete in time.
+ */
+uint8_t Esp32Bus::waitTransfer() {
+  if (i2c_master_bus_wait_all_done(bus, timeoutMs) != ESP_OK && transferResult == BQ_REQUEST_PENDING) {
+    return 5;
+  }
+  return transferResult;
+}
+
+void Esp32Bus::beginTransmission(uint8_t address) {
+  this->address = address;
+  txLength = 0;
+  txPending = false;
+}
+
+size_t Esp32Bus::write(uint8_t data) {
+  if (txLength >= BQ_BUS_BUFFER_SIZE) {
+    return 0;
+  }
+  tx[txLength++] = data;
+  return 1;
+}
+
+/**
+ * @brief Sends the bytes written since beginTransmission and waits for the transfer.
+ *
+ * @param stop  false to keep the bytes for the read of the next requestFrom.
+ *
+ * @return The Wire.endTransmission() code, 4 if the driver refused the transfer.
+ */
+uint8_t Esp32Bus::endTransmission(bool stop) {
+  if (!stop) {
+    txPending = true;
+    return 0;
+  }
+  if (bus == NULL) {
+    return 4;
+  }
+  // Address only (probe): the driver has no zero-length write
+  if (txLength == 0) {
+    esp_err_t error = i2c_master_probe(bus, address, timeoutMs);
+    return error == ESP_OK ? 0 : error == ESP_ERR_NOT_FOUND ? 2 : error == ESP_ERR_TIMEOUT ? 5 : 4;
+  }
+  if (!selectDevice(address)) {
+    return 4;
+  }
+  transferResult = BQ_REQUEST_PENDING;
+  if (i2c_master_transmit(device, tx, txLength, timeoutMs) != ESP_OK) {
+    return 4;
+  }
+  return waitTransfer();
+}
+
+/**
+ * @brief Reads from a device, after the bytes kept by endTransmission(false) if any.
+ *
+ * @param address   I2C address of the target device.
+ * @param quantity  Number of bytes to read, up to BQ_BUS_BUFFER_SIZE.
+ *
+ * @return Number of bytes read, 0 if the write or the read failed.
+ */
+uint8_t Esp32Bus::requestFrom(uint8_t address, uint8_t quantity) {
+  quantity = min(quantity, (uint8_t)BQ_BUS_BUFFER_SIZE);
+  rxLength = 0;
+  rxPosition = 0;
+  bool repeatedStart = txPending && this->address == address;
+  txPending = false;
+  if (quantity == 0 || !selectDevice(address)) {
+    return 0;
+  }
+
+  transferResult = BQ_REQUEST_PENDING;
+  esp_err_t error = repeatedStart
+    ? i2c_master_transmit_receive(device, tx, txLength, rx, quantity, timeoutMs)
+    : i2c_master_receive(device, rx, quantity, timeoutMs);
+  if (error != ESP_OK || waitTransfer() != 0) {
+    return 0;
+  }
+  rxLength = quantity;
+  return quantity;
+}
+
+/**
+ * @brief Queues the command write and the repeated-start read, returns before they are done.
+ *
+ * @param address   I2C address of the target device.
+ * @param command   Command byte written first.
+ * @param quantity  Number of bytes to read, up to BQ_BUS_BUFFER_SIZE.
+ */
+void Esp32Bus::startRequest(uint8_t address, uint8_t command, uint8_t quantity) {
+  rxLength = 0;
+  rxPosition = 0;
+  txPending = false;
+  if (!selectDevice(address)) {
+    transferResult = 4;
+    return;
+  }
+  tx[0] = command;
+  txLength = 1;
+  rxRequested = min(quantity, (uint8_t)BQ_BUS_BUFFER_SIZE);
+  // Set before queueing, the callback may run before the driver returns
+  transferResult = BQ_REQUEST_PENDING;
+  if (i2c_master_transmit_receive(device, tx, txLength, rx, rxRequested, timeoutMs) != ESP_OK) {
+    transferResult = 4;
+  }
+}
+
+/**
+ * @brief Returns the state of the request queued by startRequest.
+ *
+ * @return BQ_REQUEST_PENDING while it runs, then 0 with the block available, or the error code
+ *         (2 NACK, 4 refused by the driver, 5 timeout).
+ */
+uint8_t Esp32Bus::pollRequest() {
+  uint8_t result = transferResult;
+  if (result == 0) {
+    rxLength = rxRequested;
+  }
+  return result;
+}
+
+/**
+ * @brief Bounds how long the driver may take to complete a transfer.
+ *
+ * @param timeoutUs  Timeout in microseconds, rounded up to the millisecond of the driver.
+ */
+void Esp32Bus::setTimeout(uint16_t timeoutUs) {
+  timeoutMs = max(1, (timeoutUs + 999) / 1000);
+}
+
+/**
+ * @brief Deletes the master bus, frees the lines and creates the bus again.
+ *
+ * @return true if the bus is free and running afterwards.
+ */
+bool Esp32Bus::recover() {
+  if (bus != NULL) {
+    if (device != NULL) {
+      i2c_master_bus_rm_device(device);
+      device = NULL;
+      deviceAddress = -1;
+    }
+    i2c_del_master_bus(bus);
+    bus = NULL;
+  }
+  bool freed = recoverI2CBus(sdaPin, sclPin);
+  txPending = false;
+  transferResult = 0;
+  begin();
+  return freed && bus != NULL;
+}
+
+#endif // ESP32_BUS_AVAILABLE
@@ -0,0 +1,83 @@
+#ifndef ESP32BUS_H
+#define ESP32BUS_H
+
+#include <Arduino.h>
+#include "bqbus.h"
+
+// The ESP-IDF I2C master driver (IDF 5.2 and later, Arduino-ESP32 3.x) runs queued transfers by itself
+#if defined(ESP32) && __has_include(<driver/i2c_master.h>)
+#define ESP32_BUS_AVAILABLE 1
+#include <driver/i2c_master.h>
+#else
+#define ESP32_BUS_AVAILABLE 0
+#endif
+
+#if ESP32_BUS_AVAILABLE
+
+// Transfers the driver queues, one request runs at a time per bus
+#define ESP32_BUS_QUEUE_DEPTH 1
+// Transfer timeout until setTimeout is called, in ms
+#define ESP32_BUS_DEFAULT_TIMEOUT_MS 50
+
+/**
+ * @brief BQBus on an ESP32 I2C controller driven by the ESP-IDF asynchronous master driver.
+ *
+ * The controller runs a whole startRequest transfer (command write, repeated start, block read)
+ * from its interrupt, so pollRequest returns at once while the block is on the wires and the CPU
+ * polls the other batteries meanwhile. The controller is owned by this bus: give it a port Wire
+ * does not use (Wire takes I2C_NUM_0 when it is begun).
+ *
+ * Example usage:
+ * @code
+ * Esp32Bus batteryBusA(I2C_NUM_1, 25, 26);  // port, SDA, SCL
+ * { "A", &batteryBusA, BQ_ADDR },
+ * @endcode
+ *
+ * As on the ESP32 Wire, endTransmission(false) only keeps the written bytes: they go out with
+ * the read of the next requestFrom, which reports a failed write by returning 0.
+ */
+class Esp32Bus : public BQBus {
+public:
+  Esp32Bus(i2c_port_num_t port, int8_t sdaPin, int8_t sclPin)
+    : port(port), sdaPin(sdaPin), sclPin(sclPin) {}
+
+  void begin() override;
+  void setClock(uint32_t clock) override;
+  void beginTransmission(uint8_t address) override;
+  size_t write(uint8_t data) override;
+  uint8_t endTransmission(bool stop = true) override;
+  uint8_t requestFrom(uint8_t address, uint8_t quantity) override;
+  int available() override { return rxLength - rxPosition; }
+  int read() override { return rxPosition < rxLength ? rx[rxPosition++] : -1; }
+  bool recover() override;
+  void setTimeout(uint16_t timeoutUs) override;
+  void startRequest(uint8_t address, uint8_t command, uint8_t quantity) override;
+  uint8_t pollRequest() override;
+
+private:
+  bool selectDevice(uint8_t address);
+  uint8_t waitTransfer();
+  static bool onTransferDone(i2c_master_dev_handle_t device, const i2c_master_event_data_t* event, void* arg);
+
+  i2c_port_num_t port;
+  int8_t sdaPin;
+  int8_t sclPin;
+  uint32_t clock = 100000;
+  int timeoutMs = ESP32_BUS_DEFAULT_TIMEOUT_MS;
+  i2c_master_bus_handle_t bus = NULL;
+  i2c_master_dev_handle_t device = NULL;
+  int16_t deviceAddress = -1;  // Address of `device`, -1 if none was added
+  uint8_t address = 0;         // Target of the transaction being written
+  uint8_t tx[BQ_BUS_BUFFER_SIZE];
+  uint8_t txLength = 0;
+  bool txPending = false;      // Bytes kept by endTransmission(false) for the next read
+  uint8_t rx[BQ_BUS_BUFFER_SIZE];
+  uint8_t rxLength = 0;
+  uint8_t rxPosition = 0;
+  uint8_t rxRequested = 0;     // Length of the read being transferred
+  volatile uint8_t transferResult = 0;  // endTransmission() code of the last transfer, BQ_REQUEST_PENDING while it runs
+};
+
+#endif // ESP32_BUS_AVAILABLE
+
+#endif // ESP32BUS_H
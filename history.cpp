@@ -0,0 +1,441 @@
+#include <Arduino.h>
+#include <EEPROM.h>
+#include "history.h"
+#include "telemetry.h"
+#include "utility.h"
+#include "logsink.h"
+
+static const Cmd historyWordCommands[HISTORY_WORDS] = HISTORY_WORD_COMMANDS;
+
+static bool historyEnabled = false;
+static bool historyEmpty = true;
+// Newest block, its sequence number and the offset of its end marker (where the next record goes)
+static uint8_t headBlock = HISTORY_BLOCK_COUNT - 1;
+static uint8_t headSequence = 0;
+static uint8_t headOffset = HISTORY_BLOCK_SIZE;
+// Session of this boot, its record is written with the first attempt only
+static uint16_t session = 0;
+static bool sessionLogged = false;
+
+static int historyBlockAddress(uint8_t block) {
+  return HISTORY_EEPROM_START + block * HISTORY_BLOCK_SIZE;
+}
+
+// The emulated EEPROM only has write(), which leaves an unchanged cell alone like update()
+static void writeHistoryByte(int address, uint8_t value) {
+#if HISTORY_EEPROM_EMULATED
+  EEPROM.write(address, value);
+#else
+  EEPROM.update(address, value);
+#endif
+}
+
+// Writes the RAM copy of an emulated EEPROM back to flash, nothing to do on a real one
+static void commitHistory() {
+#if HISTORY_EEPROM_EMULATED
+  EEPROM.commit();
+#endif
+}
+
+static uint8_t readHistorySequence(uint8_t block) {
+  return EEPROM.read(historyBlockAddress(block));
+}
+
+static bool isNextHistorySequence(uint8_t sequence, uint8_t next) {
+  return sequence != HISTORY_EMPTY && next == (sequence + 1) % HISTORY_SEQUENCE_MODULO;
+}
+
+/**
+ * @brief Reads the record at an offset of a block.
+ *
+ * @param block   Block index.
+ * @param offset  Offset of the record in the block.
+ * @param record  Output, receives the record (HISTORY_MAX_RECORD bytes).
+ *
+ * @return Record length, 0 at the end of the block (end marker, or a record that does not fit).
+ */
+static uint8_t readHistoryRecord(uint8_t block, uint8_t offset, uint8_t* record) {
+  int address = historyBlockAddress(block) + offset;
+  if (offset + 2 > HISTORY_BLOCK_SIZE || EEPROM.read(address) == HISTORY_EMPTY) {
+    return 0;
+  }
+  uint8_t length = 2 + EEPROM.read(address + 1);
+  if (length > HISTORY_MAX_RECORD || offset + length > HISTORY_BLOCK_SIZE) {
+    return 0;
+  }
+  for (uint8_t i = 0; i < length; i++) {
+    record[i] = EEPROM.read(address + i);
+  }
+  return length;
+}
+
+/**
+ * @brief Visits every record, oldest first.
+ *
+ * @param visit  Called with each record and its length.
+ */
+static void walkHistory(void (*visit)(const uint8_t* record, uint8_t length)) {
+  if (historyEmpty) {
+    return;
+  }
+  // Back from the newest block while the sequence numbers follow each other
+  uint8_t oldest = headBlock;
+  for (uint8_t i = 1; i < HISTORY_BLOCK_COUNT; i++) {
+    uint8_t previous = (oldest + HISTORY_BLOCK_COUNT - 1) % HISTORY_BLOCK_COUNT;
+    if (!isNextHistorySequence(readHistorySequence(previous), readHistorySequence(oldest))) {
+      break;
+    }
+    oldest = previous;
+  }
+
+  uint8_t record[HISTORY_MAX_RECORD];
+  for (uint8_t block = oldest; ; block = (block + 1) % HISTORY_BLOCK_COUNT) {
+    uint8_t offset = 1;
+    uint8_t length;
+    while ((length = readHistoryRecord(block, offset, record)) != 0) {
+      visit(record, length);
+      offset += length;
+    }
+    if (block == headBlock) {
+      break;
+    }
+  }
+}
+
+static uint8_t putHistoryVarint(uint8_t* buffer, uint8_t length, uint32_t value) {
+  while (value >= 0x80) {
+    buffer[length++] = (value & 0x7F) | 0x80;
+    value >>= 7;
+  }
+  buffer[length++] = value;
+  return length;
+}
+
+static uint32_t getHistoryVarint(const uint8_t* buffer, uint8_t* position, uint8_t length) {
+  uint32_t value = 0;
+  for (uint8_t shift = 0; *position < length && shift < 32; shift += 7) {
+    uint8_t b = buffer[(*position)++];
+    value |= (uint32_t)(b & 0x7F) << shift;
+    if ((b & 0x80) == 0) {
+      break;
+    }
+  }
+  return value;
+}
+
+static void findLastHistorySession(const uint8_t* record, uint8_t length) {
+  if (record[0] == HISTORY_RECORD_SESSION) {
+    uint8_t position = 2;
+    session = getHistoryVarint(record, &position, length);
+  }
+}
+
+/**
+ * @brief Enables the history log and finds where it ends, the EEPROM is only read.
+ *
+ * The block following the newest one (by sequence number) is the oldest, so no pointer has
+ * to be stored and every cell is written about once per turn of the ring. On the ESP32 and
+ * RP2040 this also loads the emulated EEPROM (EEPROM.begin), every record is committed to flash.
+ *
+ * @param enabled  true to record the unlock attempts, false to leave the EEPROM alone.
+ */
+void beginHistory(bool enabled) {
+  historyEnabled = enabled;
+  sessionLogged = false;
+  if (!enabled) {
+    return;
+  }
+#if HISTORY_EEPROM_EMULATED
+  static bool eepromLoaded = false;
+  if (!eepromLoaded) {
+    EEPROM.begin(HISTORY_EEPROM_START + HISTORY_EEPROM_SIZE);
+    eepromLoaded = true;
+  }
+#endif
+
+  // The newest block is the used one not followed by its successor
+  historyEmpty = true;
+  for (uint8_t block = 0; block < HISTORY_BLOCK_COUNT && historyEmpty; block++) {
+    uint8_t sequence = readHistorySequence(block);
+    if (sequence != HISTORY_EMPTY &&
+        !isNextHistorySequence(sequence, readHistorySequence((block + 1) % HISTORY_BLOCK_COUNT))) {
+      historyEmpty = false;
+      headBlock = block;
+      headSequence = sequence;
+    }
+  }
+  if (!historyEmpty) {
+    uint8_t record[HISTORY_MAX_RECORD];
+    uint8_t length;
+    headOffset = 1;
+    while ((length = readHistoryRecord(headBlock, headOffset, record)) != 0) {
+      headOffset += length;
+    }
+  }
+
+  session = 0;
+  walkHistory(findLastHistorySession);
+  session++;
+}
+
+/**
+ * @brief Returns whether the unlock attempts are recorded.
+ */
+bool isHistoryEnabled() {
+  return historyEnabled;
+}
+
+/**
+ * @brief Appends a record to the newest block, or to the next one (the oldest) if it does not fit.
+ *
+ * The type byte is written last, over the previous end marker, so a record cut by a power loss
+ * is never read back.
+ *
+ * @param record  Record, starting with its type and length bytes.
+ * @param length  Record length.
+ */
+static void writeHistoryRecord(const uint8_t* record, uint8_t length) {
+  if (historyEmpty || headOffset + length > HISTORY_BLOCK_SIZE) {
+    headBlock = (headBlock + 1) % HISTORY_BLOCK_COUNT;
+    headSequence = historyEmpty ? 0 : (headSequence + 1) % HISTORY_SEQUENCE_MODULO;
+    headOffset = 1;
+    // End marker first: the records left from the previous turn are dropped with the sequence number
+    writeHistoryByte(historyBlockAddress(headBlock) + 1, HISTORY_EMPTY);
+    writeHistoryByte(historyBlockAddress(headBlock), headSequence);
+    historyEmpty = false;
+  }
+
+  int address = historyBlockAddress(headBlock) + headOffset;
+  for (uint8_t i = 1; i < length; i++) {
+    writeHistoryByte(address + i, record[i]);
+  }
+  if (headOffset + length < HISTORY_BLOCK_SIZE) {
+    writeHistoryByte(address + length, HISTORY_EMPTY);
+  }
+  writeHistoryByte(address, record[0]);
+  headOffset += length;
+  commitHistory();
+}
+
+/**
+ * @brief Prepares the read of the serial number, the cycle count and the status words of a battery.
+ *
+ * Nothing is sent before the first pollHistorySnapshot.
+ *
+ * @param read      Read state to initialize.
+ * @param battery   Battery to read.
+ * @param snapshot  Output, `valid` tells once done whether every register was read.
+ */
+void beginHistorySnapshot(HistoryRead* read, const BQBattery* battery, HistorySnapshot* snapshot) {
+  read->snapshot = snapshot;
+  read->battery = battery;
+  read->item = 0;
+  read->state = HISTORY_READ_ISSUE;
+  snapshot->valid = true;
+}
+
+// Stores the status word in `response` (0 if it failed) and moves to the next register
+static void finishHistoryWord(HistoryRead* read) {
+  bool failed = read->response.error != 0;
+  read->snapshot->words[read->item] = failed ? 0 : getMBAResponseValue(&read->response);
+  read->snapshot->valid &= !failed;
+  read->item++;
+  read->state = HISTORY_READ_ISSUE;
+}
+
+/**
+ * @brief Advances the read of a snapshot by at most one bus transaction, without blocking.
+ *
+ * The status words are sent and polled like the script steps (see pollMBAWait), the SBS
+ * registers take one transaction each.
+ *
+ * @param read  Read state initialized by beginHistorySnapshot.
+ *
+ * @return true while registers are left to read, false once the snapshot is done.
+ */
+bool pollHistorySnapshot(HistoryRead* read) {
+  if (read->item >= HISTORY_SNAPSHOT_ITEMS) {
+    return false;
+  }
+  selectBattery(read->battery);
+  HistorySnapshot* snapshot = read->snapshot;
+  uint8_t address = read->battery->address;
+
+  if (read->item >= HISTORY_WORDS) {
+    bool serial = read->item == HISTORY_WORDS;
+    uint16_t* value = serial ? &snapshot->serialNumber : &snapshot->cycleCount;
+    snapshot->valid &= readSBSWord(address, serial ? Sbs::SerialNumber : Sbs::CycleCount, value) == 0;
+    read->item++;
+    return read->item < HISTORY_SNAPSHOT_ITEMS;
+  }
+
+  const MBACommandInfo* cmdInfo = getMBACommandInfo(historyWordCommands[read->item]);
+  MBAWaitStatus status;
+  switch (read->state) {
+    case HISTORY_READ_ISSUE:
+      beginMBAResponse(&read->response, cmdInfo);
+      read->response.error = issueMBACommand(address, cmdInfo);
+      if (read->response.error != 0) {
+        finishHistoryWord(read);
+      } else {
+        beginMBAWait(&read->wait, address, cmdInfo);
+        read->state = HISTORY_READ_WAIT;
+      }
+      break;
+
+    case HISTORY_READ_WAIT:
+      status = pollMBAWait(&read->wait);
+      if (status == MBA_WAIT_TIMEOUT) {
+        read->response.error = MBA_ERROR_COMPLETION_TIMEOUT;
+        finishHistoryWord(read);
+      } else if (status == MBA_WAIT_DONE) {
+        // Completed, the response read gets its own timeout
+        beginMBAWait(&read->wait, address, cmdInfo);
+        read->state = HISTORY_READ_BLOCK;
+      }
+      break;
+
+    case HISTORY_READ_BLOCK:
+      if (pollMBAResponse(&read->wait, &read->response) != MBA_WAIT_PENDING) {
+        finishHistoryWord(read);
+      }
+      break;
+  }
+  return true;
+}
+
+/**
+ * @brief Appends an unlock attempt to the log, preceded by the session record on the first one of a boot.
+ *
+ * Body of HISTORY_RECORD_UNLOCK, varints are unsigned LEB128:
+ * - time of the attempt, in ms since the boot of the session (varint),
+ * - serial number, cycle count (varints), result byte (see HISTORY_RESULT_*),
+ * - mask of the non-zero status words before, followed by these words (varints),
+ * - mask of the words that changed, followed by their XOR with the value before (varints).
+ * A clean pack that stayed clean thus takes a few bytes only.
+ *
+ * @param before    State read before the unlock, the attempt is not logged if it is not valid.
+ * @param after     State read after the unlock.
+ * @param failures  Failed steps of the unlock.
+ * @param stopped   true if the unlock was stopped before its end.
+ *
+ * @return true if the attempt was written.
+ */
+bool logHistoryUnlock(const HistorySnapshot* before, const HistorySnapshot* after, uint8_t failures, bool stopped) {
+  if (!historyEnabled || !before->valid) {
+    return false;
+  }
+  uint8_t record[HISTORY_MAX_RECORD];
+  uint8_t length;
+
+  if (!sessionLogged) {
+    record[0] = HISTORY_RECORD_SESSION;
+    length = putHistoryVarint(record, 2, session);
+    record[1] = length - 2;
+    writeHistoryRecord(record, length);
+    sessionLogged = true;
+  }
+
+  record[0] = HISTORY_RECORD_UNLOCK;
+  length = putHistoryVarint(record, 2, millis());
+  length = putHistoryVarint(record, length, before->serialNumber);
+  length = putHistoryVarint(record, length, before->cycleCount);
+  record[length++] = min(failures, (uint8_t)HISTORY_RESULT_FAILURES) |
+                     (after->valid ? 0 : HISTORY_RESULT_AFTER_UNREAD) | (stopped ? HISTORY_RESULT_STOPPED : 0);
+
+  uint8_t maskAt = length++;
+  record[maskAt] = 0;
+  for (uint8_t i = 0; i < HISTORY_WORDS; i++) {
+    if (before->words[i] != 0) {
+      record[maskAt] |= 1 << i;
+      length = putHistoryVarint(record, length, before->words[i]);
+    }
+  }
+  maskAt = length++;
+  record[maskAt] = 0;
+  for (uint8_t i = 0; i < HISTORY_WORDS && after->valid; i++) {
+    uint32_t changed = before->words[i] ^ after->words[i];
+    if (changed != 0) {
+      record[maskAt] |= 1 << i;
+      length = putHistoryVarint(record, length, changed);
+    }
+  }
+
+  record[1] = length - 2;
+  writeHistoryRecord(record, length);
+  return true;
+}
+
+static void printHistoryRecord(const uint8_t* record, uint8_t length) {
+  uint8_t position = 2;
+  if (record[0] == HISTORY_RECORD_SESSION) {
+    Log.print(F("Session "));
+    Log.println(getHistoryVarint(record, &position, length));
+    return;
+  }
+  if (record[0] != HISTORY_RECORD_UNLOCK) {
+    return;
+  }
+
+  Log.print(F("Unlock at "));
+  Log.print(getHistoryVarint(record, &position, length));
+  Log.print(F(" ms, serial "));
+  Log.print(getHistoryVarint(record, &position, length));
+  Log.print(F(", "));
+  Log.print(getHistoryVarint(record, &position, length));
+  Log.print(F(" cycles, "));
+  uint8_t result = position < length ? record[position++] : 0;
+  Log.print(result & HISTORY_RESULT_FAILURES);
+  Log.print(F(" failed step(s)"));
+  if (result & HISTORY_RESULT_STOPPED) {
+    Log.print(F(", stopped"));
+  }
+  if (result & HISTORY_RESULT_AFTER_UNREAD) {
+    Log.print(F(", state after not read"));
+  }
+  Log.println();
+
+  uint32_t words[HISTORY_WORDS];
+  uint8_t present = position < length ? record[position++] : 0;
+  for (uint8_t i = 0; i < HISTORY_WORDS; i++) {
+    words[i] = present & (1 << i) ? getHistoryVarint(record, &position, length) : 0;
+  }
+  uint8_t changed = position < length ? record[position++] : 0;
+  for (uint8_t i = 0; i < HISTORY_WORDS; i++) {
+    uint32_t after = words[i] ^ (changed & (1 << i) ? getHistoryVarint(record, &position, length) : 0);
+    if ((present | changed) & (1 << i)) {
+      printBitFieldChanges(getMBACommandInfo(historyWordCommands[i]), words[i], after);
+    }
+  }
+}
+
+/**
+ * @brief Prints the log, oldest record first: the sessions, and for each attempt its pack and the bits that changed.
+ */
+void printHistory() {
+  if (historyEmpty) {
+    Log.println(F("History is empty."));
+    return;
+  }
+  walkHistory(printHistoryRecord);
+}
+
+/**
+ * @brief Streams the log to the host, oldest record first, one FRAME_HISTORY frame per record.
+ */
+void exportHistory() {
+  walkHistory(sendTelemetryHistory);
+}
+
+/**
+ * @brief Empties the log, only the block sequence numbers are erased.
+ */
+void clearHistory() {
+  for (uint8_t block = 0; block < HISTORY_BLOCK_COUNT; block++) {
+    writeHistoryByte(historyBlockAddress(block), HISTORY_EMPTY);
+  }
+  commitHistory();
+  // The next records go on after the current block, so that the ring keeps turning
+  historyEmpty = true;
+  sessionLogged = false;
+}
@@ -0,0 +1,149 @@
+#ifndef HISTORY_H
+#define HISTORY_H
+
+#include <Arduino.h>
+#include "bqcmd.h"
+#include "battery.h"
+
+// The ESP32 and RP2040 emulate the EEPROM in flash: a RAM copy reserved by EEPROM.begin(), written back by EEPROM.commit()
+#if defined(ESP32) || defined(ARDUINO_ARCH_RP2040)
+#define HISTORY_EEPROM_EMULATED 1
+#else
+#define HISTORY_EEPROM_EMULATED 0
+#endif
+
+// EEPROM area of the log, the whole EEPROM of the board by default (4 KB on the Mega)
+#define HISTORY_EEPROM_START 0
+#if defined(E2END)
+#define HISTORY_EEPROM_SIZE (E2END + 1)
+#else
+#define HISTORY_EEPROM_SIZE 4096
+#endif
+// The area is a ring of blocks, each starting with its sequence number, a record never spans two blocks
+#define HISTORY_BLOCK_SIZE 128
+#define HISTORY_BLOCK_COUNT (HISTORY_EEPROM_SIZE / HISTORY_BLOCK_SIZE)
+// Erased EEPROM byte: sequence number of an unused block, type ending the records of a block
+#define HISTORY_EMPTY 0xFF
+// Block sequence numbers count from 0 to HISTORY_SEQUENCE_MODULO - 1 (0xFF is HISTORY_EMPTY)
+#define HISTORY_SEQUENCE_MODULO 0xFF
+static_assert(HISTORY_BLOCK_COUNT >= 2 && HISTORY_BLOCK_COUNT < HISTORY_SEQUENCE_MODULO, "HISTORY_EEPROM_SIZE must hold 2 to 254 blocks");
+
+// Status words of a snapshot, in record order
+#define HISTORY_WORDS 4
+#define HISTORY_WORD_COMMANDS { Cmd::OperationStatus, Cmd::SafetyStatus, Cmd::PFStatus, Cmd::ManufacturingStatus }
+
+// Longest record: type, length, time, serial number, cycle count, result, then two masks with their words (varints)
+#define HISTORY_MAX_RECORD (2 + 5 + 3 + 3 + 1 + 2 * (1 + HISTORY_WORDS * 5))
+
+// First byte of a record, followed by the body length and the body
+enum HistoryRecordType : uint8_t {
+  HISTORY_RECORD_SESSION = 0x01,  // body: session number (varint), written before the first attempt of a boot
+  HISTORY_RECORD_UNLOCK = 0x02,   // body: see logHistoryUnlock
+};
+
+// Bits of the result byte of HISTORY_RECORD_UNLOCK, the low bits are the failed steps
+#define HISTORY_RESULT_FAILURES 0x3F
+#define HISTORY_RESULT_AFTER_UNREAD 0x40  // The state after the unlock could not be read
+#define HISTORY_RESULT_STOPPED 0x80       // The script was stopped (SCRIPT_STOP)
+
+// State of a pack at one point of time (see beginHistorySnapshot)
+struct HistorySnapshot {
+  bool valid;                     // All the registers were read
+  uint16_t serialNumber;
+  uint16_t cycleCount;
+  uint32_t words[HISTORY_WORDS];  // See HISTORY_WORD_COMMANDS
+};
+
+// Registers of a snapshot: the status words, then the serial number and the cycle count
+#define HISTORY_SNAPSHOT_ITEMS (HISTORY_WORDS + 2)
+
+enum HistoryReadState : uint8_t {
+  HISTORY_READ_ISSUE,  // Next register to be sent
+  HISTORY_READ_WAIT,   // Completion of the status word command polled
+  HISTORY_READ_BLOCK,  // Response of the status word command polled
+};
+
+// State of the read of one snapshot (see beginHistorySnapshot / pollHistorySnapshot)
+struct HistoryRead {
+  HistorySnapshot* snapshot;
+  const BQBattery* battery;
+  uint8_t item;  // Register being read, HISTORY_SNAPSHOT_ITEMS once done
+  HistoryReadState state;
+  MBAWait wait;
+  MBAResponse response;
+};
+
+/**
+ * @brief Enables the history log and finds where it ends, the EEPROM is only read.
+ *
+ * The block following the newest one (by sequence number) is the oldest, so no pointer has
+ * to be stored and every cell is written about once per turn of the ring. On the ESP32 and
+ * RP2040 this also loads the emulated EEPROM (EEPROM.begin), every record is committed to flash.
+ *
+ * @param enabled  true to record the unlock attempts, false to leave the EEPROM alone.
+ */
+void beginHistory(bool enabled);
+
+/**
+ * @brief Returns whether the unlock attempts are recorded.
+ */
+bool isHistoryEnabled();
+
+/**
+ * @brief Prepares the read of the serial number, the cycle count and the status words of a battery.
+ *
+ * Nothing is sent before the first pollHistorySnapshot.
+ *
+ * @param read      Read state to initialize.
+ * @param battery   Battery to read.
+ * @param snapshot  Output, `valid` tells once done whether every register was read.
+ */
+void beginHistorySnapshot(HistoryRead* read, const BQBattery* battery, HistorySnapshot* snapshot);
+
+/**
+ * @brief Advances the read of a snapshot by at most one bus transaction, without blocking.
+ *
+ * The status words are sent and polled like the script steps (see pollMBAWait), the SBS
+ * registers take one transaction each.
+ *
+ * @param read  Read state initialized by beginHistorySnapshot.
+ *
+ * @return true while registers are left to read, false once the snapshot is done.
+ */
+bool pollHistorySnapshot(HistoryRead* read);
+
+/**
+ * @brief Appends an unlock attempt to the log, preceded by the session record on the first one of a boot.
+ *
+ * Body of HISTORY_RECORD_UNLOCK, varints are unsigned LEB128:
+ * - time of the attempt, in ms since the boot of the session (varint),
+ * - serial number, cycle count (varints), result byte (see HISTORY_RESULT_*),
+ * - mask of the non-zero status words before, followed by these words (varints),
+ * - mask of the words that changed, followed by their XOR with the value before (varints).
+ * A clean pack that stayed clean thus takes a few bytes only.
+ *
+ * @param before    State read before the unlock, the attempt is not logged if it is not valid.
+ * @param after     State read after the unlock.
+ * @param failures  Failed steps of the unlock.
+ * @param stopped   true if the unlock was stopped before its end.
+ *
+ * @return true if the attempt was written.
+ */
+bool logHistoryUnlock(const HistorySnapshot* before, const HistorySnapshot* after, uint8_t failures, bool stopped);
+
+/**
+ * @brief Prints the log, oldest record first: the sessions, and for each attempt its pack and the bits that changed.
+ */
+void printHistory();
+
+/**
+ * @brief Streams the log to the host, oldest record first, one FRAME_HISTORY frame per record.
+ */
+void exportHistory();
+
+/**
+ * @brief Empties the log, only the block sequence numbers are erased.
+ */
+void clearHistory();
+
+#endif // HISTORY_H
@@ -0,0 +1,22 @@
+// Host build: the 4 KB EEPROM of the Mega, kept in memory for the run
+#ifndef HOST_EEPROM_H
+#define HOST_EEPROM_H
+
+#include <stdint.h>
+#include <string.h>
+
+class EEPROMClass {
+public:
+  EEPROMClass() { memset(cells, 0xFF, sizeof(cells)); }
+  uint8_t read(int address) { return cells[address]; }
+  void write(int address, uint8_t value) { cells[address] = value; }
+  void update(int address, uint8_t value) { cells[address] = value; }
+  uint16_t length() { return sizeof(cells); }
+
+private:
+  uint8_t cells[4096];
+};
+
+extern EEPROMClass EEPROM;
+
+#endif // HOST_EEPROM_H
@@ -0,0 +1,26 @@
+// Host build: a TwoWire with nothing on the bus, every address is NACKed (see SimulatedGauge for a device)
+#ifndef HOST_WIRE_H
+#define HOST_WIRE_H
+
+#include "Arduino.h"
+
+#define WIRE_HAS_TIMEOUT 1
+
+class TwoWire : public Stream {
+public:
+  void begin() {}
+  void end() {}
+  void setClock(uint32_t clock) {}
+  void setWireTimeout(uint32_t timeoutUs = 25000, bool reset = false) {}
+  void beginTransmission(uint8_t address) {}
+  size_t write(uint8_t data) override { return 1; }
+  using Print::write;
+  uint8_t endTransmission(bool stop = true) { return 2; }
+  uint8_t requestFrom(uint8_t address, uint8_t quantity) { return 0; }
+  int available() override { return 0; }
+  int read() override { return -1; }
+};
+
+extern TwoWire Wire;
+
+#endif // HOST_WIRE_H
@@ -0,0 +1,79 @@
+// Host build: time, pins, Serial, Wire and EEPROM of the Arduino core, on POSIX
+#include <time.h>
+#include "Arduino.h"
+#include "Wire.h"
+#include "EEPROM.h"
+
+HardwareSerial Serial;
+TwoWire Wire;
+EEPROMClass EEPROM;
+
+static uint64_t monotonicUs() {
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return (uint64_t)now.tv_sec * 1000000 + now.tv_nsec / 1000;
+}
+
+static const uint64_t startedAtUs = monotonicUs();
+
+// Both wrap around at 32 bits like on the board
+unsigned long micros() { return (uint32_t)(monotonicUs() - startedAtUs); }
+unsigned long millis() { return (uint32_t)((monotonicUs() - startedAtUs) / 1000); }
+
+// Busy-wait: sleeping would make the short waits of the sources much longer than asked
+void delayMicroseconds(unsigned int us) {
+  uint64_t until = monotonicUs() + us;
+  while (monotonicUs() < until) {
+  }
+}
+
+void delay(unsigned long ms) {
+  struct timespec duration = { (time_t)(ms / 1000), (long)(ms % 1000) * 1000000 };
+  nanosleep(&duration, NULL);
+}
+
+// No pins: lines read high, as a free bus
+void pinMode(uint8_t pin, uint8_t mode) {}
+void digitalWrite(uint8_t pin, uint8_t value) {}
+int digitalRead(uint8_t pin) { return HIGH; }
+
+size_t Print::write(const uint8_t* buffer, size_t size) {
+  size_t written = 0;
+  while (size--) {
+    written += write(*buffer++);
+  }
+  return written;
+}
+
+size_t Print::print(unsigned long n, int base) {
+  char text[8 * sizeof(n) + 1];
+  char* p = &text[sizeof(text) - 1];
+  *p = '\0';
+  do {
+    uint8_t digit = n % base;
+    *--p = digit < 10 ? '0' + digit : 'A' + digit - 10;
+    n /= base;
+  } while (n != 0);
+  return write(p);
+}
+
+size_t Print::print(long n, int base) {
+  if (base == DEC && n < 0) {
+    return write((uint8_t)'-') + print((unsigned long)-n, base);
+  }
+  return print((unsigned long)n, base);
+}
+
+size_t Print::print(double n, int digits) {
+  char text[32];
+  snprintf(text, sizeof(text), "%.*f", digits, n);
+  return write(text);
+}
+
+size_t HardwareSerial::write(uint8_t c) {
+  return fputc(c, stdout) == EOF ? 0 : 1;
+}
+
+void HardwareSerial::flush() {
+  fflush(stdout);
+}
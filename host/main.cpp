@@ -0,0 +1,36 @@
+// Host benchmark: runs bench.cpp against a SimulatedGauge, with the sources of the sketch unchanged
+//
+// Usage: bench [rounds [latencyMs [nackPeriod [clockHz]]]]
+#include <Arduino.h>
+#include "bqcmd.h"
+#include "simgauge.h"
+#include "bench.h"
+#include "telemetry.h"
+#include "logsink.h"
+
+#define BENCH_ADDR 0x0B
+
+// Read commands of one round, the battery state printed by the sketch
+static const Cmd benchCommands[] = {
+  Cmd::OperationStatus, Cmd::ManufacturingStatus, Cmd::PFStatus,
+  Cmd::SafetyStatus, Cmd::SafetyAlert, Cmd::PFAlert,
+};
+#define BENCH_COMMANDS_COUNT (sizeof(benchCommands) / sizeof(benchCommands[0]))
+
+int main(int argc, char** argv) {
+  uint8_t rounds = argc > 1 ? atoi(argv[1]) : 10;
+  uint8_t latencyMs = argc > 2 ? atoi(argv[2]) : SIM_GAUGE_LATENCY_MS;
+  uint8_t nackPeriod = argc > 3 ? atoi(argv[3]) : 0;
+  uint32_t clock = argc > 4 ? atol(argv[4]) : 400000;
+
+  static SimulatedGauge gauge(BENCH_ADDR);
+  static const BQBattery simulated = { "SIM", &gauge, BENCH_ADDR };
+  gauge.setClock(clock);
+  gauge.setLatency(latencyMs, 0);
+  gauge.setNackPeriod(nackPeriod);
+
+  setOutputMode(OUTPUT_MODE_TEXT);
+  runBenchmark(&simulated, benchCommands, BENCH_COMMANDS_COUNT, rounds, true);
+  Log.flush();
+  return 0;
+}
@@ -0,0 +1,243 @@
+#include <Arduino.h>
+#include <stddef.h>
+#include "lifetime.h"
+#include "telemetry.h"
+#include "utility.h"
+#include "logsink.h"
+
+static const Cmd lifetimeCommands[LIFETIME_BLOCKS] = {
+  Cmd::LifetimeDataBlock1,
+  Cmd::LifetimeDataBlock2,
+  Cmd::LifetimeDataBlock3,
+  Cmd::LifetimeDataBlock4,
+  Cmd::LifetimeDataBlock5,
+};
+
+#define LIFETIME_FIELD(block, offset, type, unit, member, name) \
+  { Cmd::block, offset, type, unit, offsetof(LifetimeData, member), name }
+
+// Layout of the Lifetime Data blocks (data from bq40z50-R2 Technical Reference), in block order.
+// Blocks 1 and 4 hold 32 bytes: their last fields are beyond a single read and stay invalid.
+static const LifetimeFieldInfo LifetimeFieldsInfo[] PROGMEM = {
+    // LifetimeDataBlock1
+    LIFETIME_FIELD(LifetimeDataBlock1, 0, FIELD_U2, LIFETIME_UNIT_MILLIVOLT, cellMaxVoltage[0], "Cell1MaxVoltage"),
+    LIFETIME_FIELD(LifetimeDataBlock1, 2, FIELD_U2, LIFETIME_UNIT_MILLIVOLT, cellMaxVoltage[1], "Cell2MaxVoltage"),
+    LIFETIME_FIELD(LifetimeDataBlock1, 4, FIELD_U2, LIFETIME_UNIT_MILLIVOLT, cellMaxVoltage[2], "Cell3MaxVoltage"),
+    LIFETIME_FIELD(LifetimeDataBlock1, 6, FIELD_U2, LIFETIME_UNIT_MILLIVOLT, cellMaxVoltage[3], "Cell4MaxVoltage"),
+    LIFETIME_FIELD(LifetimeDataBlock1, 8, FIELD_U2, LIFETIME_UNIT_MILLIVOLT, cellMinVoltage[0], "Cell1MinVoltage"),
+    LIFETIME_FIELD(LifetimeDataBlock1, 10, FIELD_U2, LIFETIME_UNIT_MILLIVOLT, cellMinVoltage[1], "Cell2MinVoltage"),
+    LIFETIME_FIELD(LifetimeDataBlock1, 12, FIELD_U2, LIFETIME_UNIT_MILLIVOLT, cellMinVoltage[2], "Cell3MinVoltage"),
+    LIFETIME_FIELD(LifetimeDataBlock1, 14, FIELD_U2, LIFETIME_UNIT_MILLIVOLT, cellMinVoltage[3], "Cell4MinVoltage"),
+    LIFETIME_FIELD(LifetimeDataBlock1, 16, FIELD_U2, LIFETIME_UNIT_MILLIVOLT, maxDeltaCellVoltage, "MaxDeltaCellVoltage"),
+    LIFETIME_FIELD(LifetimeDataBlock1, 18, FIELD_I2, LIFETIME_UNIT_MILLIAMP, maxChargeCurrent, "MaxChargeCurrent"),
+    LIFETIME_FIELD(LifetimeDataBlock1, 20, FIELD_I2, LIFETIME_UNIT_MILLIAMP, maxDischargeCurrent, "MaxDischargeCurrent"),
+    LIFETIME_FIELD(LifetimeDataBlock1, 22, FIELD_I2, LIFETIME_UNIT_MILLIAMP, maxAvgDischargeCurrent, "MaxAvgDsgCurrent"),
+    LIFETIME_FIELD(LifetimeDataBlock1, 24, FIELD_I2, LIFETIME_UNIT_CENTIWATT, maxAvgDischargePower, "MaxAvgDsgPower"),
+    LIFETIME_FIELD(LifetimeDataBlock1, 26, FIELD_I1, LIFETIME_UNIT_CELSIUS, maxTempCell, "MaxTempCell"),
+    LIFETIME_FIELD(LifetimeDataBlock1, 27, FIELD_I1, LIFETIME_UNIT_CELSIUS, minTempCell, "MinTempCell"),
+    LIFETIME_FIELD(LifetimeDataBlock1, 28, FIELD_I1, LIFETIME_UNIT_CELSIUS, maxDeltaCellTemp, "MaxDeltaCellTemp"),
+    LIFETIME_FIELD(LifetimeDataBlock1, 29, FIELD_I1, LIFETIME_UNIT_CELSIUS, maxTempIntSensor, "MaxTempIntSensor"),
+    LIFETIME_FIELD(LifetimeDataBlock1, 30, FIELD_I1, LIFETIME_UNIT_CELSIUS, minTempIntSensor, "MinTempIntSensor"),
+    LIFETIME_FIELD(LifetimeDataBlock1, 31, FIELD_I1, LIFETIME_UNIT_CELSIUS, maxTempFet, "MaxTempFet"),
+    // LifetimeDataBlock2
+    LIFETIME_FIELD(LifetimeDataBlock2, 0, FIELD_U1, LIFETIME_UNIT_NONE, shutdowns, "NoOfShutdowns"),
+    LIFETIME_FIELD(LifetimeDataBlock2, 1, FIELD_U1, LIFETIME_UNIT_NONE, partialResets, "NoOfPartialResets"),
+    LIFETIME_FIELD(LifetimeDataBlock2, 2, FIELD_U1, LIFETIME_UNIT_NONE, fullResets, "NoOfFullResets"),
+    LIFETIME_FIELD(LifetimeDataBlock2, 3, FIELD_U1, LIFETIME_UNIT_NONE, watchdogResets, "NoOfWDTResets"),
+    LIFETIME_FIELD(LifetimeDataBlock2, 4, FIELD_U1, LIFETIME_UNIT_HOURS, cellBalancingTime[0], "CBTimeCell1"),
+    LIFETIME_FIELD(LifetimeDataBlock2, 5, FIELD_U1, LIFETIME_UNIT_HOURS, cellBalancingTime[1], "CBTimeCell2"),
+    LIFETIME_FIELD(LifetimeDataBlock2, 6, FIELD_U1, LIFETIME_UNIT_HOURS, cellBalancingTime[2], "CBTimeCell3"),
+    LIFETIME_FIELD(LifetimeDataBlock2, 7, FIELD_U1, LIFETIME_UNIT_HOURS, cellBalancingTime[3], "CBTimeCell4"),
+    // LifetimeDataBlock3
+    LIFETIME_FIELD(LifetimeDataBlock3, 0, FIELD_U2, LIFETIME_UNIT_HOURS, firmwareRuntime, "TotalFwRuntime"),
+    LIFETIME_FIELD(LifetimeDataBlock3, 2, FIELD_U2, LIFETIME_UNIT_HOURS, timeSpent[0], "TimeSpentInUT"),
+    LIFETIME_FIELD(LifetimeDataBlock3, 4, FIELD_U2, LIFETIME_UNIT_HOURS, timeSpent[1], "TimeSpentInLT"),
+    LIFETIME_FIELD(LifetimeDataBlock3, 6, FIELD_U2, LIFETIME_UNIT_HOURS, timeSpent[2], "TimeSpentInSTL"),
+    LIFETIME_FIELD(LifetimeDataBlock3, 8, FIELD_U2, LIFETIME_UNIT_HOURS, timeSpent[3], "TimeSpentInRT"),
+    LIFETIME_FIELD(LifetimeDataBlock3, 10, FIELD_U2, LIFETIME_UNIT_HOURS, timeSpent[4], "TimeSpentInSTH"),
+    LIFETIME_FIELD(LifetimeDataBlock3, 12, FIELD_U2, LIFETIME_UNIT_HOURS, timeSpent[5], "TimeSpentInHT"),
+    LIFETIME_FIELD(LifetimeDataBlock3, 14, FIELD_U2, LIFETIME_UNIT_HOURS, timeSpent[6], "TimeSpentInOT"),
+    // LifetimeDataBlock4
+    LIFETIME_FIELD(LifetimeDataBlock4, 0, FIELD_U2, LIFETIME_UNIT_NONE, cov.count, "NoOfCOVEvents"),
+    LIFETIME_FIELD(LifetimeDataBlock4, 2, FIELD_U2, LIFETIME_UNIT_CYCLE, cov.lastCycle, "LastCOVEvent"),
+    LIFETIME_FIELD(LifetimeDataBlock4, 4, FIELD_U2, LIFETIME_UNIT_NONE, cuv.count, "NoOfCUVEvents"),
+    LIFETIME_FIELD(LifetimeDataBlock4, 6, FIELD_U2, LIFETIME_UNIT_CYCLE, cuv.lastCycle, "LastCUVEvent"),
+    LIFETIME_FIELD(LifetimeDataBlock4, 8, FIELD_U2, LIFETIME_UNIT_NONE, ocd1.count, "NoOfOCD1Events"),
+    LIFETIME_FIELD(LifetimeDataBlock4, 10, FIELD_U2, LIFETIME_UNIT_CYCLE, ocd1.lastCycle, "LastOCD1Event"),
+    LIFETIME_FIELD(LifetimeDataBlock4, 12, FIELD_U2, LIFETIME_UNIT_NONE, ocd2.count, "NoOfOCD2Events"),
+    LIFETIME_FIELD(LifetimeDataBlock4, 14, FIELD_U2, LIFETIME_UNIT_CYCLE, ocd2.lastCycle, "LastOCD2Event"),
+    LIFETIME_FIELD(LifetimeDataBlock4, 16, FIELD_U2, LIFETIME_UNIT_NONE, occ1.count, "NoOfOCC1Events"),
+    LIFETIME_FIELD(LifetimeDataBlock4, 18, FIELD_U2, LIFETIME_UNIT_CYCLE, occ1.lastCycle, "LastOCC1Event"),
+    LIFETIME_FIELD(LifetimeDataBlock4, 20, FIELD_U2, LIFETIME_UNIT_NONE, occ2.count, "NoOfOCC2Events"),
+    LIFETIME_FIELD(LifetimeDataBlock4, 22, FIELD_U2, LIFETIME_UNIT_CYCLE, occ2.lastCycle, "LastOCC2Event"),
+    LIFETIME_FIELD(LifetimeDataBlock4, 24, FIELD_U2, LIFETIME_UNIT_NONE, aold.count, "NoOfAOLDEvents"),
+    LIFETIME_FIELD(LifetimeDataBlock4, 26, FIELD_U2, LIFETIME_UNIT_CYCLE, aold.lastCycle, "LastAOLDEvent"),
+    LIFETIME_FIELD(LifetimeDataBlock4, 28, FIELD_U2, LIFETIME_UNIT_NONE, ascd.count, "NoOfASCDEvents"),
+    LIFETIME_FIELD(LifetimeDataBlock4, 30, FIELD_U2, LIFETIME_UNIT_CYCLE, ascd.lastCycle, "LastASCDEvent"),
+    // LifetimeDataBlock5
+    LIFETIME_FIELD(LifetimeDataBlock5, 0, FIELD_U2, LIFETIME_UNIT_NONE, ascc.count, "NoOfASCCEvents"),
+    LIFETIME_FIELD(LifetimeDataBlock5, 2, FIELD_U2, LIFETIME_UNIT_CYCLE, ascc.lastCycle, "LastASCCEvent"),
+    LIFETIME_FIELD(LifetimeDataBlock5, 4, FIELD_U2, LIFETIME_UNIT_NONE, otc.count, "NoOfOTCEvents"),
+    LIFETIME_FIELD(LifetimeDataBlock5, 6, FIELD_U2, LIFETIME_UNIT_CYCLE, otc.lastCycle, "LastOTCEvent"),
+    LIFETIME_FIELD(LifetimeDataBlock5, 8, FIELD_U2, LIFETIME_UNIT_NONE, otd.count, "NoOfOTDEvents"),
+    LIFETIME_FIELD(LifetimeDataBlock5, 10, FIELD_U2, LIFETIME_UNIT_CYCLE, otd.lastCycle, "LastOTDEvent"),
+    LIFETIME_FIELD(LifetimeDataBlock5, 12, FIELD_U2, LIFETIME_UNIT_NONE, otf.count, "NoOfOTFEvents"),
+    LIFETIME_FIELD(LifetimeDataBlock5, 14, FIELD_U2, LIFETIME_UNIT_CYCLE, otf.lastCycle, "LastOTFEvent"),
+    LIFETIME_FIELD(LifetimeDataBlock5, 16, FIELD_U2, LIFETIME_UNIT_NONE, validChargeTermination.count, "NoValidChargeTerm"),
+    LIFETIME_FIELD(LifetimeDataBlock5, 18, FIELD_U2, LIFETIME_UNIT_CYCLE, validChargeTermination.lastCycle, "LastValidChargeTerm"),
+};
+
+static_assert(sizeof(LifetimeFieldsInfo) / sizeof(LifetimeFieldsInfo[0]) == LIFETIME_FIELD_COUNT,
+              "LIFETIME_FIELD_COUNT must match LifetimeFieldsInfo");
+
+/**
+ * @brief Returns a field of the Lifetime Data layout.
+ *
+ * @param index  Field index, below LIFETIME_FIELD_COUNT.
+ *
+ * @return A pointer to its LifetimeFieldInfo (points into PROGMEM).
+ */
+const LifetimeFieldInfo* getLifetimeFieldInfo(uint8_t index) {
+  return &LifetimeFieldsInfo[index];
+}
+
+static uint8_t getLifetimeFieldSize(LifetimeFieldType type) {
+  return type == FIELD_U2 || type == FIELD_I2 ? 2 : 1;
+}
+
+/**
+ * @brief Fills LifetimeData from the results of the LIFETIME_BLOCKS block reads, following LifetimeFieldsInfo.
+ *
+ * Fields of a failed block, or beyond the end of a truncated one (a block holds up to 32 bytes,
+ * one read up to MBA_RESPONSE_PAYLOAD_SIZE), are left to 0 and not marked valid.
+ *
+ * @param slots  Results of LifetimeDataBlock1 to LifetimeDataBlock5, in this order.
+ * @param data   Output, receives the fields.
+ */
+void decodeLifetimeData(const MBABatchSlot* slots, LifetimeData* data) {
+  memset(data, 0, sizeof(LifetimeData));
+  for (uint8_t i = 0; i < LIFETIME_FIELD_COUNT; i++) {
+    const LifetimeFieldInfo* field = &LifetimeFieldsInfo[i];
+    const MBAResponse* response = &slots[static_cast<uint8_t>(getLifetimeFieldBlock(field)) -
+                                         static_cast<uint8_t>(Cmd::LifetimeDataBlock1)].response;
+    uint8_t offset = getLifetimeFieldOffset(field);
+    uint8_t size = getLifetimeFieldSize(getLifetimeFieldType(field));
+    if (response->error != 0 || offset + size > response->length) {
+      continue;
+    }
+    // Both are little-endian, signed fields keep their sign in a field of the same width
+    memcpy((uint8_t*)data + pgm_read_byte(&field->dataOffset), getMBAResponsePayload(response) + offset, size);
+    data->valid[i / 8] |= 1 << (i % 8);
+  }
+}
+
+/**
+ * @brief Reads the five Lifetime Data blocks of a battery in one batch, into the shared arena.
+ *
+ * @param battery  Battery to read.
+ * @param data     Output, receives the decoded fields (NULL to only fill the arena).
+ *
+ * @return Number of blocks read.
+ */
+uint8_t readLifetimeData(const BQBattery* battery, LifetimeData* data) {
+  selectBattery(battery);
+  MBABatchSlot* slots = getMBAArena();
+  uint8_t succeeded = runMBABatch(battery->address, lifetimeCommands, LIFETIME_BLOCKS, slots);
+  if (data != NULL) {
+    decodeLifetimeData(slots, data);
+  }
+  return succeeded;
+}
+
+static int16_t getLifetimeFieldValue(const LifetimeData* data, const LifetimeFieldInfo* field) {
+  const uint8_t* value = (const uint8_t*)data + pgm_read_byte(&field->dataOffset);
+  switch (getLifetimeFieldType(field)) {
+    case FIELD_U1: return *value;
+    case FIELD_I1: return *(const int8_t*)value;
+    default: return *(const int16_t*)value;
+  }
+}
+
+/**
+ * @brief Prints the valid fields with their unit, block by block.
+ *
+ * @param data  Decoded data.
+ */
+void printLifetimeData(const LifetimeData* data) {
+  Cmd block = Cmd::Count;
+  uint8_t missing = 0;
+  for (uint8_t i = 0; i < LIFETIME_FIELD_COUNT; i++) {
+    const LifetimeFieldInfo* field = &LifetimeFieldsInfo[i];
+    if (getLifetimeFieldBlock(field) != block) {
+      block = getLifetimeFieldBlock(field);
+      Log.print(getMBACommandName(getMBACommandInfo(block)));
+      Log.println(F(":"));
+    }
+    if (!isLifetimeFieldValid(data, i)) {
+      missing++;
+      continue;
+    }
+
+    int16_t value = getLifetimeFieldValue(data, field);
+    Log.print(F("  "));
+    Log.print(getLifetimeFieldName(field));
+    Log.print(F(": "));
+    LifetimeUnit unit = getLifetimeFieldUnit(field);
+    if (unit == LIFETIME_UNIT_CYCLE) {
+      Log.print(F("cycle "));
+    }
+    // Unsigned fields of 2 bytes may exceed int16_t
+    if (getLifetimeFieldType(field) == FIELD_U2) {
+      Log.print((uint16_t)value);
+    } else {
+      Log.print(value);
+    }
+    switch (unit) {
+      case LIFETIME_UNIT_MILLIVOLT: Log.println(F(" mV")); break;
+      case LIFETIME_UNIT_MILLIAMP: Log.println(F(" mA")); break;
+      case LIFETIME_UNIT_CENTIWATT: Log.println(F(" cW")); break;
+      case LIFETIME_UNIT_CELSIUS: Log.println(F(" C")); break;
+      case LIFETIME_UNIT_HOURS: Log.println(F(" h")); break;
+      default: Log.println(); break;
+    }
+  }
+  if (missing > 0) {
+    Log.print(missing);
+    Log.println(F(" field(s) not read (failed block, or beyond the bytes of one read)."));
+  }
+}
+
+/**
+ * @brief Captures the Lifetime Data of a battery before anything wipes it (e.g. LifetimeDataReset).
+ *
+ * In OUTPUT_MODE_BINARY the five raw blocks are sent as FRAME_RESPONSE frames, the host decodes
+ * them with the FRAME_LIFETIME_FIELD frames of the catalog; otherwise the decoded fields are printed.
+ * Some firmwares only answer once unsealed.
+ *
+ * @param battery  Battery to read.
+ *
+ * @return Number of blocks read.
+ */
+uint8_t runLifetimeCapture(const BQBattery* battery) {
+  if (getOutputMode() == OUTPUT_MODE_BINARY) {
+    uint8_t succeeded = readLifetimeData(battery, NULL);
+    printBatteryName(battery);
+    printMBABatch(getMBAArena(), LIFETIME_BLOCKS);
+    return succeeded;
+  }
+
+  LifetimeData data;
+  uint8_t succeeded = readLifetimeData(battery, &data);
+  printBatteryName(battery);
+  if (succeeded < LIFETIME_BLOCKS) {
+    // The errors, the decoded fields only cover the blocks read
+    MBABatchSlot* slots = getMBAArena();
+    for (uint8_t i = 0; i < LIFETIME_BLOCKS; i++) {
+      if (slots[i].response.error != 0) {
+        printMBABatch(&slots[i], 1);
+      }
+    }
+  }
+  printLifetimeData(&data);
+  return succeeded;
+}
@@ -0,0 +1,156 @@
+#ifndef LIFETIME_H
+#define LIFETIME_H
+
+#include <Arduino.h>
+#include "bqcmd.h"
+#include "battery.h"
+
+// Lifetime Data blocks, LifetimeDataBlock1 to LifetimeDataBlock5 in a row
+#define LIFETIME_BLOCKS 5
+#define LIFETIME_FIELD_COUNT 61
+
+// Encoding of a field in its block (little-endian)
+enum LifetimeFieldType : uint8_t {
+  FIELD_U1,
+  FIELD_I1,
+  FIELD_U2,
+  FIELD_I2,
+};
+
+// Unit of a field, tells how its value is printed
+enum LifetimeUnit : uint8_t {
+  LIFETIME_UNIT_NONE,       // Plain count
+  LIFETIME_UNIT_MILLIVOLT,
+  LIFETIME_UNIT_MILLIAMP,
+  LIFETIME_UNIT_CENTIWATT,  // 10 mW
+  LIFETIME_UNIT_CELSIUS,
+  LIFETIME_UNIT_HOURS,
+  LIFETIME_UNIT_CYCLE,      // Cycle count at the time of an event
+};
+
+// Count of a protection event and cycle count of the last one
+struct LifetimeEvent {
+  uint16_t count;
+  uint16_t lastCycle;
+};
+
+// Lifetime Data of a pack, decoded by decodeLifetimeData (data from bq40z50-R2 Technical Reference)
+struct LifetimeData {
+  uint8_t valid[(LIFETIME_FIELD_COUNT + 7) / 8];  // Fields read, by LifetimeFieldsInfo index (see isLifetimeFieldValid)
+  // Block 1: extremes
+  uint16_t cellMaxVoltage[4];
+  uint16_t cellMinVoltage[4];
+  uint16_t maxDeltaCellVoltage;
+  int16_t maxChargeCurrent;
+  int16_t maxDischargeCurrent;
+  int16_t maxAvgDischargeCurrent;
+  int16_t maxAvgDischargePower;
+  int8_t maxTempCell;
+  int8_t minTempCell;
+  int8_t maxDeltaCellTemp;
+  int8_t maxTempIntSensor;
+  int8_t minTempIntSensor;
+  int8_t maxTempFet;
+  // Block 2: resets and cell balancing
+  uint8_t shutdowns;
+  uint8_t partialResets;
+  uint8_t fullResets;
+  uint8_t watchdogResets;
+  uint8_t cellBalancingTime[4];
+  // Block 3: firmware runtime and time spent in the UT, LT, STL, RT, STH, HT and OT temperature ranges
+  uint16_t firmwareRuntime;
+  uint16_t timeSpent[7];
+  // Blocks 4 and 5: protection events
+  LifetimeEvent cov;
+  LifetimeEvent cuv;
+  LifetimeEvent ocd1;
+  LifetimeEvent ocd2;
+  LifetimeEvent occ1;
+  LifetimeEvent occ2;
+  LifetimeEvent aold;
+  LifetimeEvent ascd;
+  LifetimeEvent ascc;
+  LifetimeEvent otc;
+  LifetimeEvent otd;
+  LifetimeEvent otf;
+  LifetimeEvent validChargeTermination;
+};
+
+// Where a field is in its block and in LifetimeData
+// Strings are stored inline so the whole table can live in PROGMEM (see getLifetimeField* accessors)
+struct LifetimeFieldInfo {
+  Cmd block;            // LifetimeDataBlock1 to LifetimeDataBlock5
+  uint8_t offset;       // Offset in the block payload
+  LifetimeFieldType type;
+  LifetimeUnit unit;
+  uint8_t dataOffset;   // Offset in LifetimeData
+  char name[24];
+};
+
+inline Cmd getLifetimeFieldBlock(const LifetimeFieldInfo* field) { return static_cast<Cmd>(pgm_read_byte(&field->block)); }
+inline uint8_t getLifetimeFieldOffset(const LifetimeFieldInfo* field) { return pgm_read_byte(&field->offset); }
+inline LifetimeFieldType getLifetimeFieldType(const LifetimeFieldInfo* field) { return (LifetimeFieldType)pgm_read_byte(&field->type); }
+inline LifetimeUnit getLifetimeFieldUnit(const LifetimeFieldInfo* field) { return (LifetimeUnit)pgm_read_byte(&field->unit); }
+inline const __FlashStringHelper* getLifetimeFieldName(const LifetimeFieldInfo* field) { return (const __FlashStringHelper*)field->name; }
+
+/**
+ * @brief Returns a field of the Lifetime Data layout.
+ *
+ * @param index  Field index, below LIFETIME_FIELD_COUNT.
+ *
+ * @return A pointer to its LifetimeFieldInfo (points into PROGMEM).
+ */
+const LifetimeFieldInfo* getLifetimeFieldInfo(uint8_t index);
+
+/**
+ * @brief Returns whether a field was read (its block answered and was long enough).
+ *
+ * @param data   Decoded data.
+ * @param index  Field index.
+ */
+inline bool isLifetimeFieldValid(const LifetimeData* data, uint8_t index) {
+  return data->valid[index / 8] & (1 << (index % 8));
+}
+
+/**
+ * @brief Fills LifetimeData from the results of the LIFETIME_BLOCKS block reads, following LifetimeFieldsInfo.
+ *
+ * Fields of a failed block, or beyond the end of a truncated one (a block holds up to 32 bytes,
+ * one read up to MBA_RESPONSE_PAYLOAD_SIZE), are left to 0 and not marked valid.
+ *
+ * @param slots  Results of LifetimeDataBlock1 to LifetimeDataBlock5, in this order.
+ * @param data   Output, receives the fields.
+ */
+void decodeLifetimeData(const MBABatchSlot* slots, LifetimeData* data);
+
+/**
+ * @brief Reads the five Lifetime Data blocks of a battery in one batch, into the shared arena.
+ *
+ * @param battery  Battery to read.
+ * @param data     Output, receives the decoded fields (NULL to only fill the arena).
+ *
+ * @return Number of blocks read.
+ */
+uint8_t readLifetimeData(const BQBattery* battery, LifetimeData* data);
+
+/**
+ * @brief Prints the valid fields with their unit, block by block.
+ *
+ * @param data  Decoded data.
+ */
+void printLifetimeData(const LifetimeData* data);
+
+/**
+ * @brief Captures the Lifetime Data of a battery before anything wipes it (e.g. LifetimeDataReset).
+ *
+ * In OUTPUT_MODE_BINARY the five raw blocks are sent as FRAME_RESPONSE frames, the host decodes
+ * them with the FRAME_LIFETIME_FIELD frames of the catalog; otherwise the decoded fields are printed.
+ * Some firmwares only answer once unsealed.
+ *
+ * @param battery  Battery to read.
+ *
+ * @return Number of blocks read.
+ */
+uint8_t runLifetimeCapture(const BQBattery* battery);
+
+#endif // LIFETIME_H
@@ -0,0 +1,60 @@
+#include <Arduino.h>
+#include "logsink.h"
+
+LogSink Log(Serial);
+
+/**
+ * @brief Queues one byte, sends it right away if nothing is queued and the UART has room.
+ *
+ * @param c  Byte to write.
+ *
+ * @return 1
+ */
+size_t LogSink::write(uint8_t c) {
+  // Nothing queued: bypass the ring while the UART has room
+  if (head == tail && out.availableForWrite() > 0) {
+    return out.write(c);
+  }
+
+  uint16_t next = (head + 1) & (LOG_BUFFER_SIZE - 1);
+  if (next == tail) {
+    // Ring full: make room by sending the oldest byte synchronously
+    stalls++;
+    out.write(buffer[tail]);
+    tail = (tail + 1) & (LOG_BUFFER_SIZE - 1);
+  }
+  buffer[head] = c;
+  head = next;
+  return 1;
+}
+
+/**
+ * @brief Sends as many queued bytes as the UART accepts without blocking.
+ *
+ * On an ESP32 a call from another core than the one of loop() does nothing.
+ */
+void LogSink::drain() {
+#if defined(ESP32)
+  // Only the core of loop() owns the output, the station core may wait on the bus (see station.h)
+  if (xPortGetCoreID() != ARDUINO_RUNNING_CORE) {
+    return;
+  }
+#endif
+  int room = out.availableForWrite();
+  while (room > 0 && tail != head) {
+    out.write(buffer[tail]);
+    tail = (tail + 1) & (LOG_BUFFER_SIZE - 1);
+    room--;
+  }
+}
+
+/**
+ * @brief Blocks until every queued byte has been sent.
+ */
+void LogSink::flush() {
+  while (tail != head) {
+    out.write(buffer[tail]);
+    tail = (tail + 1) & (LOG_BUFFER_SIZE - 1);
+  }
+  out.flush();
+}
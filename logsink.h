@@ -0,0 +1,61 @@
+#ifndef LOGSINK_H
+#define LOGSINK_H
+
+#include <Arduino.h>
+
+// Size of the log ring buffer, must be a power of 2
+#define LOG_BUFFER_SIZE 512
+
+/**
+ * @brief Ring-buffered, non-blocking writer in front of a serial port.
+ *
+ * Everything printed to it is queued in SRAM and only handed to the UART when it has room
+ * (see drain), so I2C work is not stalled behind console output. drain() is called from
+ * loop() and from the command polling waits. When the ring is full the oldest bytes are
+ * sent synchronously so no log is lost (counted in `stalls`).
+ *
+ * Any Print reporting its room with availableForWrite() can be behind it: a HardwareSerial,
+ * or the USB CDC port of an ESP32-S3 or an RP2040. An output always reporting 0 only gets
+ * its bytes once the ring is full or on flush().
+ */
+class LogSink : public Print {
+public:
+  explicit LogSink(Print& out) : out(out), head(0), tail(0), stalls(0) {}
+
+  size_t write(uint8_t c) override;
+  using Print::write;
+
+  /**
+   * @brief Sends as many queued bytes as the UART accepts without blocking.
+   */
+  void drain();
+
+  /**
+   * @brief Blocks until every queued byte has been sent.
+   */
+  void flush();
+
+  /**
+   * @brief Number of bytes waiting in the ring buffer.
+   */
+  uint16_t pending() const { return (head - tail) & (LOG_BUFFER_SIZE - 1); }
+
+  /**
+   * @brief Number of bytes that had to be sent synchronously because the ring was full.
+   */
+  uint32_t getStalls() const { return stalls; }
+
+private:
+  Print& out;
+  uint8_t buffer[LOG_BUFFER_SIZE];
+  uint16_t head;
+  uint16_t tail;
+  uint32_t stalls;
+};
+
+static_assert((LOG_BUFFER_SIZE & (LOG_BUFFER_SIZE - 1)) == 0, "LOG_BUFFER_SIZE must be a power of 2");
+
+// Log output of the whole sketch, in front of Serial
+extern LogSink Log;
+
+#endif // LOGSINK_H
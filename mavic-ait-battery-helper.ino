@@ -1,83 +1,343 @@
 #include <Arduino.h>
 #include <Wire.h>
 #include "bqcmd.h"
+#include "utility.h"
+#include "telemetry.h"
+#include "logsink.h"
+#include "monitor.h"
+#include "bqbus.h"
+#include "battery.h"
+#include "unlock.h"
+#include "sampler.h"
+#include "dataflash.h"
+#include "stats.h"
+#include "bench.h"
+#include "simgauge.h"
+#include "console.h"
+#include "cache.h"
+#include "history.h"
+#include "lifetime.h"
+#include "station.h"
+#include "esp32bus.h"
 // Mavic air battery adress
 #define BQ_ADDR 0x0B
 // Set to true if you want to apply pacth, else it will just print battery data
 #define UNLOCK_ACTIVETED false
+// Set to true to run the unlock scheduler apart from the output: on a dual-core ESP32 it gets its own
+// core while loop() decodes and prints, elsewhere loop() prints between two transactions (see station.h)
+#define STATION_ACTIVATED false
+// Set to true to accept commands typed on the Serial Monitor once the startup sequence is done (type help)
+#define CONSOLE_ACTIVATED true
+// Set to true to keep watching the status registers in loop(), only changes are reported
+#define WATCH_ACTIVATED false
+// Delay between two samples of the watch mode
+#define WATCH_INTERVAL_MS 50
+// Set to true to sample the current and cell voltages of the first battery as fast as possible from loop()
+#define SAMPLE_ACTIVATED false
+// Minimum delay between two samples, 0 for back-to-back reads
+#define SAMPLE_PERIOD_US 0
+// The samples are dumped in bulk at this interval (or as soon as the buffer is full)
+#define SAMPLE_DUMP_MS 1000
+// Set to true to capture the Lifetime Data (extremes, resets, protection events) of every battery before anything is written
+#define LIFETIME_ACTIVATED false
+// Set to true to dump the whole DataFlash of every battery (after unsealing it) before anything is modified
+#define DATAFLASH_BACKUP_ACTIVATED false
+// Set to true to write back the rows of dataFlashProfile that differ on every battery (after the backup)
+#define DATAFLASH_RESTORE_ACTIVATED false
+// Set to false to only list the rows that differ from dataFlashProfile
+#define DATAFLASH_RESTORE_WRITE true
+// Set to true to check every transaction with SMBus PEC, corrupted transactions are retried (long or noisy leads)
+#define PEC_ACTIVATED false
+// Set to false to read DeviceType, FirmwareVersion, HardwareVersion (and other registers only changed by writes) every time
+#define RESPONSE_CACHE_ACTIVATED true
+// Set to false to not record the unlock attempts (pack, status before and after) in the EEPROM history (type history)
+#define HISTORY_ACTIVATED true
+// Set to true to pick, per bus, the fastest clock its batteries answer reliably at (BQ_CLOCK_MIN up to BUS_CLOCK_MAX)
+#define CLOCK_NEGOTIATION_ACTIVATED true
+// Fastest bus clock tried by the negotiation, in Hz
+#define BUS_CLOCK_MAX 400000
+// Set to true to measure commands/s, bytes/s and the unlock time before anything else
+#define BENCHMARK_ACTIVATED false
+// Set to false to measure the first battery instead of a simulated gauge (the unlock is then not timed)
+#define BENCHMARK_SIMULATED true
+// Rounds of each benchmark run
+#define BENCHMARK_ROUNDS 10
+// Response delay and NACK rate (1 transaction out of N, 0 for none) of the simulated gauge
+#define BENCHMARK_LATENCY_MS SIM_GAUGE_LATENCY_MS
+#define BENCHMARK_NACK_PERIOD 0
+// Set to true to have the simulated gauge run its block reads in the background, like a DMA-driven bus
+#define BENCHMARK_BACKGROUND_TRANSFERS false
+// Serial Monitor speed, the Mega 2560 handles 115200 up to 1000000 or 2000000 (exact dividers at 16 MHz)
+#define SERIAL_BAUD 115200
+// OUTPUT_MODE_TEXT for the Serial Monitor, OUTPUT_MODE_BINARY for a test station decoding telemetry frames
+#define OUTPUT_MODE OUTPUT_MODE_TEXT
+
+// Batteries of the tray, each one on its own bus. Up to BQ_MAX_BATTERIES, for example:
+//   SoftwareWire softWire(4, 5);                   // SDA, SCL on spare pins
+//   WireBus<SoftwareWire> softwareBus(softWire, 4, 5);
+//   TCA9548A mux(hardwareBus);                     // channels 0-7 at TCA9548A_DEFAULT_ADDR
+//   MuxChannelBus muxBus0(mux, 0), muxBus1(mux, 1);
+//   Esp32Bus esp32Bus(I2C_NUM_1, 25, 26);          // ESP32 only, block reads run by the I2C interrupt
+//   { "A", &muxBus0, BQ_ADDR }, { "B", &muxBus1, BQ_ADDR }, { "C", &softwareBus, BQ_ADDR },
+static const BQBattery batteries[] = {
+  { "A", &hardwareBus, BQ_ADDR },
+};
+#define BATTERY_COUNT (sizeof(batteries) / sizeof(batteries[0]))
+
+// Status registers dumped before and after the unlock
+static const Cmd batteryStateCommands[] = {
+  Cmd::OperationStatus,
+  Cmd::SafetyAlert,
+  Cmd::SafetyStatus,
+  Cmd::PFAlert,
+  Cmd::PFStatus,
+  Cmd::ManufacturingStatus,
+};
+#define BATTERY_STATE_COMMANDS_COUNT (sizeof(batteryStateCommands) / sizeof(batteryStateCommands[0]))
+
+static const Cmd firmwareVersionCommands[] = { Cmd::FirmwareVersion };
+static const Cmd unsealCommands[] = { Cmd::UnsealKey1, Cmd::UnsealKey2 };
+
+// Known-good DataFlash content restored by DATAFLASH_RESTORE_ACTIVATED, starting at DATAFLASH_PROFILE_START.
+// Fill it with the bytes of a dump of a healthy pack (consecutive lines of the backup), an empty
+// profile is never written.
+#define DATAFLASH_PROFILE_START DATAFLASH_START
+static const uint8_t dataFlashProfile[] PROGMEM = {
+};
+static_assert(!DATAFLASH_RESTORE_ACTIVATED || sizeof(dataFlashProfile) > 0,
+              "DATAFLASH_RESTORE_ACTIVATED needs the bytes of a healthy pack in dataFlashProfile");
+#define RUN_ON_BATTERIES(cmds) runOnBatteries(batteries, BATTERY_COUNT, cmds, sizeof(cmds) / sizeof(cmds[0]))
+
+// Watch mode state (see WATCH_ACTIVATED), one per battery
+static Monitor monitors[BATTERY_COUNT];
+// Unlock state (see UNLOCK_ACTIVETED), one per battery, advanced from loop()
+static UnlockTask unlockTasks[BATTERY_COUNT];
+static bool unlockRunning = false;
+// Station mode state (see STATION_ACTIVATED), the unlock output goes through the queue
+static Station station;
+static OutputQueue stationOutput;
+// Sampling state (see SAMPLE_ACTIVATED)
+static Sampler sampler;
+static unsigned long lastDumpAt;
+// Serial console (see CONSOLE_ACTIVATED), its unlock uses unlockTasks once the startup one is done
+static Console console;
+
+// Takes a snapshot of all status registers of every battery, then prints it
+void printBatteryState() {
+  RUN_ON_BATTERIES(batteryStateCommands);
+}
+
+// Reads the SBS measurements (voltages, current, temperature...) of every battery
+void printBatteryMeasurements() {
+  for (uint8_t i = 0; i < BATTERY_COUNT; i++) {
+    selectBattery(&batteries[i]);
+    if (BATTERY_COUNT > 1 || getOutputMode() == OUTPUT_MODE_BINARY) {
+      printBatteryName(&batteries[i]);
+    }
+    for (uint8_t r = 0; r < static_cast<uint8_t>(Sbs::Count); r++) {
+      runSBSRead(batteries[i].address, static_cast<Sbs>(r));
+    }
+    Log.println();
+  }
+}
+
+// Dumps the whole DataFlash of every battery, it has to be unsealed first
+void backupDataFlash() {
+  for (uint8_t i = 0; i < BATTERY_COUNT; i++) {
+    selectBattery(&batteries[i]);
+    printBatteryName(&batteries[i]);
+    dumpDataFlash(batteries[i].address, DATAFLASH_START, DATAFLASH_END);
+    Log.println();
+  }
+}
+
+// Writes back the rows of dataFlashProfile that differ on every battery, it has to be unsealed first
+void restoreDataFlash() {
+  for (uint8_t i = 0; i < BATTERY_COUNT; i++) {
+    selectBattery(&batteries[i]);
+    printBatteryName(&batteries[i]);
+    DataFlashSyncResult result;
+    syncDataFlash(batteries[i].address, DATAFLASH_PROFILE_START, dataFlashProfile, sizeof(dataFlashProfile),
+                  DATAFLASH_RESTORE_WRITE, &result);
+    Log.println();
+  }
+}
+
+// Measures the throughput of the sketch (see BENCHMARK_ACTIVATED) with the current output mode and bus clock
+void benchmark() {
+  if (!BENCHMARK_SIMULATED) {
+    runBenchmark(&batteries[0], batteryStateCommands, BATTERY_STATE_COMMANDS_COUNT, BENCHMARK_ROUNDS, false);
+    return;
+  }
+  static SimulatedGauge gauge(BQ_ADDR);
+  static const BQBattery simulated = { "SIM", &gauge, BQ_ADDR };
+  gauge.setClock(BUS_CLOCK_MAX);
+  gauge.setLatency(BENCHMARK_LATENCY_MS, 0);
+  gauge.setNackPeriod(BENCHMARK_NACK_PERIOD);
+  gauge.setBackgroundTransfers(BENCHMARK_BACKGROUND_TRANSFERS);
+  runBenchmark(&simulated, batteryStateCommands, BATTERY_STATE_COMMANDS_COUNT, BENCHMARK_ROUNDS, true);
+}
+
+// Starts the watch and sampling modes and the console, if activated
+void startWatch() {
+  if (CONSOLE_ACTIVATED) {
+    beginConsole(&console, &Serial, batteries, BATTERY_COUNT, unlockTasks);
+    Log.println(F("Console ready, type help for the commands."));
+  }
+  if (SAMPLE_ACTIVATED) {
+    Log.println(F("Sampling t_us,current_mA,cell1_mV,cell2_mV,cell3_mV,cell4_mV ..."));
+    beginSampler(&sampler, &batteries[0], SAMPLE_PERIOD_US);
+    lastDumpAt = millis();
+  }
+  if (WATCH_ACTIVATED) {
+    Log.println(F("Watching battery state, only changes are printed ..."));
+    for (uint8_t i = 0; i < BATTERY_COUNT; i++) {
+      beginMonitor(&monitors[i], &batteries[i], batteryStateCommands, BATTERY_STATE_COMMANDS_COUNT, WATCH_INTERVAL_MS);
+    }
+  }
+}
 
 void setup() {
-  Serial.begin(9600);      // Start serial communication for debug output
-  Wire.begin();            // Initialize I2C bus
+  Serial.begin(SERIAL_BAUD); // Start serial communication for debug output
+  for (uint8_t i = 0; i < BATTERY_COUNT; i++) {
+    batteries[i].bus->begin();  // Initialize I2C buses
+  }
   delay(1000);             // Wait for bus and device to stabilize
-  Serial.println();
+  Log.println();
+
+  setOutputMode(OUTPUT_MODE);
+  setMBAPECEnabled(PEC_ACTIVATED);
+  setMBACacheEnabled(RESPONSE_CACHE_ACTIVATED);
+  if (getOutputMode() == OUTPUT_MODE_BINARY) {
+    // Once per session, so the host can decode the response frames
+    sendTelemetryCatalog();
+  }
 
   if(!UNLOCK_ACTIVETED) {
-    Serial.println(F("⚠️ Battery unlock desactived by default (to let you test the connexion & read values first) ⚠️"));
-    Serial.println(F("⚠️ If want to unlock battery, change parameter UNLOCK_ACTIVETED to true ⚠️"));
-    Serial.println();
-  }
-
-  Serial.println(F("Starting communication with battery..."));
-  Serial.println(F("⚠️ If you receive NACK : ⚠️"));
-  Serial.println(F("  - This code is specific to Mavic Air 1 + Arduino MEGA 2560, some parameters may change if you have another configuration"));
-  Serial.println(F("  - Your battery is maybe not well connected to arduino"));
-  Serial.println(F("      - Verify connexion, you can find screenshot of how to connect in github repo. https://github.com/gvnt/mavic-air-battery-helper"));
-  Serial.println(F("  - Your battery is maybe completely discharge and cannot communicate, you need to open it and charge it a bit manually"));
-  Serial.println();
-
-  Serial.println(F("Testing to print FirmwareVersion (Should look like 0x02 0x00 0x43 0x07 0x01 0x01 0x00 0x27 0x00 0x03 0x85 0x02 0x00)"));
-  runMBACommand(BQ_ADDR, "FirmwareVersion");
-
-  Serial.println(F("Printing battery state ..."));
-  runMBACommand(BQ_ADDR, "OperationStatus");
-  runMBACommand(BQ_ADDR, "SafetyAlert");
-  runMBACommand(BQ_ADDR, "SafetyStatus");
-  runMBACommand(BQ_ADDR, "PFAlert");
-  runMBACommand(BQ_ADDR, "PFStatus");
-  runMBACommand(BQ_ADDR, "ManufacturingStatus");
+    Log.println(F("⚠️ Battery unlock desactived by default (to let you test the connexion & read values first) ⚠️"));
+    Log.println(F("⚠️ If want to unlock battery, change parameter UNLOCK_ACTIVETED to true ⚠️"));
+    Log.println();
+  }
 
-  if(UNLOCK_ACTIVETED) {
-    Serial.println(F("Unlocking battery..."));
-    runMBACommand(BQ_ADDR, "UnsealKey1");
-    runMBACommand(BQ_ADDR, "UnsealKey2");
+  Log.println(F("Starting communication with battery..."));
+  Log.println(F("⚠️ If you receive NACK : ⚠️"));
+  Log.println(F("  - This code is specific to Mavic Air 1 + Arduino MEGA 2560, some parameters may change if you have another configuration"));
+  Log.println(F("  - Your battery is maybe not well connected to arduino"));
+  Log.println(F("      - Verify connexion, you can find screenshot of how to connect in github repo. https://github.com/gvnt/mavic-air-battery-helper"));
+  Log.println(F("  - Your battery is maybe completely discharge and cannot communicate, you need to open it and charge it a bit manually"));
+  Log.println();
+  bool batteryPresent[BATTERY_COUNT];
+  scanBatteries(batteries, BATTERY_COUNT, batteryPresent);
+
+  if (CLOCK_NEGOTIATION_ACTIVATED) {
+    // Each bus gets its own rate, only the channels of one multiplexer share the slowest one
+    negotiateBatteryClocks(batteries, BATTERY_COUNT, batteryPresent, BUS_CLOCK_MAX);
+    Log.println();
+  }
 
-    Serial.println(F("Temporary disabling PermanentFailure ..."));
-    runMBACommand(BQ_ADDR, "PermanentFailure");
-    runMBACommand(BQ_ADDR, "ManufacturingStatus");
+  if (BENCHMARK_ACTIVATED) {
+    benchmark();
+  }
+  beginHistory(HISTORY_ACTIVATED);
 
-    Serial.println(F("Reseting PermanentFailure data ..."));
-    runMBACommand(BQ_ADDR, "PermanentFailureDataReset");
+  Log.println(F("Testing to print FirmwareVersion (Should look like 0x02 0x00 0x43 0x07 0x01 0x01 0x00 0x27 0x00 0x03 0x85 0x02 0x00)"));
+  RUN_ON_BATTERIES(firmwareVersionCommands);
 
-    Serial.println(F("Printing battery state ..."));
-    runMBACommand(BQ_ADDR, "OperationStatus");
+  Log.println(F("Printing battery measurements ..."));
+  printBatteryMeasurements();
 
-    Serial.println(F("Printing register custom DJI PermanentFailure ..."));
-    runMBACommand(BQ_ADDR, "PF2RegisterRead");
+  Log.println(F("Printing battery state ..."));
+  printBatteryState();
 
-    Serial.println(F("Clearing custom DJI PermanentFailure ..."));
-    runMBACommand(BQ_ADDR, "ClearPF2");
+  if (LIFETIME_ACTIVATED) {
+    Log.println(F("Capturing lifetime data ..."));
+    for (uint8_t i = 0; i < BATTERY_COUNT; i++) {
+      runLifetimeCapture(&batteries[i]);
+    }
+    Log.println();
+  }
 
-    Serial.println(F("Printing register custom DJI PermanentFailure ..."));
-    runMBACommand(BQ_ADDR, "PF2RegisterRead");
+  if (DATAFLASH_BACKUP_ACTIVATED || DATAFLASH_RESTORE_ACTIVATED) {
+    RUN_ON_BATTERIES(unsealCommands);
+  }
+  if (DATAFLASH_BACKUP_ACTIVATED) {
+    Log.println(F("Backing up DataFlash ..."));
+    backupDataFlash();
+  }
+  if (DATAFLASH_RESTORE_ACTIVATED) {
+    Log.println(F("Restoring DataFlash ..."));
+    restoreDataFlash();
+  }
 
-    Serial.println(F("Reactivating PermanentFailure mode ..."));
-    runMBACommand(BQ_ADDR, "PermanentFailure");
+  if(UNLOCK_ACTIVETED) {
+    for (uint8_t i = 0; i < BATTERY_COUNT; i++) {
+      beginUnlockTask(&unlockTasks[i], &batteries[i]);
+    }
+    if (STATION_ACTIVATED) {
+      beginStation(&station, unlockTasks, BATTERY_COUNT, &stationOutput);
+    }
+    unlockRunning = true;
+  } else {
+    if (MBA_STATS_ACTIVATED) {
+      printMBAStats();
+    }
+    startWatch();
+  }
+}
 
-    Serial.println(F("Waiting for device reset (wait some seconds) ..."));
-    runMBACommand(BQ_ADDR, "DeviceReset");
-    delay(10000);
+void loop() {
+  if (unlockRunning) {
+    // Each task does at most one transaction per call, the batteries are unlocked side by side
+    bool running = false;
+    if (STATION_ACTIVATED) {
+      running = pollStation(&station);
+    } else {
+      for (uint8_t i = 0; i < BATTERY_COUNT; i++) {
+        running |= pollUnlockTask(&unlockTasks[i]);
+      }
+    }
 
-    Serial.println(F("Printing final battery state ..."));
-    runMBACommand(BQ_ADDR, "OperationStatus");
-    runMBACommand(BQ_ADDR, "SafetyAlert");
-    runMBACommand(BQ_ADDR, "SafetyStatus");
-    runMBACommand(BQ_ADDR, "PFAlert");
-    runMBACommand(BQ_ADDR, "PFStatus");
-    runMBACommand(BQ_ADDR, "ManufacturingStatus");
+    if (!running) {
+      unlockRunning = false;
+      Log.println(F("Printing final battery state ..."));
+      printBatteryState();
+      Log.println(F("You can disconnect and test your battery now."));
+      if (isMBAPECEnabled()) {
+        Log.print(F("PEC errors (retried): "));
+        Log.print(getMBAPECErrors());
+        Log.print(F(", blocks not checked (no room for the PEC): "));
+        Log.println(getMBAPECUnverified());
+      }
+      if (getMBARetries() > 0) {
+        Log.print(F("Transactions retried: "));
+        Log.print(getMBARetries());
+        Log.print(F(", bus recoveries: "));
+        Log.println(getMBABusRecoveries());
+      }
+      if (MBA_STATS_ACTIVATED) {
+        printMBAStats();
+      }
+      startWatch();
+    }
+  } else {
+    if (CONSOLE_ACTIVATED) {
+      pollConsole(&console);
+    }
+    if (SAMPLE_ACTIVATED) {
+      pollSampler(&sampler);
+      if (sampler.count == SAMPLER_CAPACITY || millis() - lastDumpAt >= SAMPLE_DUMP_MS) {
+        lastDumpAt = millis();
+        dumpSampler(&sampler);
+        printSamplerStats(&sampler);
+      }
+    }
+    if (WATCH_ACTIVATED) {
+      for (uint8_t i = 0; i < BATTERY_COUNT; i++) {
+        pollMonitor(&monitors[i]);
+      }
+    }
+  }
 
-    Serial.println(F("You can disconnect and test your battery now."));
-  } 
+  // Send the logs queued by the I2C work
+  Log.drain();
 }
-
-void loop() {}
@@ -0,0 +1,90 @@
+#include <Arduino.h>
+#include "monitor.h"
+#include "utility.h"
+#include "telemetry.h"
+#include "logsink.h"
+
+/**
+ * @brief Starts watching a list of status registers.
+ *
+ * @param monitor     Monitoring state to initialize.
+ * @param battery     Battery to watch.
+ * @param cmds        Registers to watch (up to MONITOR_MAX_COMMANDS, at most 32-bit each).
+ * @param count       Number of registers.
+ * @param intervalMs  Delay between two samples.
+ */
+void beginMonitor(Monitor* monitor, const BQBattery* battery, const Cmd* cmds, uint8_t count, uint16_t intervalMs) {
+  monitor->battery = battery;
+  monitor->cmds = cmds;
+  monitor->count = min(count, MONITOR_MAX_COMMANDS);
+  monitor->intervalMs = intervalMs;
+  monitor->lastPollAt = millis() - intervalMs;
+  monitor->primed = false;
+}
+
+/**
+ * @brief Takes a sample if it is due and reports only what changed since the previous one.
+ *
+ * The first sample is reported in full (printMBABatch). Afterwards, in OUTPUT_MODE_TEXT only the
+ * bits that flipped are printed (see printBitFieldChanges), in OUTPUT_MODE_BINARY only the
+ * registers that changed are sent. A steady battery produces no output at all.
+ * Call it from loop(), it returns immediately when no sample is due.
+ *
+ * @param monitor  Monitoring state initialized by beginMonitor.
+ *
+ * @return true if a sample was taken.
+ */
+bool pollMonitor(Monitor* monitor) {
+  if (millis() - monitor->lastPollAt < monitor->intervalMs) {
+    return false;
+  }
+  monitor->lastPollAt = millis();
+
+  selectBattery(monitor->battery);
+  runMBABatch(monitor->battery->address, monitor->cmds, monitor->count, monitor->slots);
+
+  if (!monitor->primed) {
+    printBatteryName(monitor->battery);
+    printMBABatch(monitor->slots, monitor->count);
+  }
+
+  for (uint8_t i = 0; i < monitor->count; i++) {
+    const MBABatchSlot* slot = &monitor->slots[i];
+    uint8_t error = slot->response.error;
+    uint32_t value = error == 0 ? getMBAResponseValue(&slot->response) : monitor->previous[i];
+
+    if (monitor->primed) {
+      bool errorChanged = error != monitor->previousError[i];
+      bool valueChanged = error == 0 && value != monitor->previous[i];
+
+      if (getOutputMode() == OUTPUT_MODE_BINARY) {
+        if (errorChanged || valueChanged) {
+          sendTelemetryBattery(monitor->battery->name);
+          sendTelemetryResponse(slot->id, &slot->response);
+        }
+      } else if (errorChanged && error != 0) {
+        Log.print(F("["));
+        Log.print(monitor->lastPollAt);
+        Log.print(F(" ms] "));
+        Log.print(monitor->battery->name);
+        Log.print(F(" - "));
+        Log.print(getMBACommandName(getMBACommandInfo(slot->id)));
+        Log.print(F(": "));
+        printMBACommandError(error);
+      } else if (valueChanged || errorChanged) {
+        Log.print(F("["));
+        Log.print(monitor->lastPollAt);
+        Log.print(F(" ms] "));
+        Log.print(monitor->battery->name);
+        Log.print(F(" - "));
+        printBitFieldChanges(getMBACommandInfo(slot->id), monitor->previous[i], value);
+      }
+    }
+
+    monitor->previous[i] = value;
+    monitor->previousError[i] = error;
+  }
+
+  monitor->primed = true;
+  return true;
+}
@@ -0,0 +1,49 @@
+#ifndef MONITOR_H
+#define MONITOR_H
+
+#include <Arduino.h>
+#include "bqcmd.h"
+#include "battery.h"
+
+// Maximum number of registers watched at once
+#define MONITOR_MAX_COMMANDS 8
+
+// State of the continuous monitoring of a battery (see beginMonitor / pollMonitor)
+struct Monitor {
+  const BQBattery* battery;
+  const Cmd* cmds;
+  uint8_t count;
+  uint16_t intervalMs;
+  unsigned long lastPollAt;
+  bool primed;                                // A first, complete sample has been reported
+  uint32_t previous[MONITOR_MAX_COMMANDS];    // Last value of each register
+  uint8_t previousError[MONITOR_MAX_COMMANDS];
+  MBABatchSlot slots[MONITOR_MAX_COMMANDS];
+};
+
+/**
+ * @brief Starts watching a list of status registers.
+ *
+ * @param monitor     Monitoring state to initialize.
+ * @param battery     Battery to watch.
+ * @param cmds        Registers to watch (up to MONITOR_MAX_COMMANDS, at most 32-bit each).
+ * @param count       Number of registers.
+ * @param intervalMs  Delay between two samples.
+ */
+void beginMonitor(Monitor* monitor, const BQBattery* battery, const Cmd* cmds, uint8_t count, uint16_t intervalMs);
+
+/**
+ * @brief Takes a sample if it is due and reports only what changed since the previous one.
+ *
+ * The first sample is reported in full (printMBABatch). Afterwards, in OUTPUT_MODE_TEXT only the
+ * bits that flipped are printed (see printBitFieldChanges), in OUTPUT_MODE_BINARY only the
+ * registers that changed are sent. A steady battery produces no output at all.
+ * Call it from loop(), it returns immediately when no sample is due.
+ *
+ * @param monitor  Monitoring state initialized by beginMonitor.
+ *
+ * @return true if a sample was taken.
+ */
+bool pollMonitor(Monitor* monitor);
+
+#endif // MONITOR_H
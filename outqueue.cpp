@@ -0,0 +1,75 @@
+#include <Arduino.h>
+#include "outqueue.h"
+
+/**
+ * @brief Empties a queue, neither side may be using it.
+ *
+ * @param queue  Queue to initialize.
+ */
+void beginOutputQueue(OutputQueue* queue) {
+  queue->head = 0;
+  queue->tail = 0;
+}
+
+/**
+ * @brief Returns how many records the producer can add, producer side.
+ *
+ * The consumer may free more records meanwhile, never fewer.
+ *
+ * @param queue  Queue initialized by beginOutputQueue.
+ */
+uint8_t getOutputQueueRoom(const OutputQueue* queue) {
+  uint8_t tail = __atomic_load_n(&queue->tail, __ATOMIC_ACQUIRE);
+  return (OUTPUT_QUEUE_SIZE - 1) - ((queue->head - tail) & (OUTPUT_QUEUE_SIZE - 1));
+}
+
+/**
+ * @brief Returns the record to fill next, producer side, published by commitOutputRecord.
+ *
+ * @param queue  Queue initialized by beginOutputQueue.
+ *
+ * @return The record, NULL if the queue is full.
+ */
+OutputRecord* reserveOutputRecord(OutputQueue* queue) {
+  if (getOutputQueueRoom(queue) == 0) {
+    return NULL;
+  }
+  return &queue->records[queue->head];
+}
+
+/**
+ * @brief Hands the record returned by reserveOutputRecord to the consumer.
+ *
+ * The record is written before the new head is seen by the consumer (release).
+ *
+ * @param queue  Queue initialized by beginOutputQueue.
+ */
+void commitOutputRecord(OutputQueue* queue) {
+  __atomic_store_n(&queue->head, (uint8_t)((queue->head + 1) & (OUTPUT_QUEUE_SIZE - 1)), __ATOMIC_RELEASE);
+}
+
+/**
+ * @brief Returns the oldest record, consumer side, left in place until releaseOutputRecord.
+ *
+ * @param queue  Queue initialized by beginOutputQueue.
+ *
+ * @return The record, NULL if the queue is empty.
+ */
+const OutputRecord* peekOutputRecord(OutputQueue* queue) {
+  uint8_t head = __atomic_load_n(&queue->head, __ATOMIC_ACQUIRE);
+  if (head == queue->tail) {
+    return NULL;
+  }
+  return &queue->records[queue->tail];
+}
+
+/**
+ * @brief Gives the record returned by peekOutputRecord back to the producer.
+ *
+ * The record is read before the producer can see it free (release).
+ *
+ * @param queue  Queue initialized by beginOutputQueue.
+ */
+void releaseOutputRecord(OutputQueue* queue) {
+  __atomic_store_n(&queue->tail, (uint8_t)((queue->tail + 1) & (OUTPUT_QUEUE_SIZE - 1)), __ATOMIC_RELEASE);
+}
@@ -0,0 +1,105 @@
+#ifndef OUTQUEUE_H
+#define OUTQUEUE_H
+
+#include <Arduino.h>
+#include "bqcmd.h"
+#include "battery.h"
+
+// Records of an OutputQueue, must be a power of 2 (one entry stays free to tell full from empty)
+#if defined(ESP32) || defined(ARDUINO_ARCH_RP2040)
+#define OUTPUT_QUEUE_SIZE 16
+#else
+#define OUTPUT_QUEUE_SIZE 4
+#endif
+
+// What an OutputRecord holds
+enum OutputRecordType : uint8_t {
+  OUTPUT_RECORD_MESSAGE,   // Message printed before a script step
+  OUTPUT_RECORD_RESPONSE,  // Raw result of a command step, decoded by the consumer
+  OUTPUT_RECORD_SUMMARY,   // End of a script
+};
+
+// End of a script, as printed in its summary line
+struct ScriptSummary {
+  const char* name;    // Script name (PROGMEM)
+  uint8_t step;        // Step it stopped at
+  uint8_t failures;    // Failed steps
+  bool stopped;        // Stopped by SCRIPT_STOP
+  uint32_t elapsedMs;  // Time the script ran
+};
+
+// Output of a script, produced on the bus side and formatted on the output side (see OutputQueue)
+struct OutputRecord {
+  OutputRecordType type;
+  const BQBattery* battery;
+  union {
+    const char* message;    // OUTPUT_RECORD_MESSAGE (PROGMEM)
+    MBABatchSlot slot;      // OUTPUT_RECORD_RESPONSE
+    ScriptSummary summary;  // OUTPUT_RECORD_SUMMARY
+  };
+};
+
+/**
+ * @brief Lock-free single-producer/single-consumer ring of output records.
+ *
+ * The producer (the code running the bus transactions) only writes `head`, the consumer (the
+ * code formatting the results) only writes `tail`, each published with release/acquire ordering,
+ * so both sides can run on two cores of an ESP32 without a lock. On a single core the queue
+ * still lets loop() format a few results between two transactions. Records are filled and read
+ * in place, a full queue makes the producer wait rather than lose a record.
+ */
+struct OutputQueue {
+  OutputRecord records[OUTPUT_QUEUE_SIZE];
+  uint8_t head;  // Next record to fill, written by the producer only
+  uint8_t tail;  // Next record to read, written by the consumer only
+};
+
+static_assert((OUTPUT_QUEUE_SIZE & (OUTPUT_QUEUE_SIZE - 1)) == 0, "OUTPUT_QUEUE_SIZE must be a power of 2");
+
+/**
+ * @brief Empties a queue, neither side may be using it.
+ *
+ * @param queue  Queue to initialize.
+ */
+void beginOutputQueue(OutputQueue* queue);
+
+/**
+ * @brief Returns how many records the producer can add, producer side.
+ *
+ * @param queue  Queue initialized by beginOutputQueue.
+ */
+uint8_t getOutputQueueRoom(const OutputQueue* queue);
+
+/**
+ * @brief Returns the record to fill next, producer side, published by commitOutputRecord.
+ *
+ * @param queue  Queue initialized by beginOutputQueue.
+ *
+ * @return The record, NULL if the queue is full.
+ */
+OutputRecord* reserveOutputRecord(OutputQueue* queue);
+
+/**
+ * @brief Hands the record returned by reserveOutputRecord to the consumer.
+ *
+ * @param queue  Queue initialized by beginOutputQueue.
+ */
+void commitOutputRecord(OutputQueue* queue);
+
+/**
+ * @brief Returns the oldest record, consumer side, left in place until releaseOutputRecord.
+ *
+ * @param queue  Queue initialized by beginOutputQueue.
+ *
+ * @return The record, NULL if the queue is empty.
+ */
+const OutputRecord* peekOutputRecord(OutputQueue* queue);
+
+/**
+ * @brief Gives the record returned by peekOutputRecord back to the producer.
+ *
+ * @param queue  Queue initialized by beginOutputQueue.
+ */
+void releaseOutputRecord(OutputQueue* queue);
+
+#endif // OUTQUEUE_H
@@ -0,0 +1,34 @@
+#ifndef PEC_H
+#define PEC_H
+
+#include <Arduino.h>
+
+// CRC-8 lookup table of the SMBus PEC polynomial x^8 + x^2 + x + 1 (0x07), in PROGMEM
+extern const uint8_t crc8Table[256] PROGMEM;
+
+/**
+ * @brief Adds one byte to a CRC-8 (polynomial 0x07), one table lookup per byte.
+ *
+ * @param crc   CRC of the previous bytes (0 to start).
+ * @param data  Byte to add.
+ *
+ * @return The updated CRC.
+ */
+inline uint8_t crc8Update(uint8_t crc, uint8_t data) {
+  return pgm_read_byte(&crc8Table[crc ^ data]);
+}
+
+/**
+ * @brief Computes the CRC-8 (polynomial 0x07, initial value 0) of a buffer.
+ *
+ * This is the SMBus PEC polynomial, so the same routine checks bus and telemetry data.
+ *
+ * @param crc     CRC of the previous bytes (0 to start).
+ * @param buffer  Bytes to add to the CRC.
+ * @param length  Number of bytes.
+ *
+ * @return The updated CRC.
+ */
+uint8_t crc8(uint8_t crc, const uint8_t* buffer, size_t length);
+
+#endif // PEC_H
@@ -0,0 +1,65 @@
+#include <Arduino.h>
+#include "recipes.h"
+#include "unlock.h"
+#include "logsink.h"
+
+static const char checkName[] PROGMEM = "check";
+static const char checkTitle[] PROGMEM = "Check";
+static const char unlockRecipeName[] PROGMEM = "unlock";
+static const char unlockTitle[] PROGMEM = "Unlock";
+
+static const char firmwareMessage[] PROGMEM = "Reading firmware version ...";
+static const char sealedMessage[] PROGMEM = "Checking the battery is sealed ...";
+static const char pfStatusMessage[] PROGMEM = "Checking PermanentFailure flags ...";
+static const char safetyMessage[] PROGMEM = "Checking safety flags ...";
+static const char pfEnabledMessage[] PROGMEM = "Checking PermanentFailure mode is enabled ...";
+
+// Read-only diagnosis, each flag that is not in its normal state counts as a failed step.
+// OperationStatus SEC (bits 8-9) is 3 when sealed, ManufacturingStatus PF (bit 6) is 1 when enabled.
+static const ScriptStep checkScript[] PROGMEM = {
+  SCRIPT_RUN(FirmwareVersion, SCRIPT_STOP, firmwareMessage),
+  SCRIPT_EXPECT(OperationStatus, CHECK_EQUAL, 0x00000300, 0x00000300, 0, SCRIPT_NEXT, sealedMessage),
+  SCRIPT_EXPECT(PFStatus, CHECK_EQUAL, 0xFFFFFFFF, 0, 0, SCRIPT_NEXT, pfStatusMessage),
+  SCRIPT_EXPECT(SafetyStatus, CHECK_EQUAL, 0xFFFFFFFF, 0, 0, SCRIPT_NEXT, safetyMessage),
+  SCRIPT_EXPECT(ManufacturingStatus, CHECK_NOT_EQUAL, 0x0040, 0, 0, SCRIPT_NEXT, pfEnabledMessage),
+  SCRIPT_END(),
+};
+
+static const ScriptRecipe scriptRecipes[] PROGMEM = {
+  { checkName, checkTitle, checkScript },
+  { unlockRecipeName, unlockTitle, unlockScript },
+};
+
+#define SCRIPT_RECIPE_COUNT (sizeof(scriptRecipes) / sizeof(scriptRecipes[0]))
+
+/**
+ * @brief Finds a script of the catalog by name.
+ *
+ * Adding a recipe (e.g. for another pack) only takes a PROGMEM step table and a line of
+ * scriptRecipes in recipes.cpp.
+ *
+ * @param name    Name of the recipe (e.g. "check").
+ * @param recipe  Output, receives the recipe (copied from PROGMEM) if it exists.
+ *
+ * @return true if the recipe exists.
+ */
+bool getScriptRecipeByName(const char* name, ScriptRecipe* recipe) {
+  for (uint8_t i = 0; i < SCRIPT_RECIPE_COUNT; i++) {
+    memcpy_P(recipe, &scriptRecipes[i], sizeof(ScriptRecipe));
+    if (strcmp_P(name, recipe->name) == 0) {
+      return true;
+    }
+  }
+  return false;
+}
+
+/**
+ * @brief Prints the names of the recipes of the catalog on one line.
+ */
+void printScriptRecipes() {
+  for (uint8_t i = 0; i < SCRIPT_RECIPE_COUNT; i++) {
+    Log.print(i == 0 ? F("Recipes: ") : F(", "));
+    Log.print((const __FlashStringHelper*)pgm_read_ptr(&scriptRecipes[i].name));
+  }
+  Log.println();
+}
@@ -0,0 +1,32 @@
+#ifndef RECIPES_H
+#define RECIPES_H
+
+#include <Arduino.h>
+#include "script.h"
+
+// A named script of the catalog (see getScriptRecipeByName), run by the console `run` command
+struct ScriptRecipe {
+  const char* name;           // Name typed in the console (PROGMEM)
+  const char* title;          // Printed in the summary (PROGMEM)
+  const ScriptStep* script;   // Steps (PROGMEM)
+};
+
+/**
+ * @brief Finds a script of the catalog by name.
+ *
+ * Adding a recipe (e.g. for another pack) only takes a PROGMEM step table and a line of
+ * scriptRecipes in recipes.cpp.
+ *
+ * @param name    Name of the recipe (e.g. "check").
+ * @param recipe  Output, receives the recipe (copied from PROGMEM) if it exists.
+ *
+ * @return true if the recipe exists.
+ */
+bool getScriptRecipeByName(const char* name, ScriptRecipe* recipe);
+
+/**
+ * @brief Prints the names of the recipes of the catalog on one line.
+ */
+void printScriptRecipes();
+
+#endif // RECIPES_H
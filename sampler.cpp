@@ -0,0 +1,178 @@
+#include <Arduino.h>
+#include "sampler.h"
+#include "utility.h"
+#include "telemetry.h"
+#include "logsink.h"
+
+// Registers of a sample, in read order: current first, then cell 1 to SAMPLER_CELLS
+static const Sbs samplerChannels[SAMPLER_CELLS + 1] PROGMEM = {
+  Sbs::Current,
+  Sbs::CellVoltage1,
+  Sbs::CellVoltage2,
+  Sbs::CellVoltage3,
+  Sbs::CellVoltage4,
+};
+
+// Packed size of a sample in a FRAME_SAMPLES frame
+#define SAMPLE_FRAME_SIZE (4 + 2 + 2 * SAMPLER_CELLS)
+// Samples per FRAME_SAMPLES frame, the frame length is a single byte
+#define SAMPLES_PER_FRAME ((255 - 1) / SAMPLE_FRAME_SIZE)
+
+/**
+ * @brief Starts sampling the current and cell voltages of a battery.
+ *
+ * @param sampler   Sampling state to initialize.
+ * @param battery   Battery to sample.
+ * @param periodUs  Minimum delay between two samples, 0 to sample as fast as the gauge answers.
+ */
+void beginSampler(Sampler* sampler, const BQBattery* battery, uint16_t periodUs) {
+  sampler->battery = battery;
+  sampler->periodUs = periodUs;
+  sampler->channel = 0;
+  sampler->sampleFailed = false;
+  sampler->head = 0;
+  sampler->count = 0;
+  sampler->taken = 0;
+  sampler->dropped = 0;
+  sampler->errors = 0;
+  sampler->startedAtUs = micros();
+  sampler->pending.timestampUs = sampler->startedAtUs - periodUs;
+}
+
+/**
+ * @brief Stores the sample that has just been completed.
+ *
+ * @param sampler  Sampling state.
+ */
+static void storeSample(Sampler* sampler) {
+  if (sampler->sampleFailed) {
+    sampler->errors++;
+    return;
+  }
+  sampler->taken++;
+  if (sampler->count == SAMPLER_CAPACITY) {
+    sampler->dropped++;
+    return;
+  }
+  uint8_t tail = (sampler->head + sampler->count) % SAMPLER_CAPACITY;
+  sampler->samples[tail] = sampler->pending;
+  sampler->count++;
+}
+
+/**
+ * @brief Advances the sampling by at most one SBS read-word, without blocking.
+ *
+ * A sample takes SAMPLER_CELLS + 1 calls. Complete samples are stored in the ring buffer;
+ * when it is full they are counted as dropped until the next dumpSampler.
+ *
+ * @param sampler  Sampling state initialized by beginSampler.
+ *
+ * @return true if a transaction was done.
+ */
+bool pollSampler(Sampler* sampler) {
+  if (sampler->channel == 0) {
+    // Not yet time for the next sample
+    uint32_t now = micros();
+    if (now - sampler->pending.timestampUs < sampler->periodUs) {
+      return false;
+    }
+    sampler->pending.timestampUs = now;
+    sampler->sampleFailed = false;
+  }
+
+  selectBattery(sampler->battery);
+  Sbs id = static_cast<Sbs>(pgm_read_byte(&samplerChannels[sampler->channel]));
+  uint16_t value = 0;
+  if (readSBSWord(sampler->battery->address, id, &value) != 0) {
+    sampler->sampleFailed = true;
+  }
+
+  if (sampler->channel == 0) {
+    sampler->pending.current = (int16_t)value;
+  } else {
+    sampler->pending.cells[sampler->channel - 1] = value;
+  }
+
+  if (++sampler->channel > SAMPLER_CELLS) {
+    sampler->channel = 0;
+    storeSample(sampler);
+  }
+  return true;
+}
+
+/**
+ * @brief Sends all the stored samples at once and empties the buffer.
+ *
+ * In OUTPUT_MODE_TEXT the samples are printed as CSV lines (`t_us,current_mA,cell1_mV...`),
+ * in OUTPUT_MODE_BINARY they are packed into FRAME_SAMPLES frames.
+ *
+ * @param sampler  Sampling state.
+ *
+ * @return The number of samples sent.
+ */
+uint8_t dumpSampler(Sampler* sampler) {
+  uint8_t sent = sampler->count;
+  bool binary = getOutputMode() == OUTPUT_MODE_BINARY;
+  uint8_t body[1 + SAMPLES_PER_FRAME * SAMPLE_FRAME_SIZE];
+  uint8_t length = 1;
+  body[0] = 0;
+
+  if (binary) {
+    sendTelemetryBattery(sampler->battery->name);
+  }
+
+  while (sampler->count > 0) {
+    const Sample* sample = &sampler->samples[sampler->head];
+    sampler->head = (sampler->head + 1) % SAMPLER_CAPACITY;
+    sampler->count--;
+
+    if (!binary) {
+      Log.print(sample->timestampUs);
+      Log.print(',');
+      Log.print(sample->current);
+      for (uint8_t c = 0; c < SAMPLER_CELLS; c++) {
+        Log.print(',');
+        Log.print(sample->cells[c]);
+      }
+      Log.println();
+      continue;
+    }
+
+    // Little-endian, field by field so the layout does not depend on the compiler
+    for (uint8_t b = 0; b < 4; b++) {
+      body[length++] = sample->timestampUs >> (8 * b);
+    }
+    body[length++] = lowByte(sample->current);
+    body[length++] = highByte(sample->current);
+    for (uint8_t c = 0; c < SAMPLER_CELLS; c++) {
+      body[length++] = lowByte(sample->cells[c]);
+      body[length++] = highByte(sample->cells[c]);
+    }
+    if (++body[0] == SAMPLES_PER_FRAME || sampler->count == 0) {
+      sendTelemetrySamples(body, length);
+      body[0] = 0;
+      length = 1;
+    }
+  }
+  return sent;
+}
+
+/**
+ * @brief Prints the achieved sampling rate and the dropped/failed sample counters.
+ *
+ * @param sampler  Sampling state.
+ */
+void printSamplerStats(const Sampler* sampler) {
+  uint32_t elapsedUs = micros() - sampler->startedAtUs;
+  Log.print(F("Sampler "));
+  Log.print(sampler->battery->name);
+  Log.print(F(": "));
+  Log.print(sampler->taken);
+  Log.print(F(" samples, "));
+  Log.print(elapsedUs > 0 ? sampler->taken * 1000000.0 / elapsedUs : 0.0, 1);
+  Log.print(F(" samples/s, "));
+  Log.print(sampler->dropped);
+  Log.print(F(" dropped (buffer full), "));
+  Log.print(sampler->errors);
+  Log.println(F(" failed (read error)"));
+}
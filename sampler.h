@@ -0,0 +1,76 @@
+#ifndef SAMPLER_H
+#define SAMPLER_H
+
+#include <Arduino.h>
+#include "bqcmd.h"
+#include "battery.h"
+
+// Samples kept between two dumps (14 bytes each)
+#define SAMPLER_CAPACITY 64
+// Cells sampled (CellVoltage1-4)
+#define SAMPLER_CELLS 4
+
+// One sample: pack current and cell voltages, timestamped when its first read started
+struct Sample {
+  uint32_t timestampUs;            // micros()
+  int16_t current;                 // mA, negative while discharging
+  uint16_t cells[SAMPLER_CELLS];   // mV, cell 1 first
+};
+
+// State of the high-rate sampling of a battery (see beginSampler / pollSampler)
+struct Sampler {
+  const BQBattery* battery;
+  uint16_t periodUs;               // Minimum delay between two samples, 0 for back-to-back
+  uint8_t channel;                 // Next register of the sample being taken
+  bool sampleFailed;               // A read of the sample being taken failed
+  Sample pending;                  // Sample being taken
+  Sample samples[SAMPLER_CAPACITY];
+  uint8_t head;                    // Oldest stored sample
+  uint8_t count;                   // Stored samples
+  uint32_t taken;                  // Complete samples since beginSampler
+  uint32_t dropped;                // Samples lost because the buffer was full
+  uint32_t errors;                 // Samples lost because a read failed
+  uint32_t startedAtUs;
+};
+
+/**
+ * @brief Starts sampling the current and cell voltages of a battery.
+ *
+ * @param sampler   Sampling state to initialize.
+ * @param battery   Battery to sample.
+ * @param periodUs  Minimum delay between two samples, 0 to sample as fast as the gauge answers.
+ */
+void beginSampler(Sampler* sampler, const BQBattery* battery, uint16_t periodUs);
+
+/**
+ * @brief Advances the sampling by at most one SBS read-word, without blocking.
+ *
+ * A sample takes SAMPLER_CELLS + 1 calls. Complete samples are stored in the ring buffer;
+ * when it is full they are counted as dropped until the next dumpSampler.
+ *
+ * @param sampler  Sampling state initialized by beginSampler.
+ *
+ * @return true if a transaction was done.
+ */
+bool pollSampler(Sampler* sampler);
+
+/**
+ * @brief Sends all the stored samples at once and empties the buffer.
+ *
+ * In OUTPUT_MODE_TEXT the samples are printed as CSV lines (`t_us,current_mA,cell1_mV...`),
+ * in OUTPUT_MODE_BINARY they are packed into FRAME_SAMPLES frames.
+ *
+ * @param sampler  Sampling state.
+ *
+ * @return The number of samples sent.
+ */
+uint8_t dumpSampler(Sampler* sampler);
+
+/**
+ * @brief Prints the achieved sampling rate and the dropped/failed sample counters.
+ *
+ * @param sampler  Sampling state.
+ */
+void printSamplerStats(const Sampler* sampler);
+
+#endif // SAMPLER_H
@@ -0,0 +1,306 @@
+#include <Arduino.h>
+#include "script.h"
+#include "utility.h"
+#include "telemetry.h"
+#include "logsink.h"
+#include "stats.h"
+
+/**
+ * @brief Prepares a script on a battery, nothing is sent before the first pollScriptTask.
+ *
+ * @param task     Script state to initialize.
+ * @param battery  Battery to run it on.
+ * @param script   Steps in PROGMEM, ending with SCRIPT_END().
+ * @param name     Name printed in the summary (PROGMEM, e.g. "Unlock").
+ */
+void beginScriptTask(ScriptTask* task, const BQBattery* battery, const ScriptStep* script, const char* name) {
+  task->script = script;
+  task->name = name;
+  task->battery = battery;
+  task->step = 0;
+  task->state = SCRIPT_ISSUE;
+  task->failures = 0;
+  task->stopped = false;
+  task->startedAt = millis();
+  task->output = NULL;
+}
+
+/**
+ * @brief Prints one output record of a script: the message, the decoded response or the summary.
+ *
+ * Only reads the record: the print phase is not added to the stats, which the producer
+ * may be updating on the station core meanwhile.
+ *
+ * @param record  Record to print.
+ */
+void printScriptRecord(const OutputRecord* record) {
+  switch (record->type) {
+    case OUTPUT_RECORD_MESSAGE:
+      if (getOutputMode() == OUTPUT_MODE_TEXT) {
+        Log.print(F("[Battery "));
+        Log.print(record->battery->name);
+        Log.print(F("] "));
+        Log.println((const __FlashStringHelper*)record->message);
+      }
+      break;
+    case OUTPUT_RECORD_RESPONSE:
+      printBatteryName(record->battery);
+      printMBABatchSlot(&record->slot);
+      break;
+    case OUTPUT_RECORD_SUMMARY:
+      if (getOutputMode() != OUTPUT_MODE_TEXT) {
+        break;
+      }
+      Log.print((const __FlashStringHelper*)record->summary.name);
+      Log.print(F(" of battery "));
+      Log.print(record->battery->name);
+      if (record->summary.stopped) {
+        Log.print(F(" stopped at step "));
+        Log.print(record->summary.step);
+        Log.print(F(" after "));
+      } else {
+        Log.print(F(" finished in "));
+      }
+      Log.print(record->summary.elapsedMs);
+      Log.print(F(" ms, "));
+      Log.print(record->summary.failures);
+      Log.println(F(" failed step(s)."));
+      break;
+  }
+}
+
+/**
+ * @brief Prints the records queued by the script tasks, oldest first, consumer side of the queue.
+ *
+ * @param output  Queue given to setScriptTaskOutput.
+ *
+ * @return Number of records printed.
+ */
+uint8_t drainScriptOutput(OutputQueue* output) {
+  uint8_t printed = 0;
+  const OutputRecord* record;
+  while ((record = peekOutputRecord(output)) != NULL) {
+    printScriptRecord(record);
+    releaseOutputRecord(output);
+    printed++;
+  }
+  return printed;
+}
+
+/**
+ * @brief Hands a record to the output queue of a task, or prints it at once without one.
+ *
+ * @param task    Script state, gives the battery of the record.
+ * @param record  Record to output, its `battery` is set here.
+ */
+static void outputScriptRecord(ScriptTask* task, OutputRecord* record) {
+  record->battery = task->battery;
+  if (task->output == NULL) {
+    printScriptRecord(record);
+    return;
+  }
+  // Room was checked by pollScriptTask
+  OutputRecord* queued = reserveOutputRecord(task->output);
+  if (queued != NULL) {
+    *queued = *record;
+    commitOutputRecord(task->output);
+  }
+}
+
+// Outputs the summary line of a stopped script
+static void finishScriptTask(ScriptTask* task) {
+  task->state = SCRIPT_DONE;
+  OutputRecord record;
+  record.type = OUTPUT_RECORD_SUMMARY;
+  record.summary.name = task->name;
+  record.summary.step = task->step;
+  record.summary.failures = task->failures;
+  record.summary.stopped = task->stopped;
+  record.summary.elapsedMs = millis() - task->startedAt;
+  outputScriptRecord(task, &record);
+}
+
+static void goToScriptStep(ScriptTask* task, uint8_t step) {
+  task->step = step;
+  task->state = SCRIPT_ISSUE;
+}
+
+/**
+ * @brief Leaves a step that did not succeed, through its `onFail` target.
+ *
+ * @param task     Script state.
+ * @param onFail   Target of the step.
+ * @param counted  true if it counts as a failed step (always for SCRIPT_NEXT and SCRIPT_STOP).
+ */
+static void failScriptStep(ScriptTask* task, uint8_t onFail, bool counted) {
+  if (counted || onFail == SCRIPT_NEXT || onFail == SCRIPT_STOP) {
+    task->failures++;
+  }
+  if (onFail == SCRIPT_STOP) {
+    task->stopped = true;
+    finishScriptTask(task);
+  } else if (onFail == SCRIPT_NEXT) {
+    goToScriptStep(task, task->step + 1);
+  } else {
+    goToScriptStep(task, onFail);
+  }
+}
+
+// Sends the command of the current step and starts polling its completion
+static void issueScriptCommand(ScriptTask* task, const MBACommandInfo* cmdInfo) {
+  task->stepStartedAtUs = getMBAStatsTime();
+  beginMBAResponse(&task->slot.response, cmdInfo);
+  task->slot.response.error = issueMBACommand(task->battery->address, cmdInfo);
+  if (task->slot.response.error == 0) {
+    beginMBAWait(&task->wait, task->battery->address, cmdInfo);
+    task->state = SCRIPT_WAIT;
+  }
+}
+
+static bool checkScriptValue(const ScriptStep* step, uint32_t value) {
+  bool equal = (value & pgm_read_dword(&step->mask)) == pgm_read_dword(&step->expected);
+  return (ScriptCheck)pgm_read_byte(&step->check) == CHECK_EQUAL ? equal : !equal;
+}
+
+/**
+ * @brief Ends the command of a STEP_RUN or STEP_EXPECT (response read, or failed) and picks the next step.
+ *
+ * An expectation not met yet is read again after SCRIPT_EXPECT_POLL_MS until the step timeout,
+ * only its last response is printed.
+ *
+ * @param task  Script state, `slot` holds the result.
+ * @param step  Current step.
+ */
+static void finishScriptCommand(ScriptTask* task, const ScriptStep* step) {
+  ScriptOp op = (ScriptOp)pgm_read_byte(&step->op);
+  uint8_t onFail = pgm_read_byte(&step->onFail);
+  bool failed = task->slot.response.error != 0;
+  bool met = !failed && (op == STEP_RUN || checkScriptValue(step, getMBAResponseValue(&task->slot.response)));
+
+  if (!failed && !met && millis() - task->stepStartedAt < pgm_read_word(&step->timeoutMs)) {
+    task->resumeAt = millis() + SCRIPT_EXPECT_POLL_MS;
+    task->state = SCRIPT_DELAY;
+    return;
+  }
+
+  if (!failed) {
+    recordMBACommand(task->slot.id, getMBAStatsTime() - task->stepStartedAtUs);
+  }
+  OutputRecord record;
+  record.type = OUTPUT_RECORD_RESPONSE;
+  record.slot = task->slot;
+  outputScriptRecord(task, &record);
+
+  if (met) {
+    goToScriptStep(task, task->step + 1);
+  } else {
+    // A bus failure always counts, an unmet expectation only when it is not a branch
+    failScriptStep(task, onFail, failed);
+  }
+}
+
+/**
+ * @brief Advances a script by at most one bus transaction, without blocking.
+ *
+ * Call it from loop(), several tasks can run side by side (one per battery). Completions are
+ * polled like every command (see pollMBAWait), so a script runs as fast as the device answers.
+ * Each command step is printed once done, the summary once the script stops. With an output
+ * queue nothing is done until it has room for SCRIPT_MAX_RECORDS_PER_POLL records.
+ *
+ * @param task  Script state initialized by beginScriptTask.
+ *
+ * @return true while the script is running, false once it has stopped.
+ */
+bool pollScriptTask(ScriptTask* task) {
+  if (task->state == SCRIPT_DONE) {
+    return false;
+  }
+  // Wait for the consumer rather than lose output
+  if (task->output != NULL && getOutputQueueRoom(task->output) < SCRIPT_MAX_RECORDS_PER_POLL) {
+    return true;
+  }
+
+  selectBattery(task->battery);
+  const ScriptStep* step = &task->script[task->step];
+  ScriptOp op = (ScriptOp)pgm_read_byte(&step->op);
+  Cmd id = static_cast<Cmd>(pgm_read_byte(&step->id));
+  const MBACommandInfo* cmdInfo = op == STEP_RUN || op == STEP_EXPECT ? getMBACommandInfo(id) : NULL;
+  MBAWaitStatus status;
+
+  switch (task->state) {
+    case SCRIPT_ISSUE: {
+      const char* message = (const char*)pgm_read_ptr(&step->message);
+      if (message != NULL) {
+        OutputRecord record;
+        record.type = OUTPUT_RECORD_MESSAGE;
+        record.message = message;
+        outputScriptRecord(task, &record);
+      }
+      task->stepStartedAt = millis();
+
+      switch (op) {
+        case STEP_RUN:
+        case STEP_EXPECT:
+          task->slot.id = id;
+          issueScriptCommand(task, cmdInfo);
+          if (task->slot.response.error != 0) {
+            finishScriptCommand(task, step);
+          }
+          break;
+        case STEP_DELAY:
+          task->resumeAt = millis() + pgm_read_word(&step->timeoutMs);
+          task->state = SCRIPT_DELAY;
+          break;
+        case STEP_JUMP:
+          goToScriptStep(task, pgm_read_byte(&step->onFail));
+          break;
+        case STEP_END:
+          finishScriptTask(task);
+          break;
+      }
+      break;
+    }
+
+    case SCRIPT_WAIT:
+      status = pollMBAWait(&task->wait);
+      if (status == MBA_WAIT_PENDING) {
+        break;
+      }
+      if (status == MBA_WAIT_TIMEOUT) {
+        task->slot.response.error = MBA_ERROR_COMPLETION_TIMEOUT;
+        finishScriptCommand(task, step);
+      } else if (isMBACommandWriteOnly(cmdInfo)) {
+        finishScriptCommand(task, step);
+      } else {
+        // Completed, the response read gets its own timeout
+        beginMBAWait(&task->wait, task->battery->address, cmdInfo);
+        task->state = SCRIPT_READ;
+      }
+      break;
+
+    case SCRIPT_READ:
+      if (pollMBAResponse(&task->wait, &task->slot.response) != MBA_WAIT_PENDING) {
+        finishScriptCommand(task, step);
+      }
+      break;
+
+    case SCRIPT_DELAY:
+      if ((long)(millis() - task->resumeAt) < 0) {
+        break;
+      }
+      if (op == STEP_EXPECT) {
+        // Read again, the step (and its timeout) goes on
+        issueScriptCommand(task, cmdInfo);
+        if (task->slot.response.error != 0) {
+          finishScriptCommand(task, step);
+        }
+      } else {
+        goToScriptStep(task, task->step + 1);
+      }
+      break;
+
+    case SCRIPT_DONE:
+      break;
+  }
+  return task->state != SCRIPT_DONE;
+}
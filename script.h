@@ -0,0 +1,134 @@
+#ifndef SCRIPT_H
+#define SCRIPT_H
+
+#include <Arduino.h>
+#include "bqcmd.h"
+#include "battery.h"
+#include "outqueue.h"
+
+// Special step targets of `onFail`
+#define SCRIPT_NEXT 0xFF  // Count the failure and go on with the next step
+#define SCRIPT_STOP 0xFE  // Count the failure and stop the script
+
+// Delay between two reads of a STEP_EXPECT whose predicate does not hold yet
+#define SCRIPT_EXPECT_POLL_MS 10
+
+// Most records one pollScriptTask call outputs: a step message, a response and the summary
+#define SCRIPT_MAX_RECORDS_PER_POLL 3
+
+// What a step does
+enum ScriptOp : uint8_t {
+  STEP_RUN,     // Runs a command (its response is printed), goes to `onFail` if it fails
+  STEP_EXPECT,  // Reads a command until its value matches, goes to `onFail` if it does not before `timeoutMs`
+  STEP_DELAY,   // Waits `timeoutMs` without blocking
+  STEP_JUMP,    // Goes to step `onFail`
+  STEP_END,     // Stops the script
+};
+
+// Predicate of a STEP_EXPECT on the response value (see getMBAResponseValue)
+enum ScriptCheck : uint8_t {
+  CHECK_EQUAL,      // (value & mask) == expected
+  CHECK_NOT_EQUAL,  // (value & mask) != expected
+};
+
+// One step of a script, scripts are arrays of steps in PROGMEM ending with STEP_END (see the SCRIPT_* macros)
+struct ScriptStep {
+  ScriptOp op;
+  Cmd id;               // Command of STEP_RUN / STEP_EXPECT
+  ScriptCheck check;    // Predicate of STEP_EXPECT
+  uint8_t onFail;       // Step index to go to on failure (target of STEP_JUMP), SCRIPT_NEXT or SCRIPT_STOP
+  uint32_t mask;        // Bits of the value checked by STEP_EXPECT
+  uint32_t expected;    // Value of these bits
+  uint16_t timeoutMs;   // STEP_EXPECT: read again until then (0 to read once); STEP_DELAY: the delay
+  const char* message;  // Printed before the step (PROGMEM), NULL for none
+};
+
+// Step constructors, so that a script reads like a recipe
+#define SCRIPT_RUN(id, onFail, message) { STEP_RUN, Cmd::id, CHECK_EQUAL, onFail, 0, 0, 0, message }
+#define SCRIPT_EXPECT(id, check, mask, expected, timeoutMs, onFail, message) \
+  { STEP_EXPECT, Cmd::id, check, onFail, mask, expected, timeoutMs, message }
+#define SCRIPT_DELAY(ms, message) { STEP_DELAY, Cmd::Count, CHECK_EQUAL, SCRIPT_NEXT, 0, 0, ms, message }
+#define SCRIPT_JUMP(step) { STEP_JUMP, Cmd::Count, CHECK_EQUAL, step, 0, 0, 0, NULL }
+#define SCRIPT_END() { STEP_END, Cmd::Count, CHECK_EQUAL, SCRIPT_NEXT, 0, 0, 0, NULL }
+
+// Progress of a ScriptTask
+enum ScriptState : uint8_t {
+  SCRIPT_ISSUE,  // Current step must be started
+  SCRIPT_WAIT,   // Waiting for the device to complete the command
+  SCRIPT_READ,   // Reading the response of a read command
+  SCRIPT_DELAY,  // STEP_DELAY or STEP_EXPECT waiting before its next read
+  SCRIPT_DONE,   // Stopped
+};
+
+// State of one script running on one battery (see beginScriptTask / pollScriptTask)
+struct ScriptTask {
+  const ScriptStep* script;
+  const char* name;           // Printed in the summary (PROGMEM)
+  const BQBattery* battery;
+  uint8_t step;               // Index of the current step
+  ScriptState state;
+  uint8_t failures;           // Failed steps
+  bool stopped;               // Stopped by SCRIPT_STOP
+  unsigned long startedAt;
+  unsigned long stepStartedAt;
+  unsigned long resumeAt;     // End of SCRIPT_DELAY
+  uint32_t stepStartedAtUs;   // For the instrumentation only (see stats.h)
+  MBAWait wait;
+  MBABatchSlot slot;          // Response of the current step
+  OutputQueue* output;        // Where the output goes, NULL to print it at once (see setScriptTaskOutput)
+};
+
+/**
+ * @brief Prepares a script on a battery, nothing is sent before the first pollScriptTask.
+ *
+ * @param task     Script state to initialize.
+ * @param battery  Battery to run it on.
+ * @param script   Steps in PROGMEM, ending with SCRIPT_END().
+ * @param name     Name printed in the summary (PROGMEM, e.g. "Unlock").
+ */
+void beginScriptTask(ScriptTask* task, const BQBattery* battery, const ScriptStep* script, const char* name);
+
+/**
+ * @brief Sends the output of a script (step messages, responses, summary) to a queue instead of Log.
+ *
+ * The task then never prints: the records are formatted by whoever drains the queue
+ * (see drainScriptOutput), possibly on another core. Reset by beginScriptTask.
+ *
+ * @param task    Script state initialized by beginScriptTask.
+ * @param output  Queue the task is the producer of, NULL to print at once.
+ */
+inline void setScriptTaskOutput(ScriptTask* task, OutputQueue* output) { task->output = output; }
+
+/**
+ * @brief Advances a script by at most one bus transaction, without blocking.
+ *
+ * Call it from loop(), several tasks can run side by side (one per battery). Completions are
+ * polled like every command (see pollMBAWait), so a script runs as fast as the device answers.
+ * Each command step is printed once done, the summary once the script stops. With an output
+ * queue nothing is done until it has room for SCRIPT_MAX_RECORDS_PER_POLL records.
+ *
+ * @param task  Script state initialized by beginScriptTask.
+ *
+ * @return true while the script is running, false once it has stopped.
+ */
+bool pollScriptTask(ScriptTask* task);
+
+/**
+ * @brief Prints one output record of a script: the message, the decoded response or the summary.
+ *
+ * Leaves the stats alone, so it can run on the output core of a station.
+ *
+ * @param record  Record to print.
+ */
+void printScriptRecord(const OutputRecord* record);
+
+/**
+ * @brief Prints the records queued by the script tasks, oldest first, consumer side of the queue.
+ *
+ * @param output  Queue given to setScriptTaskOutput.
+ *
+ * @return Number of records printed.
+ */
+uint8_t drainScriptOutput(OutputQueue* output);
+
+#endif // SCRIPT_H
@@ -0,0 +1,375 @@
+#include <Arduino.h>
+#include "simgauge.h"
+#include "pec.h"
+
+// Subcommands the simulated gauge treats specially
+#define SIM_PERMANENT_FAILURE 0x0024
+#define SIM_PF_DATA_RESET 0x0029
+#define SIM_SEAL_DEVICE 0x0030
+#define SIM_DEVICE_RESET 0x0041
+#define SIM_PF_STATUS 0x0053
+#define SIM_OPERATION_STATUS 0x0054
+#define SIM_MANUFACTURING_STATUS 0x0057
+#define SIM_LIFETIME_DATA_BLOCK1 0x0060
+#define SIM_PF2_REGISTER 0x4062
+#define SIM_UNSEAL_KEY1 0x7EE0
+#define SIM_UNSEAL_KEY2 0xCCDF
+
+// Security modes of OperationStatus SEC1:SEC0
+#define SIM_SECURITY_UNSEALED 2
+#define SIM_SECURITY_SEALED 3
+
+// DataFlash returns a full 32-byte block, truncated by the Wire buffer like on the real gauge
+#define SIM_DATAFLASH_BLOCK_SIZE 32
+
+// Fixed block of a read subcommand
+struct SimBlock {
+  uint16_t subcommand;
+  uint8_t length;
+  uint8_t data[11];
+};
+
+// Responses that do not depend on the state, from exemple.log where it has them
+static const SimBlock simBlocks[] PROGMEM = {
+  { 0x0001, 2, { 0x00, 0x45 } },                                                        // DeviceType
+  { 0x0002, 11, { 0x43, 0x07, 0x01, 0x01, 0x00, 0x27, 0x00, 0x03, 0x85, 0x02, 0x00 } },  // FirmwareVersion
+  { 0x0003, 2, { 0x00, 0x00 } },                                                        // HardwareVersion
+  { 0x0050, 4, { 0x00, 0x00, 0x00, 0x00 } },                                            // SafetyAlert
+  { 0x0051, 4, { 0x00, 0x00, 0x00, 0x00 } },                                            // SafetyStatus
+  { 0x0052, 4, { 0x00, 0x00, 0x00, 0x00 } },                                            // PFAlert
+};
+
+// Lifetime Data blocks 1 to 5 of a pack that has seen a few faults
+struct SimLifetimeBlock {
+  uint8_t length;
+  uint8_t data[SIM_DATAFLASH_BLOCK_SIZE];
+};
+
+static const SimLifetimeBlock simLifetimeBlocks[] PROGMEM = {
+  // LifetimeDataBlock1: extremes of a pack that hit PF
+  { 32, { 0xCD, 0x10, 0xCA, 0x10, 0xD1, 0x10, 0xCB, 0x10, 0xC4, 0x0B, 0xCC, 0x0B, 0xC0, 0x0B, 0xC7, 0x0B, 0x61, 0x00, 0x1C, 0x0C, 0x2C, 0xCF, 0x90, 0xE8, 0xE4, 0xDA, 0x30, 0x0C, 0x04, 0x33, 0x0A, 0x3E } },
+  // LifetimeDataBlock2: resets, cell balancing
+  { 8, { 0x03, 0x01, 0x00, 0x00, 0x0C, 0x0A, 0x0E, 0x0B } },
+  // LifetimeDataBlock3: runtime, time per temperature range
+  { 16, { 0xC8, 0x05, 0x02, 0x00, 0x23, 0x00, 0x78, 0x00, 0xB5, 0x04, 0x62, 0x00, 0x12, 0x00, 0x00, 0x00 } },
+  // LifetimeDataBlock4: COV/CUV/OCD/OCC/AOLD/ASCD events
+  { 32, { 0x00, 0x00, 0x00, 0x00, 0x01, 0x00, 0x1D, 0x00, 0x03, 0x00, 0x25, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x01, 0x00, 0x28, 0x00, 0x00, 0x00, 0x00, 0x00 } },
+  // LifetimeDataBlock5: ASCC/OTC/OTD/OTF events, charge terminations
+  { 20, { 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x02, 0x00, 0x29, 0x00, 0x00, 0x00, 0x00, 0x00, 0x26, 0x00, 0x2A, 0x00 } },
+};
+
+// SBS word registers of a 4S pack at rest
+struct SimWord {
+  uint8_t reg;
+  uint16_t value;
+};
+
+static const SimWord simWords[] PROGMEM = {
+  { 0x08, 2981 },   // Temperature, 0.1 K
+  { 0x09, 15200 },  // Voltage, mV
+  { 0x0A, 0 },      // Current, mA
+  { 0x0D, 57 },     // RelativeStateOfCharge, %
+  { 0x17, 42 },     // CycleCount
+  { 0x1C, 4660 },   // SerialNumber
+  { 0x3C, 3798 },   // CellVoltage4, mV
+  { 0x3D, 3799 },   // CellVoltage3, mV
+  { 0x3E, 3802 },   // CellVoltage2, mV
+  { 0x3F, 3801 },   // CellVoltage1, mV
+};
+
+SimulatedGauge::SimulatedGauge(uint8_t address)
+  : address(address), targetAddress(0), clock(100000), txLength(0), rxLength(0), rxPosition(0), reg(0),
+    subcommand(0), pending(0), readyAt(0), busyUntil(0), offlineUntil(0),
+    responseMs(SIM_GAUGE_LATENCY_MS), busyMs(0), nackPeriod(0), nackCountdown(0),
+    background(false), deferring(false), deferredUs(0), requestDoneAt(0), transactions(0), nacks(0) {
+  lock();
+}
+
+/**
+ * @brief Sets how slow the simulated gauge is.
+ *
+ * @param responseMs  Delay before the block of a written subcommand can be read (SIM_GAUGE_LATENCY_MS by default).
+ * @param busyMs      Time the address is NACKed after each block write, 0 by default.
+ */
+void SimulatedGauge::setLatency(uint8_t responseMs, uint8_t busyMs) {
+  this->responseMs = responseMs;
+  this->busyMs = busyMs;
+}
+
+/**
+ * @brief Puts the gauge back in its locked state: sealed, PermanentFailure data and PF2 flag set.
+ */
+void SimulatedGauge::lock() {
+  security = SIM_SECURITY_SEALED;
+  keyReceived = false;
+  pfEnabled = true;
+  pfDataSet = true;
+  memset(pf2, 0, sizeof(pf2));
+}
+
+bool SimulatedGauge::isOnline() const {
+  return (long)(millis() - offlineUntil) >= 0;
+}
+
+/**
+ * @brief Waits for the time the bytes of a transaction take on the wires at the current clock.
+ *
+ * In a background request (see startRequest) the time is only added up.
+ *
+ * @param bytes  Bytes of the transaction, address byte included (9 clocks each, plus START and STOP).
+ */
+void SimulatedGauge::simulateBusTime(uint8_t bytes) {
+  uint32_t us = (bytes * 9UL + 2) * 1000000UL / clock;
+  if (deferring) {
+    deferredUs += us;
+    return;
+  }
+  // delayMicroseconds is only accurate up to 16383 us
+  if (us >= 1000) {
+    delay(us / 1000);
+  }
+  delayMicroseconds(us % 1000);
+}
+
+void SimulatedGauge::beginTransmission(uint8_t address) {
+  targetAddress = address;
+  txLength = 0;
+}
+
+size_t SimulatedGauge::write(uint8_t data) {
+  if (txLength >= sizeof(tx)) {
+    return 0;
+  }
+  tx[txLength++] = data;
+  return 1;
+}
+
+uint8_t SimulatedGauge::endTransmission(bool stop) {
+  transactions++;
+  simulateBusTime(1 + txLength);
+
+  bool injected = nackPeriod != 0 && ++nackCountdown >= nackPeriod;
+  if (injected) {
+    nackCountdown = 0;
+  }
+  if (targetAddress != address || !isOnline() || (long)(millis() - busyUntil) < 0 || injected) {
+    nacks++;
+    return 2;
+  }
+  if (txLength == 0) {
+    // Address probe
+    return 0;
+  }
+
+  reg = tx[0];
+  if (reg == MANUFACTURER_BLOCK_ACCESS_COMMAND && txLength >= 4) {
+    // Block write: command, length, subcommand, data, then the PEC if the master sent one
+    uint8_t blockLength = tx[1];
+    if (txLength == blockLength + 3) {
+      uint8_t pec = crc8Update(0, address << 1);
+      pec = crc8(pec, tx, txLength - 1);
+      if (pec != tx[txLength - 1]) {
+        nacks++;
+        return 3;
+      }
+      txLength--;
+    }
+    receiveBlock();
+  }
+  return 0;
+}
+
+/**
+ * @brief Applies a ManufacturerBlockAccess write (tx holds command, length, subcommand and data).
+ */
+void SimulatedGauge::receiveBlock() {
+  uint16_t written = word(tx[3], tx[2]);
+  const uint8_t* data = &tx[4];
+  uint8_t length = txLength - 4;
+  bool unsealed = security != SIM_SECURITY_SEALED;
+
+  pending = written;
+  readyAt = millis() + responseMs;
+  busyUntil = millis() + busyMs;
+
+  if (written == SIM_UNSEAL_KEY1) {
+    keyReceived = true;
+    return;
+  }
+  if (written == SIM_UNSEAL_KEY2) {
+    if (keyReceived) {
+      security = SIM_SECURITY_UNSEALED;
+    }
+    keyReceived = false;
+    return;
+  }
+  keyReceived = false;
+
+  // A sealed gauge ignores the other writes
+  if (!unsealed) {
+    return;
+  }
+  switch (written) {
+    case SIM_PERMANENT_FAILURE:
+      pfEnabled = !pfEnabled;
+      break;
+    case SIM_PF_DATA_RESET:
+      pfDataSet = false;
+      break;
+    case SIM_SEAL_DEVICE:
+      security = SIM_SECURITY_SEALED;
+      break;
+    case SIM_DEVICE_RESET:
+      offlineUntil = millis() + SIM_GAUGE_RESET_MS;
+      security = SIM_SECURITY_SEALED;
+      pfEnabled = true;
+      break;
+    case SIM_PF2_REGISTER:
+      memcpy(pf2, data, min(length, (uint8_t)sizeof(pf2)));
+      break;
+  }
+}
+
+/**
+ * @brief Runs a write then read request, in the background with setBackgroundTransfers.
+ *
+ * The gauge answers with its state at the start of the request, the bytes are only handed
+ * out by pollRequest once the wire time of the write and the read has elapsed.
+ */
+void SimulatedGauge::startRequest(uint8_t address, uint8_t command, uint8_t quantity) {
+  deferring = background;
+  deferredUs = 0;
+  BQBus::startRequest(address, command, quantity);
+  deferring = false;
+  requestDoneAt = micros() + deferredUs;
+}
+
+uint8_t SimulatedGauge::pollRequest() {
+  if (background && (long)(micros() - requestDoneAt) < 0) {
+    return BQ_REQUEST_PENDING;
+  }
+  return BQBus::pollRequest();
+}
+
+uint8_t SimulatedGauge::requestFrom(uint8_t address, uint8_t quantity) {
+  transactions++;
+  rxLength = 0;
+  rxPosition = 0;
+
+  bool injected = nackPeriod != 0 && ++nackCountdown >= nackPeriod;
+  if (injected) {
+    nackCountdown = 0;
+  }
+  if (address != this->address || !isOnline() || injected) {
+    nacks++;
+    simulateBusTime(1);
+    return 0;
+  }
+
+  if (reg == MANUFACTURER_BLOCK_ACCESS_COMMAND) {
+    loadBlockResponse();
+  } else {
+    loadWordResponse();
+  }
+  rxLength = min(rxLength, quantity);
+  simulateBusTime(1 + rxLength);
+  return rxLength;
+}
+
+/**
+ * @brief Fills rx with length, subcommand echo, payload and PEC of the current block.
+ *
+ * The written subcommand only shows up SIM_GAUGE_LATENCY_MS after its write, until then the
+ * block of the previous one is returned.
+ */
+void SimulatedGauge::loadBlockResponse() {
+  if (pending != subcommand && (long)(millis() - readyAt) >= 0) {
+    subcommand = pending;
+  }
+
+  uint8_t payload[SIM_DATAFLASH_BLOCK_SIZE];
+  uint8_t length = 0;
+  uint32_t value;
+
+  switch (subcommand) {
+    case SIM_OPERATION_STATUS:
+      // XDSG and XCHG until the PF data and the PF2 register are cleared, as in exemple.log
+      value = (uint32_t)security << 8;
+      if (pfDataSet || pf2[0] == 0) {
+        value |= 0x6000;
+      }
+      memcpy(payload, &value, 4);
+      length = 4;
+      break;
+    case SIM_PF_STATUS:
+      // DFETF (Discharge FET Failure)
+      value = pfDataSet ? 0x00020000UL : 0;
+      memcpy(payload, &value, 4);
+      length = 4;
+      break;
+    case SIM_MANUFACTURING_STATUS:
+      // GAUGE, FET, LF and BBR enabled
+      payload[0] = 0x38 | (pfEnabled ? 0x40 : 0);
+      payload[1] = 0;
+      length = 2;
+      break;
+    default:
+      if (subcommand >= 0x4000 && subcommand < 0x6000) {
+        for (uint8_t i = 0; i < SIM_DATAFLASH_BLOCK_SIZE; i++) {
+          uint16_t dfAddress = subcommand + i;
+          payload[i] = dfAddress >= SIM_PF2_REGISTER && dfAddress < SIM_PF2_REGISTER + sizeof(pf2)
+                         ? pf2[dfAddress - SIM_PF2_REGISTER] : lowByte(dfAddress);
+        }
+        length = SIM_DATAFLASH_BLOCK_SIZE;
+        break;
+      }
+      if (subcommand >= SIM_LIFETIME_DATA_BLOCK1 && subcommand < SIM_LIFETIME_DATA_BLOCK1 + 5) {
+        const SimLifetimeBlock* lifetime = &simLifetimeBlocks[subcommand - SIM_LIFETIME_DATA_BLOCK1];
+        length = pgm_read_byte(&lifetime->length);
+        memcpy_P(payload, lifetime->data, length);
+        break;
+      }
+      for (uint8_t i = 0; i < sizeof(simBlocks) / sizeof(simBlocks[0]); i++) {
+        if (pgm_read_word(&simBlocks[i].subcommand) == subcommand) {
+          length = pgm_read_byte(&simBlocks[i].length);
+          memcpy_P(payload, simBlocks[i].data, length);
+          break;
+        }
+      }
+      break;
+  }
+
+  uint8_t block[3 + SIM_DATAFLASH_BLOCK_SIZE + 1];
+  block[0] = 2 + length;
+  block[1] = lowByte(subcommand);
+  block[2] = highByte(subcommand);
+  memcpy(&block[3], payload, length);
+  uint8_t pec = crc8Update(0, address << 1);
+  pec = crc8Update(pec, MANUFACTURER_BLOCK_ACCESS_COMMAND);
+  pec = crc8Update(pec, (address << 1) | 1);
+  pec = crc8(pec, block, 3 + length);
+  block[3 + length] = pec;
+
+  rxLength = min(4 + length, (int)sizeof(rx));
+  memcpy(rx, block, rxLength);
+}
+
+/**
+ * @brief Fills rx with the SBS word of the last register written (0 if unknown) and its PEC.
+ */
+void SimulatedGauge::loadWordResponse() {
+  uint16_t value = 0;
+  for (uint8_t i = 0; i < sizeof(simWords) / sizeof(simWords[0]); i++) {
+    if (pgm_read_byte(&simWords[i].reg) == reg) {
+      value = pgm_read_word(&simWords[i].value);
+      break;
+    }
+  }
+  rx[0] = lowByte(value);
+  rx[1] = highByte(value);
+  uint8_t pec = crc8Update(0, address << 1);
+  pec = crc8Update(pec, reg);
+  pec = crc8Update(pec, (address << 1) | 1);
+  rx[2] = crc8(pec, rx, 2);
+  rxLength = 3;
+}
@@ -0,0 +1,129 @@
+#ifndef SIMGAUGE_H
+#define SIMGAUGE_H
+
+#include <Arduino.h>
+#include "bqbus.h"
+#include "bqcmd.h"
+
+// Delay before the block of a written subcommand replaces the previous one (the echo changes)
+#define SIM_GAUGE_LATENCY_MS 2
+// Time the gauge stays offline after DeviceReset
+#define SIM_GAUGE_RESET_MS 300
+
+/**
+ * @brief BQBus with a simulated bq40z50 behind it, to measure the sketch without a battery.
+ *
+ * Answers ManufacturerBlockAccess and SBS word reads at its address like the gauge of a locked
+ * Mavic Air pack (the responses of exemple.log): sealed, PermanentFailure data set, PF2 flag set.
+ * The unlock sequence changes that state as on a real pack (unseal keys, PF data reset, ClearPF2,
+ * DeviceReset going offline for SIM_GAUGE_RESET_MS). Every block is followed by its PEC, so it
+ * works with PEC enabled or not. DataFlash reads return a pattern, only the PF2 register keeps
+ * what is written to it.
+ *
+ * The time a transaction takes on the wires is simulated at the setClock() rate, and latency or
+ * NACKs can be injected to see how polling, retries and batching cope with a slow or noisy pack.
+ * With setBackgroundTransfers the block reads behave like on a DMA-driven bus: startRequest
+ * returns at once and pollRequest reports the read done once its bus time has elapsed.
+ *
+ * Example usage:
+ * @code
+ * SimulatedGauge gauge;
+ * gauge.setLatency(5, 2);   // echo after 5 ms, NACK for 2 ms after each block write
+ * gauge.setNackPeriod(50);  // 1 transaction out of 50 NACKed
+ * BQBattery battery = { "SIM", &gauge, 0x0B };
+ * @endcode
+ */
+class SimulatedGauge : public BQBus {
+public:
+  explicit SimulatedGauge(uint8_t address = 0x0B);
+
+  void begin() override {}
+  void setClock(uint32_t clock) override { this->clock = clock; }
+  void beginTransmission(uint8_t address) override;
+  size_t write(uint8_t data) override;
+  uint8_t endTransmission(bool stop = true) override;
+  uint8_t requestFrom(uint8_t address, uint8_t quantity) override;
+  int available() override { return rxLength - rxPosition; }
+  int read() override { return rxPosition < rxLength ? rx[rxPosition++] : -1; }
+  bool recover() override { return true; }
+  void setTimeout(uint16_t timeoutUs) override {}
+  void startRequest(uint8_t address, uint8_t command, uint8_t quantity) override;
+  uint8_t pollRequest() override;
+
+  /**
+   * @brief Sets how slow the simulated gauge is.
+   *
+   * @param responseMs  Delay before the block of a written subcommand can be read (SIM_GAUGE_LATENCY_MS by default).
+   * @param busyMs      Time the address is NACKed after each block write, 0 by default.
+   */
+  void setLatency(uint8_t responseMs, uint8_t busyMs);
+
+  /**
+   * @brief NACKs one transaction out of `period` (address NACK, code 2), 0 to never inject.
+   */
+  void setNackPeriod(uint8_t period) { nackPeriod = period; }
+
+  /**
+   * @brief Runs the requests of startRequest in the background instead of waiting for their bus time.
+   *
+   * @param enabled  true to simulate a DMA or interrupt driven bus, false (default) for a blocking one.
+   */
+  void setBackgroundTransfers(bool enabled) { background = enabled; }
+
+  /**
+   * @brief Puts the gauge back in its locked state: sealed, PermanentFailure data and PF2 flag set.
+   */
+  void lock();
+
+  /**
+   * @brief Returns the number of transactions (writes and reads, probes included) since startup.
+   */
+  uint32_t getTransactions() const { return transactions; }
+
+  /**
+   * @brief Returns the number of transactions NACKed since startup, injected or not.
+   */
+  uint32_t getNacks() const { return nacks; }
+
+private:
+  bool isOnline() const;
+  void simulateBusTime(uint8_t bytes);
+  void receiveBlock();
+  void loadBlockResponse();
+  void loadWordResponse();
+
+  uint8_t address;
+  uint8_t targetAddress;
+  uint32_t clock;
+  uint8_t tx[BQ_BUS_BUFFER_SIZE + 1];  // Room for a full block and its PEC
+  uint8_t txLength;
+  uint8_t rx[BQ_BUS_BUFFER_SIZE];
+  uint8_t rxLength;
+  uint8_t rxPosition;
+  uint8_t reg;               // Last register written (0x44 or an SBS register)
+
+  uint16_t subcommand;       // Subcommand whose block is returned by a 0x44 read
+  uint16_t pending;          // Subcommand written, returned once readyAt is reached
+  unsigned long readyAt;
+  unsigned long busyUntil;
+  unsigned long offlineUntil;
+  uint8_t responseMs;
+  uint8_t busyMs;
+  uint8_t nackPeriod;
+  uint8_t nackCountdown;
+  bool background;           // See setBackgroundTransfers
+  bool deferring;            // A background request is being started, its bus time is accumulated
+  uint32_t deferredUs;
+  unsigned long requestDoneAt;  // micros() at which the background request completes
+
+  uint8_t security;          // OperationStatus SEC1:SEC0, 3 sealed, 2 unsealed
+  bool keyReceived;          // UnsealKey1 received, UnsealKey2 expected
+  bool pfEnabled;            // ManufacturingStatus PF
+  bool pfDataSet;            // PFStatus not cleared yet
+  uint8_t pf2[4];            // PF2 register (DataFlash 0x4062)
+
+  uint32_t transactions;
+  uint32_t nacks;
+};
+
+#endif // SIMGAUGE_H
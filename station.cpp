@@ -0,0 +1,75 @@
+#include <Arduino.h>
+#include "station.h"
+#include "script.h"
+
+// Advances every task by at most one transaction, true while one of them runs
+static bool pollStationTasks(Station* station) {
+  bool running = false;
+  for (uint8_t i = 0; i < station->count; i++) {
+    running |= pollUnlockTask(&station->tasks[i]);
+  }
+  return running;
+}
+
+#if STATION_DUAL_CORE
+
+/**
+ * @brief FreeRTOS task of the station core: runs the scheduler until every unlock is done.
+ *
+ * It runs at the priority of the idle task of its core, so yielding lets the idle task feed
+ * the watchdog. Nothing is printed from this core, the output goes through the queue.
+ *
+ * @param parameter  The Station.
+ */
+static void runStationCore(void* parameter) {
+  Station* station = (Station*)parameter;
+  while (pollStationTasks(station)) {
+    taskYIELD();
+  }
+  // The records of the last polls are committed before this
+  __atomic_store_n(&station->running, false, __ATOMIC_RELEASE);
+  vTaskDelete(NULL);
+}
+
+#endif
+
+/**
+ * @brief Starts running unlock tasks with their output going through a queue.
+ *
+ * @param station  Station state to initialize.
+ * @param tasks    Unlock tasks, already prepared by beginUnlockTask.
+ * @param count    Number of tasks.
+ * @param output   Queue of the records, emptied by beginStation.
+ */
+void beginStation(Station* station, UnlockTask* tasks, uint8_t count, OutputQueue* output) {
+  station->tasks = tasks;
+  station->count = count;
+  station->output = output;
+  station->running = true;
+  beginOutputQueue(output);
+  for (uint8_t i = 0; i < count; i++) {
+    setScriptTaskOutput(&tasks[i].script, output);
+  }
+#if STATION_DUAL_CORE
+  xTaskCreatePinnedToCore(runStationCore, "station", STATION_STACK_SIZE, station, tskIDLE_PRIORITY, NULL, STATION_CORE);
+#endif
+}
+
+/**
+ * @brief Prints the records queued by the tasks and, on a single core, advances them.
+ *
+ * @param station  Station state initialized by beginStation.
+ *
+ * @return true while a task runs or records are left to print.
+ */
+bool pollStation(Station* station) {
+#if STATION_DUAL_CORE
+  // Read before draining, so the records of the last polls are printed in this call
+  bool running = __atomic_load_n(&station->running, __ATOMIC_ACQUIRE);
+#else
+  bool running = pollStationTasks(station);
+  station->running = running;
+#endif
+  drainScriptOutput(station->output);
+  return running;
+}
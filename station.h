@@ -0,0 +1,53 @@
+#ifndef STATION_H
+#define STATION_H
+
+#include <Arduino.h>
+#include "unlock.h"
+#include "outqueue.h"
+
+// The station core and the output are split on a dual-core ESP32 only
+#if defined(ESP32) && !CONFIG_FREERTOS_UNICORE
+#define STATION_DUAL_CORE 1
+// Core of the per-battery scheduler; loop() keeps the output on ARDUINO_RUNNING_CORE (1)
+#define STATION_CORE 0
+#define STATION_STACK_SIZE 8192
+#else
+#define STATION_DUAL_CORE 0
+#endif
+
+// Unlock tasks run apart from their output (see beginStation / pollStation)
+struct Station {
+  UnlockTask* tasks;
+  uint8_t count;
+  OutputQueue* output;
+  bool running;  // The scheduler has not finished, written by the station core only
+};
+
+/**
+ * @brief Starts running unlock tasks with their output going through a queue.
+ *
+ * On a dual-core ESP32 the per-battery scheduler (every transaction) runs in a FreeRTOS task
+ * on STATION_CORE, while loop() decodes and prints the queued records on the other core. Give
+ * each battery its own I2C peripheral (e.g. Wire and Wire1), so the batteries do not wait for
+ * each other. Elsewhere pollStation polls the tasks itself and prints the records between
+ * two transactions.
+ *
+ * @param station  Station state to initialize.
+ * @param tasks    Unlock tasks, already prepared by beginUnlockTask.
+ * @param count    Number of tasks.
+ * @param output   Queue of the records, emptied by beginStation.
+ */
+void beginStation(Station* station, UnlockTask* tasks, uint8_t count, OutputQueue* output);
+
+/**
+ * @brief Prints the records queued by the tasks and, on a single core, advances them.
+ *
+ * Call it from loop() until it returns false.
+ *
+ * @param station  Station state initialized by beginStation.
+ *
+ * @return true while a task runs or records are left to print.
+ */
+bool pollStation(Station* station);
+
+#endif // STATION_H
@@ -0,0 +1,143 @@
+#include <Arduino.h>
+#include "stats.h"
+#include "logsink.h"
+
+#if MBA_STATS_ACTIVATED
+
+// Latencies of one command
+struct MBACommandStats {
+  uint16_t count;
+  uint32_t minUs;
+  uint32_t maxUs;
+  uint32_t totalUs;
+  uint16_t histogram[MBA_STATS_BUCKETS];
+};
+
+// Fixed tables, one entry per command, phase and error code
+static MBACommandStats commandStats[static_cast<uint8_t>(Cmd::Count)];
+static uint32_t phaseTotalUs[MBA_PHASE_COUNT];
+static uint16_t phaseCount[MBA_PHASE_COUNT];
+static uint16_t errorCount[MBA_STATS_ERROR_CODES];
+
+/**
+ * @brief Adds the duration of one phase of a command to the phase totals.
+ *
+ * @param phase  Phase that took `us`.
+ * @param us     Duration in microseconds.
+ */
+void recordMBAPhase(MBAPhase phase, uint32_t us) {
+  phaseTotalUs[phase] += us;
+  phaseCount[phase]++;
+}
+
+/**
+ * @brief Adds one run of a command to its min/max/mean and latency histogram.
+ *
+ * @param id  Command that was run.
+ * @param us  Time from its block write to its completion or response, in microseconds.
+ */
+void recordMBACommand(Cmd id, uint32_t us) {
+  MBACommandStats* stats = &commandStats[static_cast<uint8_t>(id)];
+  if (stats->count == 0 || us < stats->minUs) {
+    stats->minUs = us;
+  }
+  if (us > stats->maxUs) {
+    stats->maxUs = us;
+  }
+  stats->count++;
+  stats->totalUs += us;
+
+  // Bucket of the highest set bit, the first one collects everything shorter
+  uint8_t log2 = us != 0 ? sizeof(unsigned long) * 8 - 1 - __builtin_clzl(us) : 0;
+  uint8_t bucket = log2 < MBA_STATS_FIRST_BUCKET_LOG2 ? 0 : log2 - MBA_STATS_FIRST_BUCKET_LOG2 + 1;
+  stats->histogram[min(bucket, MBA_STATS_BUCKETS - 1)]++;
+}
+
+/**
+ * @brief Counts a failed transaction or command by its printMBACommandError code.
+ *
+ * @param error  Error code, retried transactions included.
+ */
+void recordMBAError(uint8_t error) {
+  if (error < MBA_STATS_ERROR_CODES) {
+    errorCount[error]++;
+  }
+}
+
+/**
+ * @brief Prints the per-command latencies, the phase totals and the error counters.
+ */
+void printMBAStats() {
+  Log.print(F("Command latency (us): count min mean max | <"));
+  Log.print(1UL << MBA_STATS_FIRST_BUCKET_LOG2);
+  Log.println(F(" then x2 per bucket"));
+  for (uint8_t i = 0; i < static_cast<uint8_t>(Cmd::Count); i++) {
+    const MBACommandStats* stats = &commandStats[i];
+    if (stats->count == 0) {
+      continue;
+    }
+    Log.print(getMBACommandName(getMBACommandInfo(static_cast<Cmd>(i))));
+    Log.print(F(": "));
+    Log.print(stats->count);
+    Log.print(F(" "));
+    Log.print(stats->minUs);
+    Log.print(F(" "));
+    Log.print(stats->totalUs / stats->count);
+    Log.print(F(" "));
+    Log.print(stats->maxUs);
+    Log.print(F(" |"));
+    for (uint8_t b = 0; b < MBA_STATS_BUCKETS; b++) {
+      Log.print(F(" "));
+      Log.print(stats->histogram[b]);
+    }
+    Log.println();
+    Log.drain();
+  }
+
+  static const char phaseNames[MBA_PHASE_COUNT][7] PROGMEM = { "send", "wait", "read", "decode", "print" };
+  Log.print(F("Phases (total us / count):"));
+  for (uint8_t p = 0; p < MBA_PHASE_COUNT; p++) {
+    Log.print(F(" "));
+    Log.print((const __FlashStringHelper*)phaseNames[p]);
+    Log.print(F(" "));
+    Log.print(phaseTotalUs[p]);
+    Log.print(F("/"));
+    Log.print(phaseCount[p]);
+  }
+  Log.println();
+
+  Log.print(F("Errors by code:"));
+  bool any = false;
+  for (uint8_t code = 1; code < MBA_STATS_ERROR_CODES; code++) {
+    if (errorCount[code] == 0) {
+      continue;
+    }
+    any = true;
+    Log.print(F(" "));
+    Log.print(code);
+    Log.print(F("="));
+    Log.print(errorCount[code]);
+  }
+  Log.println(any ? F("") : F(" none"));
+}
+
+/**
+ * @brief Clears every counter, e.g. before measuring a new bus clock or poll setting.
+ */
+void resetMBAStats() {
+  memset(commandStats, 0, sizeof(commandStats));
+  memset(phaseTotalUs, 0, sizeof(phaseTotalUs));
+  memset(phaseCount, 0, sizeof(phaseCount));
+  memset(errorCount, 0, sizeof(errorCount));
+}
+
+#else
+
+/**
+ * @brief Prints the per-command latencies, the phase totals and the error counters.
+ */
+void printMBAStats() {
+  Log.println(F("Statistics are disabled, set MBA_STATS_ACTIVATED to true in stats.h."));
+}
+
+#endif
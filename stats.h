@@ -0,0 +1,80 @@
+#ifndef STATS_H
+#define STATS_H
+
+#include <Arduino.h>
+#include "bqcmd.h"
+
+// Set to true to time every command and count the bus errors (about 30 bytes of SRAM per command).
+// Build time only: without it the console `stats` command has nothing to print.
+#define MBA_STATS_ACTIVATED false
+
+// Buckets of the latency histograms: < 256 us, < 512 us, ... , >= 16384 us (powers of 2)
+#define MBA_STATS_BUCKETS 8
+#define MBA_STATS_FIRST_BUCKET_LOG2 8
+// Error codes counted: the Wire codes 1-5 and the MBA_ERROR_* codes
+#define MBA_STATS_ERROR_CODES (MBA_ERROR_VERIFY + 1)
+
+// Where the time of a command goes
+enum MBAPhase : uint8_t {
+  MBA_PHASE_SEND,    // Block write of the subcommand (issueMBACommand)
+  MBA_PHASE_WAIT,    // Completion polling (pollMBAWait)
+  MBA_PHASE_READ,    // Block reads, echo polls included (pollMBAResponse)
+  MBA_PHASE_DECODE,  // Response value and bit field lookup (decodeMBAResponse)
+  MBA_PHASE_PRINT,   // Printing, or sending the frame (printMBABatch, printDecodedMBAResponse)
+  MBA_PHASE_COUNT
+};
+
+#if MBA_STATS_ACTIVATED
+
+/**
+ * @brief Adds the duration of one phase of a command to the phase totals.
+ *
+ * @param phase  Phase that took `us`.
+ * @param us     Duration in microseconds.
+ */
+void recordMBAPhase(MBAPhase phase, uint32_t us);
+
+/**
+ * @brief Adds one run of a command to its min/max/mean and latency histogram.
+ *
+ * @param id  Command that was run.
+ * @param us  Time from its block write to its completion or response, in microseconds.
+ */
+void recordMBACommand(Cmd id, uint32_t us);
+
+/**
+ * @brief Counts a failed transaction or command by its printMBACommandError code.
+ *
+ * @param error  Error code, retried transactions included.
+ */
+void recordMBAError(uint8_t error);
+
+/**
+ * @brief Prints the per-command latencies, the phase totals and the error counters.
+ */
+void printMBAStats();
+
+/**
+ * @brief Clears every counter, e.g. before measuring a new bus clock or poll setting.
+ */
+void resetMBAStats();
+
+#else
+
+// Instrumentation compiled out, the calls cost nothing
+inline void recordMBAPhase(MBAPhase, uint32_t) {}
+inline void recordMBACommand(Cmd, uint32_t) {}
+inline void recordMBAError(uint8_t) {}
+void printMBAStats();
+inline void resetMBAStats() {}
+
+#endif
+
+/**
+ * @brief Returns a timestamp for the instrumentation (micros(), or 0 when it is compiled out).
+ */
+inline uint32_t getMBAStatsTime() {
+  return MBA_STATS_ACTIVATED ? micros() : 0;
+}
+
+#endif // STATS_H
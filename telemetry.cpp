@@ -0,0 +1,200 @@
+#include <Arduino.h>
+#include "telemetry.h"
+#include "logsink.h"
+#include "lifetime.h"
+
+// Largest frame body: bit field with all its strings
+#define TELEMETRY_MAX_BODY (2 + sizeof(BitFieldInfo))
+
+static OutputMode outputMode = OUTPUT_MODE_TEXT;
+
+/**
+ * @brief Selects how responses are reported, can be changed at any time.
+ *
+ * @param mode  OUTPUT_MODE_TEXT or OUTPUT_MODE_BINARY.
+ */
+void setOutputMode(OutputMode mode) {
+  outputMode = mode;
+}
+
+/**
+ * @brief Returns the current output mode (OUTPUT_MODE_TEXT by default).
+ */
+OutputMode getOutputMode() {
+  return outputMode;
+}
+
+/**
+ * @brief Writes one frame: sync, type, length, body and CRC.
+ *
+ * The body is given in two parts so that a response block can be sent from where
+ * it was received, without copying it into a frame buffer first.
+ *
+ * @param type        Frame type.
+ * @param body        First part of the frame body.
+ * @param length      Length of the first part.
+ * @param tail        Second part of the frame body (may be NULL if `tailLength` is 0).
+ * @param tailLength  Length of the second part.
+ */
+static void sendTelemetryFrame(TelemetryFrameType type, const uint8_t* body, uint8_t length,
+                               const uint8_t* tail = NULL, uint8_t tailLength = 0) {
+  uint8_t header[2] = { (uint8_t)type, (uint8_t)(length + tailLength) };
+  uint8_t crc = crc8(0, header, sizeof(header));
+  crc = crc8(crc, body, length);
+  crc = crc8(crc, tail, tailLength);
+
+  Log.write(TELEMETRY_SYNC);
+  Log.write(header, sizeof(header));
+  Log.write(body, length);
+  Log.write(tail, tailLength);
+  Log.write(crc);
+}
+
+/**
+ * @brief Appends a PROGMEM string and its terminating '\0' to a frame body.
+ *
+ * @param body    Frame body.
+ * @param length  Current body length, updated.
+ * @param str     String in PROGMEM.
+ */
+static void appendFlashString(uint8_t* body, uint8_t* length, const char* str) {
+  uint8_t c;
+  do {
+    c = pgm_read_byte(str++);
+    body[(*length)++] = c;
+  } while (c != '\0');
+}
+
+/**
+ * @brief Sends the response of a command as a FRAME_RESPONSE frame.
+ *
+ * Write commands and failed commands are sent with an empty payload, the host
+ * tells them apart with the error byte.
+ *
+ * @param id        Command the response belongs to.
+ * @param response  Response to send.
+ */
+void sendTelemetryResponse(Cmd id, const MBAResponse* response) {
+  uint8_t header[2] = { static_cast<uint8_t>(id), response->error };
+  // The block already holds the subcommand (LSB first) and the payload in frame order
+  uint8_t blockLength = 2 + (response->error == 0 ? response->length : 0);
+  sendTelemetryFrame(FRAME_RESPONSE, header, sizeof(header), response->block, blockLength);
+}
+
+/**
+ * @brief Sends an SBS word register value as a FRAME_SBS frame.
+ *
+ * @param id     Register the value belongs to.
+ * @param error  0 on success, printMBACommandError code otherwise.
+ * @param value  Raw word read by readSBSWord.
+ */
+void sendTelemetrySBS(Sbs id, uint8_t error, uint16_t value) {
+  uint8_t body[4] = { static_cast<uint8_t>(id), error, lowByte(value), highByte(value) };
+  sendTelemetryFrame(FRAME_SBS, body, sizeof(body));
+}
+
+/**
+ * @brief Sends a batch of samples packed by dumpSampler as a FRAME_SAMPLES frame.
+ *
+ * @param body    Packed samples, starting with their count.
+ * @param length  Body length.
+ */
+void sendTelemetrySamples(const uint8_t* body, uint8_t length) {
+  sendTelemetryFrame(FRAME_SAMPLES, body, length);
+}
+
+/**
+ * @brief Sends a chunk of DataFlash read by dumpDataFlash as a FRAME_DATAFLASH frame.
+ *
+ * @param response  Response of the DataFlash read, its echo is the chunk address.
+ * @param length    Number of payload bytes belonging to the chunk (ignored on error).
+ */
+void sendTelemetryDataFlash(const MBAResponse* response, uint8_t length) {
+  uint8_t header[1] = { response->error };
+  // The echo is the address (LSB first), followed by the data in place
+  uint8_t blockLength = 2 + (response->error == 0 ? length : 0);
+  sendTelemetryFrame(FRAME_DATAFLASH, header, sizeof(header), response->block, blockLength);
+}
+
+/**
+ * @brief Sends a record of the EEPROM history log as a FRAME_HISTORY frame.
+ *
+ * @param record  Record, starting with its type and length bytes.
+ * @param length  Record length.
+ */
+void sendTelemetryHistory(const uint8_t* record, uint8_t length) {
+  sendTelemetryFrame(FRAME_HISTORY, record, length);
+}
+
+/**
+ * @brief Sends a FRAME_BATTERY frame: the next responses belong to this battery.
+ *
+ * @param name  Battery name (see BQBattery).
+ */
+void sendTelemetryBattery(const char* name) {
+  sendTelemetryFrame(FRAME_BATTERY, (const uint8_t*)name, strlen(name));
+}
+
+/**
+ * @brief Exports the whole command catalog (MBACommandsInfo and their bit fields, SBSRegistersInfo).
+ *
+ * Sends one FRAME_COMMAND_INFO per command, one FRAME_BITFIELD per bit, one FRAME_SBS_INFO
+ * per SBS register and one FRAME_LIFETIME_FIELD per field of the Lifetime Data blocks, so the host
+ * can decode FRAME_RESPONSE payloads with the same tables as the firmware. It only needs
+ * to be sent once per session.
+ */
+void sendTelemetryCatalog() {
+  uint8_t body[TELEMETRY_MAX_BODY];
+
+  for (uint8_t i = 0; i < static_cast<uint8_t>(Cmd::Count); i++) {
+    const MBACommandInfo* cmdInfo = getMBACommandInfo(static_cast<Cmd>(i));
+    uint16_t subcommand = getMBACommandSubcommand(cmdInfo);
+    const BitFieldInfo* bitfields = getMBACommandBitFields(cmdInfo);
+    uint8_t bitfieldCount = getMBACommandBitFieldCount(cmdInfo);
+
+    uint8_t length = 0;
+    body[length++] = i;
+    body[length++] = lowByte(subcommand);
+    body[length++] = highByte(subcommand);
+    body[length++] = pgm_read_byte(&cmdInfo->access[0]);
+    body[length++] = getMBACommandDisplayFormat(cmdInfo);
+    body[length++] = bitfieldCount;
+    appendFlashString(body, &length, cmdInfo->name);
+    // The terminating '\0' is implied by the frame length
+    sendTelemetryFrame(FRAME_COMMAND_INFO, body, length - 1);
+
+    for (uint8_t b = 0; bitfields && b < bitfieldCount; b++) {
+      const BitFieldInfo* bitfield = &bitfields[b];
+      length = 0;
+      body[length++] = i;
+      body[length++] = getBitFieldIndex(bitfield);
+      appendFlashString(body, &length, bitfield->label);
+      appendFlashString(body, &length, bitfield->description);
+      appendFlashString(body, &length, bitfield->activeValue);
+      appendFlashString(body, &length, bitfield->inactiveValue);
+      sendTelemetryFrame(FRAME_BITFIELD, body, length - 1);
+    }
+  }
+
+  for (uint8_t i = 0; i < static_cast<uint8_t>(Sbs::Count); i++) {
+    const SBSRegisterInfo* regInfo = getSBSRegisterInfo(static_cast<Sbs>(i));
+    uint8_t length = 0;
+    body[length++] = i;
+    body[length++] = getSBSRegister(regInfo);
+    body[length++] = getSBSRegisterUnit(regInfo);
+    appendFlashString(body, &length, regInfo->name);
+    sendTelemetryFrame(FRAME_SBS_INFO, body, length - 1);
+  }
+
+  for (uint8_t i = 0; i < LIFETIME_FIELD_COUNT; i++) {
+    const LifetimeFieldInfo* field = getLifetimeFieldInfo(i);
+    uint8_t length = 0;
+    body[length++] = i;
+    body[length++] = static_cast<uint8_t>(getLifetimeFieldBlock(field));
+    body[length++] = getLifetimeFieldOffset(field);
+    body[length++] = getLifetimeFieldType(field);
+    body[length++] = getLifetimeFieldUnit(field);
+    appendFlashString(body, &length, field->name);
+    sendTelemetryFrame(FRAME_LIFETIME_FIELD, body, length - 1);
+  }
+}
@@ -0,0 +1,105 @@
+#ifndef TELEMETRY_H
+#define TELEMETRY_H
+
+#include <Arduino.h>
+#include "bqcmd.h"
+#include "pec.h"
+
+// First byte of every binary frame
+#define TELEMETRY_SYNC 0xA5
+
+// Frame layout: SYNC | type | body length | body... | CRC-8 (SMBus polynomial 0x07, over type..body)
+// Text written between frames (e.g. the setup() banners) is skipped by the host while resyncing on SYNC.
+enum TelemetryFrameType {
+  FRAME_RESPONSE = 0x01,      // body: cmd id, error, subcommand LSB, subcommand MSB, payload...
+  FRAME_COMMAND_INFO = 0x02,  // body: cmd id, subcommand LSB, subcommand MSB, access, display format, bitfield count, name
+  FRAME_BITFIELD = 0x03,      // body: cmd id, bit index, label \0 description \0 activeValue \0 inactiveValue
+  FRAME_BATTERY = 0x04,       // body: battery name, the following frames belong to this battery
+  FRAME_SBS = 0x05,           // body: sbs id, error, value LSB, value MSB
+  FRAME_SBS_INFO = 0x06,      // body: sbs id, register, unit, name
+  FRAME_SAMPLES = 0x07,       // body: count, then per sample: micros (4), current (2), cell 1-4 mV (2 each), little-endian
+  FRAME_DATAFLASH = 0x08,     // body: error, address LSB, address MSB, data...
+  FRAME_HISTORY = 0x09,       // body: one history record as stored in EEPROM (type, length, body, see history.h)
+  FRAME_LIFETIME_FIELD = 0x0A,  // body: field index, cmd id of its block, offset, type, unit, name (see lifetime.h)
+};
+
+// How responses are reported on Serial
+enum OutputMode {
+  OUTPUT_MODE_TEXT,    // Human-readable logs (printMBAResponse / printBitFields)
+  OUTPUT_MODE_BINARY,  // Framed binary telemetry, decoded by the host with the exported catalog
+};
+
+/**
+ * @brief Selects how responses are reported, can be changed at any time.
+ *
+ * @param mode  OUTPUT_MODE_TEXT or OUTPUT_MODE_BINARY.
+ */
+void setOutputMode(OutputMode mode);
+
+/**
+ * @brief Returns the current output mode (OUTPUT_MODE_TEXT by default).
+ */
+OutputMode getOutputMode();
+
+/**
+ * @brief Sends the response of a command as a FRAME_RESPONSE frame.
+ *
+ * Write commands and failed commands are sent with an empty payload, the host
+ * tells them apart with the error byte.
+ *
+ * @param id        Command the response belongs to.
+ * @param response  Response to send.
+ */
+void sendTelemetryResponse(Cmd id, const MBAResponse* response);
+
+/**
+ * @brief Sends an SBS word register value as a FRAME_SBS frame.
+ *
+ * @param id     Register the value belongs to.
+ * @param error  0 on success, printMBACommandError code otherwise.
+ * @param value  Raw word read by readSBSWord.
+ */
+void sendTelemetrySBS(Sbs id, uint8_t error, uint16_t value);
+
+/**
+ * @brief Sends a batch of samples packed by dumpSampler as a FRAME_SAMPLES frame.
+ *
+ * @param body    Packed samples, starting with their count.
+ * @param length  Body length.
+ */
+void sendTelemetrySamples(const uint8_t* body, uint8_t length);
+
+/**
+ * @brief Sends a chunk of DataFlash read by dumpDataFlash as a FRAME_DATAFLASH frame.
+ *
+ * @param response  Response of the DataFlash read, its echo is the chunk address.
+ * @param length    Number of payload bytes belonging to the chunk (ignored on error).
+ */
+void sendTelemetryDataFlash(const MBAResponse* response, uint8_t length);
+
+/**
+ * @brief Sends a record of the EEPROM history log as a FRAME_HISTORY frame.
+ *
+ * @param record  Record, starting with its type and length bytes.
+ * @param length  Record length.
+ */
+void sendTelemetryHistory(const uint8_t* record, uint8_t length);
+
+/**
+ * @brief Sends a FRAME_BATTERY frame: the next responses belong to this battery.
+ *
+ * @param name  Battery name (see BQBattery).
+ */
+void sendTelemetryBattery(const char* name);
+
+/**
+ * @brief Exports the whole command catalog (MBACommandsInfo and their bit fields, SBSRegistersInfo).
+ *
+ * Sends one FRAME_COMMAND_INFO per command, one FRAME_BITFIELD per bit, one FRAME_SBS_INFO
+ * per SBS register and one FRAME_LIFETIME_FIELD per field of the Lifetime Data blocks, so the host
+ * can decode FRAME_RESPONSE payloads with the same tables as the firmware. It only needs
+ * to be sent once per session.
+ */
+void sendTelemetryCatalog();
+
+#endif // TELEMETRY_H
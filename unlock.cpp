@@ -0,0 +1,109 @@
+#include <Arduino.h>
+#include "unlock.h"
+
+static const char unlockName[] PROGMEM = "Unlock";
+static const char securityMessage[] PROGMEM = "Checking security mode ...";
+static const char unsealMessage[] PROGMEM = "Unlocking battery...";
+static const char checkPFMessage[] PROGMEM = "Checking PermanentFailure flags ...";
+static const char disablePFMessage[] PROGMEM = "Temporary disabling PermanentFailure ...";
+static const char resetPFDataMessage[] PROGMEM = "Reseting PermanentFailure data ...";
+static const char stateMessage[] PROGMEM = "Printing battery state ...";
+static const char clearPF2Message[] PROGMEM = "Clearing custom DJI PermanentFailure ...";
+static const char readPF2Message[] PROGMEM = "Printing register custom DJI PermanentFailure ...";
+static const char enablePFMessage[] PROGMEM = "Reactivating PermanentFailure mode ...";
+static const char resetMessage[] PROGMEM = "Waiting for device reset ...";
+static const char cleanMessage[] PROGMEM = "No PermanentFailure to clear, sealing battery ...";
+
+// Steps targeted by the branches of unlockScript
+#define UNLOCK_STEP_KEYS 2
+#define UNLOCK_STEP_PRECHECK 4
+#define UNLOCK_STEP_RECOVERY 8
+#define UNLOCK_STEP_SEAL 17
+
+// PF2RegisterRead value once cleared, the ClearPF2 payload (0x01 0x23 0x45 0x67) read as little-endian
+#define UNLOCK_PF2_CLEARED 0x67452301
+
+// The pre-checks decode the status registers and branch over the steps already satisfied:
+// - the keys are skipped only when OperationStatus is read and SEC1:SEC0 (bits 8-9) is not 11
+//   (sealed); a failed read goes to the keys as well, it may be a sealed pack,
+// - a pack whose PFStatus, SafetyStatus and PF2 register are clean is only sealed again, without
+//   any PermanentFailure write nor the DeviceReset.
+// The two unseal keys are back-to-back: they must reach the device within 4 s.
+// In the recovery, a failed step is reported and the sequence goes on, as the last steps
+// re-enable PermanentFailure and reset the device.
+const ScriptStep unlockScript[] PROGMEM = {
+  /* 0 */ SCRIPT_EXPECT(OperationStatus, CHECK_NOT_EQUAL, 0x0300, 0x0300, 0, UNLOCK_STEP_KEYS, securityMessage),
+  /* 1 */ SCRIPT_JUMP(UNLOCK_STEP_PRECHECK),
+  /* 2 */ SCRIPT_RUN(UnsealKey1, SCRIPT_NEXT, unsealMessage),
+  /* 3 */ SCRIPT_RUN(UnsealKey2, SCRIPT_NEXT, NULL),
+  /* 4 */ SCRIPT_EXPECT(PFStatus, CHECK_EQUAL, 0xFFFFFFFF, 0, 0, UNLOCK_STEP_RECOVERY, checkPFMessage),
+  /* 5 */ SCRIPT_EXPECT(SafetyStatus, CHECK_EQUAL, 0xFFFFFFFF, 0, 0, UNLOCK_STEP_RECOVERY, NULL),
+  /* 6 */ SCRIPT_EXPECT(PF2RegisterRead, CHECK_EQUAL, 0xFFFFFFFF, UNLOCK_PF2_CLEARED, 0, UNLOCK_STEP_RECOVERY, NULL),
+  /* 7 */ SCRIPT_JUMP(UNLOCK_STEP_SEAL),
+  /* 8 */ SCRIPT_RUN(PermanentFailure, SCRIPT_NEXT, disablePFMessage),
+  /* 9 */ SCRIPT_RUN(ManufacturingStatus, SCRIPT_NEXT, NULL),
+  /* 10 */ SCRIPT_RUN(PermanentFailureDataReset, SCRIPT_NEXT, resetPFDataMessage),
+  /* 11 */ SCRIPT_RUN(OperationStatus, SCRIPT_NEXT, stateMessage),
+  /* 12 */ SCRIPT_RUN(ClearPF2, SCRIPT_NEXT, clearPF2Message),
+  /* 13 */ SCRIPT_RUN(PF2RegisterRead, SCRIPT_NEXT, readPF2Message),
+  /* 14 */ SCRIPT_RUN(PermanentFailure, SCRIPT_NEXT, enablePFMessage),
+  /* 15 */ SCRIPT_RUN(DeviceReset, SCRIPT_NEXT, resetMessage),
+  /* 16 */ SCRIPT_END(),
+  /* 17 */ SCRIPT_RUN(SealDevice, SCRIPT_NEXT, cleanMessage),
+  /* 18 */ SCRIPT_END(),
+};
+
+/**
+ * @brief Prepares the unlock of a battery, nothing is sent before the first pollUnlockTask.
+ *
+ * The sequence is UnsealKey1, UnsealKey2, PermanentFailure (disable), PermanentFailureDataReset,
+ * ClearPF2, PermanentFailure (enable) and DeviceReset, with status reads in between. Pre-checks
+ * skip the keys of an unsealed pack, and everything but SealDevice on a pack without failure.
+ * If the history is enabled, the state of the pack is read first (see beginHistorySnapshot).
+ *
+ * @param task     Unlock state to initialize.
+ * @param battery  Battery to unlock.
+ */
+void beginUnlockTask(UnlockTask* task, const BQBattery* battery) {
+  task->logging = isHistoryEnabled();
+  if (task->logging) {
+    beginHistorySnapshot(&task->read, battery, &task->before);
+  }
+  beginScriptTask(&task->script, battery, unlockScript, unlockName);
+}
+
+/**
+ * @brief Advances the unlock by at most one bus transaction, without blocking.
+ *
+ * Call it from loop() (several tasks can run side by side, one per battery). Each step is
+ * printed once done; a failed step is reported and the sequence goes on, as the last steps
+ * re-enable PermanentFailure and reset the device. Once done, the attempt is logged with the
+ * state before and after (see logHistoryUnlock), both snapshots are read one transaction per
+ * call as well.
+ *
+ * @param task  Unlock state initialized by beginUnlockTask.
+ *
+ * @return true while the unlock is running, false once all steps are done.
+ */
+bool pollUnlockTask(UnlockTask* task) {
+  if (!task->logging) {
+    return pollScriptTask(&task->script);
+  }
+  bool beforeScript = task->read.snapshot == &task->before;
+  if (!beforeScript && task->script.state != SCRIPT_DONE) {
+    pollScriptTask(&task->script);
+    return true;
+  }
+  if (pollHistorySnapshot(&task->read)) {
+    return true;
+  }
+  if (beforeScript) {
+    beginHistorySnapshot(&task->read, task->script.battery, &task->after);
+    // The summary times the script alone
+    task->script.startedAt = millis();
+    return true;
+  }
+  task->logging = false;
+  logHistoryUnlock(&task->before, &task->after, task->script.failures, task->script.stopped);
+  return false;
+}
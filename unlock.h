@@ -0,0 +1,50 @@
+#ifndef UNLOCK_H
+#define UNLOCK_H
+
+#include <Arduino.h>
+#include "bqcmd.h"
+#include "battery.h"
+#include "script.h"
+#include "history.h"
+
+// State of the unlock of one battery (see beginUnlockTask / pollUnlockTask), runs unlockScript
+struct UnlockTask {
+  ScriptTask script;        // Also runs other scripts, which are not logged (see beginScriptTask)
+  bool logging;             // The attempt is written to the history once done
+  HistorySnapshot before;   // State of the pack before the unlock
+  HistorySnapshot after;    // State of the pack after the unlock
+  HistoryRead read;         // Read of `before`, then of `after` once the script is done
+};
+
+// The unlock recipe, a script that can be run on its own (see script.h)
+extern const ScriptStep unlockScript[] PROGMEM;
+
+/**
+ * @brief Prepares the unlock of a battery, nothing is sent before the first pollUnlockTask.
+ *
+ * The sequence is UnsealKey1, UnsealKey2, PermanentFailure (disable), PermanentFailureDataReset,
+ * ClearPF2, PermanentFailure (enable) and DeviceReset, with status reads in between. Pre-checks
+ * skip the keys of an unsealed pack, and everything but SealDevice on a pack without failure.
+ * If the history is enabled, the state of the pack is read first (see beginHistorySnapshot).
+ *
+ * @param task     Unlock state to initialize.
+ * @param battery  Battery to unlock.
+ */
+void beginUnlockTask(UnlockTask* task, const BQBattery* battery);
+
+/**
+ * @brief Advances the unlock by at most one bus transaction, without blocking.
+ *
+ * Call it from loop() (several tasks can run side by side, one per battery). Each step is
+ * printed once done; a failed step is reported and the sequence goes on, as the last steps
+ * re-enable PermanentFailure and reset the device. Once done, the attempt is logged with the
+ * state before and after (see logHistoryUnlock), both snapshots are read one transaction per
+ * call as well.
+ *
+ * @param task  Unlock state initialized by beginUnlockTask.
+ *
+ * @return true while the unlock is running, false once all steps are done.
+ */
+bool pollUnlockTask(UnlockTask* task);
+
+#endif // UNLOCK_H
@@ -1,25 +1,9 @@
 #include <Arduino.h>
 #include "bqcmd.h"
-
-/**
- * @brief Reverses the byte order of a buffer (endianness).
- *
- * This function swaps the bytes of the given buffer in-place, effectively reversing the order.
- * It is typically used to convert between little-endian and big-endian representations.
- *
- * @param buffer Pointer to the byte buffer to reverse.
- * @param bufferSize Number of bytes in the buffer.
- *
- * For example, if the input buffer contains {0x12, 0x34, 0x56, 0x78}, the result after calling
- * this function will be {0x78, 0x56, 0x34, 0x12}.
- */
-void reverseBufferEndian(uint8_t *buffer, size_t bufferSize) {
-    for (size_t i = 0; i < bufferSize / 2; ++i) {
-        uint8_t temp = buffer[i];
-        buffer[i] = buffer[bufferSize - 1 - i];
-        buffer[bufferSize - 1 - i] = temp;
-    }
-}
+#include "utility.h"
+#include "telemetry.h"
+#include "logsink.h"
+#include "stats.h"
 
 /**
  * @brief Prints the contents of a byte buffer to the Serial monitor in multiple formats.
@@ -42,112 +26,230 @@ void reverseBufferEndian(uint8_t *buffer, size_t bufferSize) {
  * @endcode
  */
 void printBuffer(const uint8_t* buffer, size_t bufferSize, DisplayFormat displayFormat) {
-  Serial.print(F("Data (hex): "));
+  Log.print(F("Data (hex): "));
   for (size_t i = 0; i < bufferSize; ++i) {
-    Serial.print(F("0x"));
-    if (buffer[i] < 0x10) Serial.print("0");
-    Serial.print(buffer[i], HEX);
-    Serial.print(F(" "));
+    Log.print(F("0x"));
+    if (buffer[i] < 0x10) Log.print("0");
+    Log.print(buffer[i], HEX);
+    Log.print(F(" "));
   }
-  Serial.println();
+  Log.println();
   switch (displayFormat) {
     case FORMAT_DECIMAL:
-      Serial.print(F("Data (dec): "));
+      Log.print(F("Data (dec): "));
       for (size_t i = 0; i < bufferSize; ++i) {
-        Serial.print(buffer[i]);
-        Serial.print(F(" "));
+        Log.print(buffer[i]);
+        Log.print(F(" "));
       }
-      Serial.println();
+      Log.println();
       break;
     case FORMAT_BINARY:
-      Serial.print(F("Data (bin): "));
+      Log.print(F("Data (bin): "));
       for (size_t i = 0; i < bufferSize; ++i) {
         for (int b = 7; b >= 0; b--) {
-          Serial.print(bitRead(buffer[i], b));
+          Log.print(bitRead(buffer[i], b));
         }
-        Serial.print(F(" "));
+        Log.print(F(" "));
       }
-      Serial.println();
+      Log.println();
       break;
     case FORMAT_TEXT:
-      Serial.print(F("Data (txt): "));
+      Log.print(F("Data (txt): "));
       for (size_t i = 0; i < bufferSize; ++i) {
         if (buffer[i] >= 32 && buffer[i] <= 126) {
-          Serial.print((char)buffer[i]);
+          Log.print((char)buffer[i]);
         } else {
-          Serial.print(F("."));
+          Log.print(F("."));
         }
       }
-      Serial.println();
+      Log.println();
       break;
   }
 }
 
 /**
- * @brief Prints the state of individual bit fields from a buffer based on provided metadata.
+ * @brief Finds the description of a bit in a bit field table.
  *
- * This function reads specific bits from a byte buffer and prints a human-readable description
- * for each, based on an array of `BitFieldInfo` structures. Bits are accessed in MSB-first order.
+ * The tables list their bits in order, so entry `bitIndex` is checked first.
  *
- * @param buffer Pointer to the byte buffer containing the bit fields.
- * @param bufferSize Number of bytes in the buffer.
- * @param bitfields Pointer to an array of `BitFieldInfo` structures defining each bit field.
- * @param bitfieldsCount Number of bit fields to process from the `bitfields` array.
+ * @param bitfields       Bit field table (points into PROGMEM).
+ * @param bitfieldsCount  Number of entries.
+ * @param bitIndex        Bit to look for.
  *
- * Each `BitFieldInfo` entry defines the bit index, a label, the value meaning when the bit is set (`activeValue`),
- * the meaning when cleared (`inactiveValue`), and an optional description. The function prints these to the Serial monitor.
+ * @return The matching entry, or NULL if the bit is not described.
+ */
+static const BitFieldInfo* findBitField(const BitFieldInfo* bitfields, uint8_t bitfieldsCount, uint8_t bitIndex) {
+  if (bitIndex < bitfieldsCount && getBitFieldIndex(&bitfields[bitIndex]) == bitIndex) {
+    return &bitfields[bitIndex];
+  }
+  for (uint8_t i = 0; i < bitfieldsCount; ++i) {
+    if (getBitFieldIndex(&bitfields[i]) == bitIndex) {
+      return &bitfields[i];
+    }
+  }
+  return NULL;
+}
+
+/**
+ * @brief Prints what a bit value means: active/inactive value, then the optional description.
+ *
+ * @param b       Bit field (points into PROGMEM).
+ * @param bitSet  Value of the bit.
+ */
+static void printBitFieldMeaning(const BitFieldInfo* b, bool bitSet) {
+  if (bitSet) {
+    Log.print(getBitFieldActiveValue(b));
+  } else if (pgm_read_byte(&b->inactiveValue[0]) != '\0') {
+    Log.print(getBitFieldInactiveValue(b));
+  } else {
+    Log.print(F("Inactive"));
+  }
+
+  // Optional description
+  if (pgm_read_byte(&b->description[0]) != '\0') {
+    Log.print(F(" - "));
+    Log.print(getBitFieldDescription(b));
+  }
+  Log.println();
+}
+
+/**
+ * @brief Returns the mask of the bits of a register that can be decoded.
+ *
+ * @param bitfieldsCount  Number of bits described by the bit field table.
+ * @param length          Payload bytes received.
+ *
+ * @return The bits that are both described and received.
+ */
+uint32_t getBitFieldsMask(uint8_t bitfieldsCount, uint8_t length) {
+  uint8_t bits = min(bitfieldsCount, (uint8_t)(min(length, 4) * 8));
+  return bits >= 32 ? 0xFFFFFFFFUL : (1UL << bits) - 1;
+}
+
+/**
+ * @brief Prints the bit fields that are set in a register value.
+ *
+ * The register is decoded as a single word: when no bit of `mask` is set a single line is printed,
+ * otherwise only the set bits are visited (count trailing zeros, then clear the lowest set bit), so a
+ * healthy pack costs one test per register instead of one line per bit.
  *
- * The function performs safe bounds checking to avoid reading beyond the buffer.
+ * @param value           Register value (see getMBAResponseValue).
+ * @param mask            Bits to decode (see getBitFieldsMask).
+ * @param bitfields       Pointer to an array of `BitFieldInfo` structures defining each bit field.
+ * @param bitfieldsCount  Number of entries of the `bitfields` array.
+ *
+ * Each `BitFieldInfo` entry defines the bit index, a label, the value meaning when the bit is set (`activeValue`),
+ * and an optional description. The `bitfields` array is expected to live in PROGMEM and is read through
+ * the getBitField* accessors.
  *
  * Example output:
  * @code
- * Bit 5 (Power): 1 = On
- * Bit 6 (Error): 0 = No Error
- * Bit 7 (Ready): 1 = Ready to start
+ * Bit 3 (GAUGE): 1 = Enabled - Gas Gauging.
+ * Bit 6 (PF): 1 = Enabled - Permanent Failure functionality.
  * @endcode
  */
-void printBitFields(uint8_t* buffer, size_t bufferSize, const BitFieldInfo* bitfields, uint8_t bitfieldsCount) {
-  for (uint8_t i = 0; i < bitfieldsCount; ++i) {
-    const BitFieldInfo* b = &bitfields[i];
+void printBitFields(uint32_t value, uint32_t mask, const BitFieldInfo* bitfields, uint8_t bitfieldsCount) {
+  DecodedBitFields decoded;
+  decodeBitFields(value, mask, bitfields, bitfieldsCount, &decoded);
+  printDecodedBitFields(&decoded, bitfields);
+}
 
-    // Invert byte access (MSB byte first)
-    uint8_t byteIndex = (bitfieldsCount/8) - (b->bitIndex / 8) - 1;
+/**
+ * @brief Finds the bit field entries of the bits set in a register value, without printing.
+ *
+ * Decoding stage of printBitFields, so that it can be timed apart from the output (see MBA_PHASE_DECODE).
+ *
+ * @param value           Register value (see getMBAResponseValue).
+ * @param mask            Bits to decode (see getBitFieldsMask).
+ * @param bitfields       Bit field table (points into PROGMEM).
+ * @param bitfieldsCount  Number of entries of the `bitfields` array.
+ * @param decoded         Output, only the entries of the set bits are written.
+ */
+void decodeBitFields(uint32_t value, uint32_t mask, const BitFieldInfo* bitfields, uint8_t bitfieldsCount,
+                     DecodedBitFields* decoded) {
+  decoded->bits = value & mask;
+  uint32_t bits = decoded->bits;
+  while (bits != 0) {
+    uint8_t bitIndex = __builtin_ctzl(bits);
+    bits &= bits - 1;
+    const BitFieldInfo* b = findBitField(bitfields, bitfieldsCount, bitIndex);
+    decoded->entries[bitIndex] = b == NULL ? BIT_FIELD_UNKNOWN : b - bitfields;
+  }
+}
 
-    // Invert bit access (MSB bit first)
-    uint8_t bitInByte = (b->bitIndex % 8);
+/**
+ * @brief Prints the bit fields found by decodeBitFields, as printBitFields.
+ *
+ * @param decoded    Set bits and their entries.
+ * @param bitfields  Bit field table given to decodeBitFields.
+ */
+void printDecodedBitFields(const DecodedBitFields* decoded, const BitFieldInfo* bitfields) {
+  uint32_t bits = decoded->bits;
+  if (bits == 0) {
+    Log.println(F("No flag set."));
+    return;
+  }
 
-    // Extract the target bit (safely check data size)
-    bool bitSet = false;
+  while (bits != 0) {
+    uint8_t bitIndex = __builtin_ctzl(bits);
+    bits &= bits - 1;
 
-    if (byteIndex < bufferSize) {
-      bitSet = (buffer[byteIndex] >> bitInByte) & 0x01;
+    Log.print(F("Bit "));
+    Log.print(bitIndex);
+    if (decoded->entries[bitIndex] == BIT_FIELD_UNKNOWN) {
+      Log.println(F(": 1"));
+      continue;
     }
+    const BitFieldInfo* b = &bitfields[decoded->entries[bitIndex]];
+    Log.print(F(" ("));
+    Log.print(getBitFieldLabel(b));
+    Log.print(F("): 1 = "));
+    printBitFieldMeaning(b, true);
+  }
+}
 
-    // Print bit index and label
-    Serial.print(F("Bit "));
-    Serial.print(b->bitIndex);
-    Serial.print(F(" ("));
-    Serial.print(b->label);
-    Serial.print(F("): "));
-
-    // Print meaning
-    if (bitSet) {
-      Serial.print(F("1 = "));
-      Serial.print(b->activeValue);
-    } else {
-      Serial.print(F("0 = "));
-      if (b->inactiveValue) {
-        Serial.print(b->inactiveValue);
-      } else {
-        Serial.print(F("Inactive"));
-      }
-    }
+/**
+ * @brief Prints the bit fields of a register that changed between two samples.
+ *
+ * Prints the register name with its old and new value, then one line per bit that flipped,
+ * with the same wording as printBitFields. Only the changed bits are visited.
+ *
+ * @param cmdInfo   Command the values belong to (points into PROGMEM).
+ * @param previous  Previous register value.
+ * @param current   Current register value.
+ *
+ * Example output:
+ * @code
+ * SafetyAlert: 0x00000000 -> 0x00000002
+ *   Bit 1 (COV): 0 -> 1 = Detected - Cell Overvoltage
+ * @endcode
+ */
+void printBitFieldChanges(const MBACommandInfo* cmdInfo, uint32_t previous, uint32_t current) {
+  Log.print(getMBACommandName(cmdInfo));
+  Log.print(F(": 0x"));
+  Log.print(previous, HEX);
+  Log.print(F(" -> 0x"));
+  Log.println(current, HEX);
+
+  const BitFieldInfo* bitfields = getMBACommandBitFields(cmdInfo);
+  uint8_t bitfieldCount = getMBACommandBitFieldCount(cmdInfo);
+  uint32_t changed = bitfields ? (previous ^ current) & getBitFieldsMask(bitfieldCount, 4) : 0;
 
-    // Optional description
-    if (b->description) {
-      Serial.print(F(" - "));
-      Serial.println(b->description);
+  while (changed != 0) {
+    uint8_t bitIndex = __builtin_ctzl(changed);
+    changed &= changed - 1;
+    const BitFieldInfo* b = findBitField(bitfields, bitfieldCount, bitIndex);
+    if (b == NULL) {
+      continue;
     }
+    bool bitSet = (current >> bitIndex) & 0x01;
+
+    Log.print(F("  Bit "));
+    Log.print(bitIndex);
+    Log.print(F(" ("));
+    Log.print(getBitFieldLabel(b));
+    Log.print(bitSet ? F("): 0 -> 1 = ") : F("): 1 -> 0 = "));
+    printBitFieldMeaning(b, bitSet);
   }
 }
 
@@ -165,6 +267,10 @@ void printBitFields(uint8_t* buffer, size_t bufferSize, const BitFieldInfo* bitf
  *                - 3: Received NACK on transmit of data
  *                - 4: Other error
  *                - 5: Timeout
+ *                - 6 (MBA_ERROR_NO_DATA): No data available to read
+ *                - 7 (MBA_ERROR_ECHO_TIMEOUT): Response never echoed the subcommand
+ *                - 8 (MBA_ERROR_COMPLETION_TIMEOUT): Device never reported completion
+ *                - 9 (MBA_ERROR_PEC): Packet error checking failed on every attempt
  *                - Default: Unknown error code
  *
  * @note A return value of 0 (success) is not handled in this function and should be checked separately.
@@ -173,22 +279,37 @@ void printBitFields(uint8_t* buffer, size_t bufferSize, const BitFieldInfo* bitf
 void printMBACommandError(int result) {
   switch (result) {
     case 1:
-      Serial.println(F("Error: Data too long to fit in transmit buffer."));
+      Log.println(F("Error: Data too long to fit in transmit buffer."));
       break;
     case 2:
-      Serial.println(F("Error: Received NACK on transmit of address."));
+      Log.println(F("Error: Received NACK on transmit of address."));
       break;
     case 3:
-      Serial.println(F("Error: Received NACK on transmit of data."));
+      Log.println(F("Error: Received NACK on transmit of data."));
       break;
     case 4:
-      Serial.println(F("Error: Other error occurred."));
+      Log.println(F("Error: Other error occurred."));
       break;
     case 5:
-      Serial.println(F("Error: Timeout occurred."));
+      Log.println(F("Error: Timeout occurred."));
+      break;
+    case MBA_ERROR_NO_DATA:
+      Log.println(F("Error: No data available to read."));
+      break;
+    case MBA_ERROR_ECHO_TIMEOUT:
+      Log.println(F("Error: Timeout waiting for subcommand echo."));
+      break;
+    case MBA_ERROR_COMPLETION_TIMEOUT:
+      Log.println(F("Error: Timeout waiting for command completion."));
+      break;
+    case MBA_ERROR_PEC:
+      Log.println(F("Error: PEC mismatch, data corrupted on the bus."));
+      break;
+    case MBA_ERROR_VERIFY:
+      Log.println(F("Error: Data read back differs from the data written."));
       break;
     default:
-      Serial.println(F("Error: Unknown error code."));
+      Log.println(F("Error: Unknown error code."));
       break;
   }
 }
@@ -205,26 +326,207 @@ void printMBACommandError(int result) {
  *
  * @note The subcommand is displayed as two bytes (LSB and MSB), and data bytes (if any)
  *       are printed in 0xXX format. The `dataLength` field must be properly initialized.
+ *       `cmdInfo` points into PROGMEM and is read through the getMBACommand* accessors.
  */
 
 void printMBACommandInfo(const MBACommandInfo* cmdInfo) {
-  Serial.print(cmdInfo->name);
-  Serial.print(F(" : CMD=0x"));
-  if (MANUFACTURER_BLOCK_ACCESS_COMMAND < 0x10) Serial.print("0");
-  Serial.print(MANUFACTURER_BLOCK_ACCESS_COMMAND, HEX);
-
-  Serial.print(F(", SUBCMD=0x"));
-  if (highByte(cmdInfo->cmd) < 0x10) Serial.print("0");
-  Serial.print(highByte(cmdInfo->cmd), HEX);
-  if (lowByte(cmdInfo->cmd) < 0x10) Serial.print("0");
-  Serial.print(lowByte(cmdInfo->cmd), HEX);
-
-  if (cmdInfo->dataLength > 0) {
-    Serial.print(F(" DATA=0x"));
-    for (uint8_t i = 0; i < cmdInfo->dataLength; i++) {
-      if (cmdInfo->data[i] < 0x10) Serial.print("0");
-      Serial.print(cmdInfo->data[i], HEX);
+  uint16_t subcommand = getMBACommandSubcommand(cmdInfo);
+  uint8_t dataLength = getMBACommandDataLength(cmdInfo);
+
+  Log.print(getMBACommandName(cmdInfo));
+  Log.print(F(" : CMD=0x"));
+  if (MANUFACTURER_BLOCK_ACCESS_COMMAND < 0x10) Log.print("0");
+  Log.print(MANUFACTURER_BLOCK_ACCESS_COMMAND, HEX);
+
+  Log.print(F(", SUBCMD=0x"));
+  if (highByte(subcommand) < 0x10) Log.print("0");
+  Log.print(highByte(subcommand), HEX);
+  if (lowByte(subcommand) < 0x10) Log.print("0");
+  Log.print(lowByte(subcommand), HEX);
+
+  if (dataLength > 0) {
+    Log.print(F(" DATA=0x"));
+    for (uint8_t i = 0; i < dataLength; i++) {
+      uint8_t data = getMBACommandData(cmdInfo, i);
+      if (data < 0x10) Log.print("0");
+      Log.print(data, HEX);
+    }
+  }
+  Log.println();
+}
+
+/**
+ * @brief Prints the value of an SBS word register with its unit.
+ *
+ * @param regInfo  Register the value belongs to (points into PROGMEM).
+ * @param value    Raw word read by readSBSWord.
+ *
+ * Example output:
+ * @code
+ * Voltage (0x09): 11542 mV
+ * Temperature (0x08): 24.6 C
+ * @endcode
+ */
+void printSBSRegister(const SBSRegisterInfo* regInfo, uint16_t value) {
+  uint8_t reg = getSBSRegister(regInfo);
+  Log.print(getSBSRegisterName(regInfo));
+  Log.print(F(" (0x"));
+  if (reg < 0x10) Log.print("0");
+  Log.print(reg, HEX);
+  Log.print(F("): "));
+
+  switch (getSBSRegisterUnit(regInfo)) {
+    case SBS_UNIT_MILLIVOLT:
+      Log.print(value);
+      Log.println(F(" mV"));
+      break;
+    case SBS_UNIT_MILLIAMP:
+      Log.print((int16_t)value);
+      Log.println(F(" mA"));
+      break;
+    case SBS_UNIT_PERCENT:
+      Log.print(value);
+      Log.println(F(" %"));
+      break;
+    case SBS_UNIT_DECIKELVIN:
+      // 0.1 K to degrees Celsius, one decimal
+      Log.print(((int32_t)value - 2731) / 10.0, 1);
+      Log.println(F(" C"));
+      break;
+    case SBS_UNIT_NONE:
+      Log.println(value);
+      break;
+  }
+}
+
+/**
+ * @brief Prints a ManufacturerBlockAccess response read by readMBAResponse.
+ *
+ * This is the formatting stage of a read, kept apart from the I2C transaction so it can be
+ * deferred or skipped. It prints the block length, the data (subcommand echo then payload)
+ * in the command display format, then the bit fields when the command has some.
+ *
+ * @param cmdInfo   Command the response belongs to (points into PROGMEM).
+ * @param response  Response to print, must not be in error.
+ */
+void printMBAResponse(const MBACommandInfo* cmdInfo, const MBAResponse* response) {
+  DecodedBitFields decoded;
+  decodeMBAResponse(cmdInfo, response, &decoded);
+  printDecodedMBAResponse(cmdInfo, response, &decoded);
+}
+
+/**
+ * @brief Decodes the bit fields of a ManufacturerBlockAccess response, first stage of printMBAResponse.
+ *
+ * @param cmdInfo   Command the response belongs to (points into PROGMEM).
+ * @param response  Response to decode, must not be in error.
+ * @param decoded   Output, no bit set when the command has no bit fields.
+ */
+void decodeMBAResponse(const MBACommandInfo* cmdInfo, const MBAResponse* response, DecodedBitFields* decoded) {
+  const BitFieldInfo* bitfields = getMBACommandBitFields(cmdInfo);
+  uint8_t bitfieldCount = getMBACommandBitFieldCount(cmdInfo);
+  if (!bitfields || bitfieldCount == 0) {
+    decoded->bits = 0;
+    return;
+  }
+  decodeBitFields(getMBAResponseValue(response), getBitFieldsMask(bitfieldCount, response->length),
+                  bitfields, bitfieldCount, decoded);
+}
+
+/**
+ * @brief Prints a response decoded by decodeMBAResponse, second stage of printMBAResponse.
+ *
+ * @param cmdInfo   Command the response belongs to (points into PROGMEM).
+ * @param response  Response to print, must not be in error.
+ * @param decoded   Bit fields of the response.
+ */
+void printDecodedMBAResponse(const MBACommandInfo* cmdInfo, const MBAResponse* response, const DecodedBitFields* decoded) {
+  // If response is bigger than our buffer we send a warning
+  if (response->truncated) {
+    Log.print(F("⚠️  Warning: Block length exceeds buffer limit ("));
+    Log.print(MBA_RESPONSE_PAYLOAD_SIZE);
+    Log.println(F(" bytes). Truncation occurred."));
+  }
+  if (response->unverified) {
+    Log.println(F("⚠️  Warning: No room for the PEC in the bus buffer, block not checked."));
+  }
+  Log.print(F("Response length: "));
+  Log.print(response->length + 2);
+  Log.println(F(" bytes"));
+
+  // Print the block as received: subcommand echo then payload
+  printBuffer(response->block, response->length + 2, getMBACommandDisplayFormat(cmdInfo));
+
+  const BitFieldInfo* bitfields = getMBACommandBitFields(cmdInfo);
+  uint8_t bitfieldCount = getMBACommandBitFieldCount(cmdInfo);
+  if (bitfields && bitfieldCount > 0) {
+    printDecodedBitFields(decoded, bitfields);
+  }
+}
+
+/**
+ * @brief Prints one result of a batch, or sends its frame in OUTPUT_MODE_BINARY.
+ *
+ * @param slot   Result filled by runMBABatch or a script step.
+ * @param timed  true to add the decoding and the printing to the stats (MBA_PHASE_DECODE, MBA_PHASE_PRINT).
+ */
+static void outputMBABatchSlot(const MBABatchSlot* slot, bool timed) {
+  uint32_t startedAt = getMBAStatsTime();
+  uint32_t decodeUs = 0;
+  bool decodedResponse = false;
+
+  if (getOutputMode() == OUTPUT_MODE_BINARY) {
+    sendTelemetryResponse(slot->id, &slot->response);
+  } else {
+    const MBACommandInfo* cmdInfo = getMBACommandInfo(slot->id);
+    printMBACommandInfo(cmdInfo);
+
+    if (slot->response.error != 0) {
+      printMBACommandError(slot->response.error);
+    } else if (!isMBACommandWriteOnly(cmdInfo)) {
+      DecodedBitFields decoded;
+      uint32_t decodeStartedAt = getMBAStatsTime();
+      decodeMBAResponse(cmdInfo, &slot->response, &decoded);
+      decodeUs = getMBAStatsTime() - decodeStartedAt;
+      decodedResponse = true;
+      printDecodedMBAResponse(cmdInfo, &slot->response, &decoded);
     }
+    Log.println();
+  }
+
+  if (timed) {
+    if (decodedResponse) {
+      recordMBAPhase(MBA_PHASE_DECODE, decodeUs);
+    }
+    recordMBAPhase(MBA_PHASE_PRINT, getMBAStatsTime() - startedAt - decodeUs);
+  }
+}
+
+/**
+ * @brief Prints one result of a batch, as printMBABatch but without timing it.
+ *
+ * Leaves the stats tables alone, so the output core of a station can call it while the
+ * station core records the bus phases (see printScriptRecord).
+ *
+ * @param slot  Result filled by runMBABatch or a script step.
+ */
+void printMBABatchSlot(const MBABatchSlot* slot) {
+  outputMBABatchSlot(slot, false);
+}
+
+/**
+ * @brief Prints the results of a batch run by runMBABatch.
+ *
+ * For each slot this prints the command info, then either the error or the response
+ * (length, data in the command display format and bit fields when the command has some),
+ * in the same layout as runMBACommand.
+ * In OUTPUT_MODE_BINARY each slot is sent as a telemetry frame instead.
+ *
+ * @param slots  Results filled by runMBABatch.
+ * @param count  Number of slots.
+ */
+void printMBABatch(const MBABatchSlot* slots, uint8_t count) {
+  for (uint8_t i = 0; i < count; i++) {
+    outputMBABatchSlot(&slots[i], true);
   }
-  Serial.println();
 }
\ No newline at end of file
@@ -4,20 +4,6 @@
 #include <Arduino.h>
 #include "bqcmd.h"
 
-/**
- * @brief Reverses the byte order of a buffer (endianness).
- *
- * This function swaps the bytes of the given buffer in-place, effectively reversing the order.
- * It is typically used to convert between little-endian and big-endian representations.
- *
- * @param buffer Pointer to the byte buffer to reverse.
- * @param bufferSize Number of bytes in the buffer.
- *
- * For example, if the input buffer contains {0x12, 0x34, 0x56, 0x78}, the result after calling
- * this function will be {0x78, 0x56, 0x34, 0x12}.
- */
-void reverseBufferEndian(uint8_t *buffer, size_t bufferSize);
-
 /**
  * @brief Prints the contents of a byte buffer to the Serial monitor in multiple formats.
  *
@@ -41,29 +27,87 @@ void reverseBufferEndian(uint8_t *buffer, size_t bufferSize);
 void printBuffer(const uint8_t* buffer, size_t bufferSize, DisplayFormat displayFormat);
 
 /**
- * @brief Prints the state of individual bit fields from a buffer based on provided metadata.
+ * @brief Returns the mask of the bits of a register that can be decoded.
  *
- * This function reads specific bits from a byte buffer and prints a human-readable description
- * for each, based on an array of `BitFieldInfo` structures. Bits are accessed in MSB-first order.
+ * @param bitfieldsCount  Number of bits described by the bit field table.
+ * @param length          Payload bytes received.
  *
- * @param buffer Pointer to the byte buffer containing the bit fields.
- * @param bufferSize Number of bytes in the buffer.
- * @param bitfields Pointer to an array of `BitFieldInfo` structures defining each bit field.
- * @param bitfieldsCount Number of bit fields to process from the `bitfields` array.
+ * @return The bits that are both described and received.
+ */
+uint32_t getBitFieldsMask(uint8_t bitfieldsCount, uint8_t length);
+
+// Entry of a bit that the bit field table does not describe
+#define BIT_FIELD_UNKNOWN 0xFF
+
+// Set bits of a register matched to their bit field entries, printed later (see decodeBitFields)
+struct DecodedBitFields {
+  uint32_t bits;        // Set bits within the decoded mask
+  uint8_t entries[32];  // Entry of each set bit in the table, by bit index, or BIT_FIELD_UNKNOWN
+};
+
+/**
+ * @brief Finds the bit field entries of the bits set in a register value, without printing.
+ *
+ * Decoding stage of printBitFields, so that it can be timed apart from the output (see MBA_PHASE_DECODE).
+ *
+ * @param value           Register value (see getMBAResponseValue).
+ * @param mask            Bits to decode (see getBitFieldsMask).
+ * @param bitfields       Bit field table (points into PROGMEM).
+ * @param bitfieldsCount  Number of entries of the `bitfields` array.
+ * @param decoded         Output, only the entries of the set bits are written.
+ */
+void decodeBitFields(uint32_t value, uint32_t mask, const BitFieldInfo* bitfields, uint8_t bitfieldsCount,
+                     DecodedBitFields* decoded);
+
+/**
+ * @brief Prints the bit fields found by decodeBitFields, as printBitFields.
+ *
+ * @param decoded    Set bits and their entries.
+ * @param bitfields  Bit field table given to decodeBitFields.
+ */
+void printDecodedBitFields(const DecodedBitFields* decoded, const BitFieldInfo* bitfields);
+
+/**
+ * @brief Prints the bit fields that are set in a register value.
+ *
+ * The register is decoded as a single word: when no bit of `mask` is set a single line is printed,
+ * otherwise only the set bits are visited (count trailing zeros, then clear the lowest set bit), so a
+ * healthy pack costs one test per register instead of one line per bit.
+ *
+ * @param value           Register value (see getMBAResponseValue).
+ * @param mask            Bits to decode (see getBitFieldsMask).
+ * @param bitfields       Pointer to an array of `BitFieldInfo` structures defining each bit field.
+ * @param bitfieldsCount  Number of entries of the `bitfields` array.
  *
  * Each `BitFieldInfo` entry defines the bit index, a label, the value meaning when the bit is set (`activeValue`),
- * the meaning when cleared (`inactiveValue`), and an optional description. The function prints these to the Serial monitor.
+ * and an optional description. The `bitfields` array is expected to live in PROGMEM and is read through
+ * the getBitField* accessors.
+ *
+ * Example output:
+ * @code
+ * Bit 3 (GAUGE): 1 = Enabled - Gas Gauging.
+ * Bit 6 (PF): 1 = Enabled - Permanent Failure functionality.
+ * @endcode
+ */
+void printBitFields(uint32_t value, uint32_t mask, const BitFieldInfo* bitfields, uint8_t bitfieldsCount);
+
+/**
+ * @brief Prints the bit fields of a register that changed between two samples.
  *
- * The function performs safe bounds checking to avoid reading beyond the buffer.
+ * Prints the register name with its old and new value, then one line per bit that flipped,
+ * with the same wording as printBitFields. Only the changed bits are visited.
+ *
+ * @param cmdInfo   Command the values belong to (points into PROGMEM).
+ * @param previous  Previous register value.
+ * @param current   Current register value.
  *
  * Example output:
  * @code
- * Bit 5 (Power): 1 = On
- * Bit 6 (Error): 0 = No Error
- * Bit 7 (Ready): 1 = Ready to start
+ * SafetyAlert: 0x00000000 -> 0x00000002
+ *   Bit 1 (COV): 0 -> 1 = Detected - Cell Overvoltage
  * @endcode
  */
-void printBitFields(uint8_t* buffer, size_t bufferSize, const BitFieldInfo* bitfields, uint8_t bitfieldsCount);
+void printBitFieldChanges(const MBACommandInfo* cmdInfo, uint32_t previous, uint32_t current);
 
 /**
  * @brief Prints a human-readable error message corresponding to an I2C transmission result code.
@@ -79,6 +123,10 @@ void printBitFields(uint8_t* buffer, size_t bufferSize, const BitFieldInfo* bitf
  *                - 3: Received NACK on transmit of data
  *                - 4: Other error
  *                - 5: Timeout
+ *                - 6 (MBA_ERROR_NO_DATA): No data available to read
+ *                - 7 (MBA_ERROR_ECHO_TIMEOUT): Response never echoed the subcommand
+ *                - 8 (MBA_ERROR_COMPLETION_TIMEOUT): Device never reported completion
+ *                - 9 (MBA_ERROR_PEC): Packet error checking failed on every attempt
  *                - Default: Unknown error code
  *
  * @note A return value of 0 (success) is not handled in this function and should be checked separately.
@@ -98,8 +146,73 @@ void printMBACommandError(int result);
  *
  * @note The subcommand is displayed as two bytes (LSB and MSB), and data bytes (if any)
  *       are printed in 0xXX format. The `dataLength` field must be properly initialized.
+ *       `cmdInfo` points into PROGMEM and is read through the getMBACommand* accessors.
  */
 
 void printMBACommandInfo(const MBACommandInfo* cmdInfo);
 
+/**
+ * @brief Prints the value of an SBS word register with its unit.
+ *
+ * @param regInfo  Register the value belongs to (points into PROGMEM).
+ * @param value    Raw word read by readSBSWord.
+ *
+ * Example output:
+ * @code
+ * Voltage (0x09): 11542 mV
+ * Temperature (0x08): 24.6 C
+ * @endcode
+ */
+void printSBSRegister(const SBSRegisterInfo* regInfo, uint16_t value);
+
+/**
+ * @brief Prints a ManufacturerBlockAccess response read by readMBAResponse.
+ *
+ * This is the formatting stage of a read, kept apart from the I2C transaction so it can be
+ * deferred or skipped. It prints the block length, the data (subcommand echo then payload)
+ * in the command display format, then the bit fields when the command has some.
+ *
+ * @param cmdInfo   Command the response belongs to (points into PROGMEM).
+ * @param response  Response to print, must not be in error.
+ */
+void printMBAResponse(const MBACommandInfo* cmdInfo, const MBAResponse* response);
+
+/**
+ * @brief Decodes the bit fields of a ManufacturerBlockAccess response, first stage of printMBAResponse.
+ *
+ * @param cmdInfo   Command the response belongs to (points into PROGMEM).
+ * @param response  Response to decode, must not be in error.
+ * @param decoded   Output, no bit set when the command has no bit fields.
+ */
+void decodeMBAResponse(const MBACommandInfo* cmdInfo, const MBAResponse* response, DecodedBitFields* decoded);
+
+/**
+ * @brief Prints a response decoded by decodeMBAResponse, second stage of printMBAResponse.
+ *
+ * @param cmdInfo   Command the response belongs to (points into PROGMEM).
+ * @param response  Response to print, must not be in error.
+ * @param decoded   Bit fields of the response.
+ */
+void printDecodedMBAResponse(const MBACommandInfo* cmdInfo, const MBAResponse* response, const DecodedBitFields* decoded);
+
+/**
+ * @brief Prints one result of a batch, as printMBABatch but without timing it.
+ *
+ * @param slot  Result filled by runMBABatch or a script step.
+ */
+void printMBABatchSlot(const MBABatchSlot* slot);
+
+/**
+ * @brief Prints the results of a batch run by runMBABatch.
+ *
+ * For each slot this prints the command info, then either the error or the response
+ * (length, data in the command display format and bit fields when the command has some),
+ * in the same layout as runMBACommand.
+ * In OUTPUT_MODE_BINARY each slot is sent as a telemetry frame instead.
+ *
+ * @param slots  Results filled by runMBABatch.
+ * @param count  Number of slots.
+ */
+void printMBABatch(const MBABatchSlot* slots, uint8_t count);
+
 #endif // UTILITY_H
\ No newline at end of file